@@ -81,6 +81,13 @@ public:
      */
     virtual void close() = 0;
 
+    /**
+     * @brief Prepare the transports of the accepted clients for an event loop run by multiple threads.
+     * Must be called before open().
+     * @return false if the acceptor does not support multi-threading
+     */
+    virtual bool enable_multi_threading()   {   return false;   }
+
 protected:
     Listener* myListener = nullptr;
 };
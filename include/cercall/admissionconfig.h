@@ -0,0 +1,60 @@
+/*!
+ * \file
+ * \brief     Cercall admission control configuration
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ADMISSIONCONFIG_H
+#define CERCALL_ADMISSIONCONFIG_H
+
+#include <chrono>
+#include <cstddef>
+
+namespace cercall {
+
+/**
+ * @brief The limits of the work which the clients of a service may start, @see Service::set_admission_config().
+ * A call over a limit is rejected with Error::quota_exceeded() before its arguments are deserialized,
+ * a one-way call over a limit is dropped. A zero value disables the limit.
+ */
+struct AdmissionConfig
+{
+    /** The sustained rate of the calls of one client, one-way calls included. */
+    double callsPerSecond = 0.0;
+    /**
+     * The number of calls a client may make at once above the sustained rate, the capacity of its token bucket.
+     * The bucket of a new client is full. Values below 1 allow one call.
+     */
+    double callBurst = 1.0;
+    /** The number of calls in progress of one client. */
+    std::size_t maxPendingCallsPerClient = 0;
+    /** The number of calls in progress of each function, counted over all clients. */
+    std::size_t maxPendingCallsPerFunction = 0;
+    /**
+     * The target of the event loop lag, the time a function posted to the event loop of a client transport
+     * waits behind the handlers queued before it. When the lag stays above the target for lagInterval,
+     * the service sheds calls with Error::service_overloaded() until the lag drops, @see details::LagShedder.
+     * One-way calls are not shed. The lag is measured only through the transports supporting
+     * Transport::post(), see Transport::can_post().
+     */
+    std::chrono::microseconds lagTarget { 0 };
+    std::chrono::microseconds lagInterval { 100000 };
+};
+
+}   //namespace cercall
+
+#endif // CERCALL_ADMISSIONCONFIG_H
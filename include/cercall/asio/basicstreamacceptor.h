@@ -54,11 +54,28 @@ public:
 
     virtual void set_socket_options(typename StreamProtocol::acceptor& acceptor) = 0;
 
+    /**
+     * Set the configuration applied to every accepted client transport.
+     */
+    void set_transport_config(const StreamTransportConfig& config)
+    {
+        myTransportConfig = config;
+    }
+
     bool is_open() const override
     {
         return myAcceptor.is_open();
     }
 
+    /**
+     * The accepted client transports serialize their handlers on strands.
+     */
+    bool enable_multi_threading() override
+    {
+        myMultiThreaded = true;
+        return true;
+    }
+
     void open(int maxPendingClientConnections = -1) override
     {
         log<trace>(O_LOG_TOKEN, "");
@@ -101,11 +118,34 @@ public:
         }
     }
 
+protected:
+
+    /**
+     * Create the transport for an accepted client socket.
+     * Derived classes can override it to set up a different transport type.
+     * @return the client transport, or null pointer when the client connection shall be dropped
+     */
+    virtual std::shared_ptr<Transport> create_transport(SocketPtr socket)
+    {
+        std::shared_ptr<TransportType> clientTr { new TransportType(socket) };
+        StreamTransportConfig config = myTransportConfig;
+        config.useStrand = config.useStrand || myMultiThreaded;
+        clientTr->set_config(config);
+        return clientTr;
+    }
+
+    const StreamTransportConfig& get_transport_config() const
+    {
+        return myTransportConfig;
+    }
+
 private:
 
     ::asio::io_service& myIoService;
     EndpointType myEndpoint;
     typename StreamProtocol::acceptor myAcceptor;
+    StreamTransportConfig myTransportConfig;
+    bool myMultiThreaded = false;
 
     void start_accept()
     {
@@ -113,8 +153,10 @@ private:
         SocketPtr socket { new SocketType(myIoService) };
         myAcceptor.async_accept(*socket, [this, socket] (const ErrorCode& ec) {
             if ( !ec && is_open()) {
-                std::shared_ptr<TransportType> clientTr { new TransportType(socket) };
-                myListener->on_client_accepted(clientTr);
+                std::shared_ptr<Transport> clientTr = create_transport(socket);
+                if (clientTr) {
+                    myListener->on_client_accepted(clientTr);
+                }
             } else if (is_open() || ec != ::asio::error::operation_aborted) {
                 log<error>(O_LOG_TOKEN, "async_accept error - %s", ec.message().c_str());
                 myListener->on_accept_error(cercall::Error(ec));
@@ -24,8 +24,10 @@
 
 #include "cercall/transport.h"
 #include "cercall/asio/errorcode.h"
+#include "cercall/details/receivebuffer.h"
 #include "cercall/log.h"
 #include <deque>
+#include <vector>
 #include <memory>
 #include <functional>
 #include <array>
@@ -34,6 +36,36 @@
 namespace cercall {
 namespace asio {
 
+/**
+ * @brief Configuration of a stream transport.
+ */
+struct StreamTransportConfig
+{
+    /**
+     * When true, write() does not block - messages are appended to an outgoing queue,
+     * which is written to the socket asynchronously.
+     * Messages written in the same io_service turn are passed to the socket in one gather write.
+     */
+    bool asyncWrite = false;
+    /** Outgoing queue size in bytes, at which Transport::Listener::on_write_queue_high() is called. */
+    std::size_t writeQueueHighWatermark = 4u * 1024u * 1024u;
+    /** Outgoing queue size in bytes, at which Transport::Listener::on_write_queue_low() is called. */
+    std::size_t writeQueueLowWatermark = 1024u * 1024u;
+    /**
+     * When greater than 0, the transport reads ahead with async_read_some into a reusable receive
+     * buffer of this size, and passes all received data to the listener in one notification,
+     * instead of reading exactly the length requested with read().
+     * The buffer grows when a message longer than its size is requested.
+     */
+    std::size_t receiveBufferSize = 0;
+    /**
+     * When true, the completion handlers of the transport are serialized on a strand, so the transport
+     * can be used with an io_service run by multiple threads.
+     * Other threads must access the transport through Transport::dispatch() then.
+     */
+    bool useStrand = false;
+};
+
 template<class StreamProtocol>
 class BasicStreamTransport : public Transport
 {
@@ -68,26 +100,83 @@ public:
 
     virtual void set_socket_options(typename StreamProtocol::socket&) {}
 
+    /**
+     * Set the transport configuration.
+     * The configuration must be set before the transport is opened.
+     */
+    void set_config(const StreamTransportConfig& config)
+    {
+        o_assert(config.writeQueueLowWatermark <= config.writeQueueHighWatermark);
+        myConfig = config;
+        myRecvBuffer = details::ReceiveBuffer(config.receiveBufferSize);
+        if (config.useStrand && !myStrand) {
+            myStrand.reset(new StrandType(mySocket->get_executor()));
+        } else if ( !config.useStrand) {
+            myStrand.reset();
+        }
+    }
+
+    const StreamTransportConfig& get_config() const
+    {
+        return myConfig;
+    }
+
     void read(uint32_t len) override
     {
+        if (myConfig.receiveBufferSize > 0) {
+            myRequestedLen = len;
+            if ( !myReadInProgress && !myDeliveringData) {
+                start_read_some();
+            }
+            return;
+        }
         myBuffer.resize(len);
         auto sharedThis = std::static_pointer_cast<BasicStreamTransport<StreamProtocol>>(this->shared_from_this());
-        ::asio::async_read(*mySocket, ::asio::buffer(&myBuffer[0], len),
-                           std::bind(&BasicStreamTransport::handle_recv, sharedThis,
-                                     std::placeholders::_1, std::placeholders::_2));
+        start_async([this, len](auto&& handler) {
+                        ::asio::async_read(*mySocket, ::asio::buffer(&myBuffer[0], len), std::move(handler));
+                    },
+                    std::bind(&BasicStreamTransport::handle_recv, sharedThis,
+                              std::placeholders::_1, std::placeholders::_2));
     }
 
-    const std::string& get_read_data() override
+    bool reads_ahead() const override
     {
-        return myBuffer;
+        return myConfig.receiveBufferSize > 0;
+    }
+
+    DataView get_read_data() override
+    {
+        if (myConfig.receiveBufferSize == 0) {
+            return DataView(myBuffer);
+        }
+        if (myRequestedLen > 0) {
+            //The consumed data stays in place until the next read is started.
+            o_assert(myRecvBuffer.size() >= myRequestedLen);
+            myReadView = DataView(myRecvBuffer.data(), myRequestedLen);
+            myRecvBuffer.consume(myRequestedLen);
+            myRequestedLen = 0;
+        }
+        return myReadView;
     }
 
     Error write(const std::string& msg) override
+    {
+        const DataView buffer(msg);
+        return write(&buffer, 1u);
+    }
+
+    Error write(const DataView* buffers, std::size_t count) override
     {
         Error result;
-        if (is_open()) {
+        if (is_open() && myConfig.asyncWrite) {
+            enqueue_write(buffers, count);
+        } else if (is_open()) {
+            myGatherBuffers.clear();
+            for (std::size_t i = 0; i < count; ++i) {
+                myGatherBuffers.push_back(::asio::buffer(buffers[i].data(), buffers[i].size()));
+            }
             ErrorCode ec;
-            ::asio::write(*mySocket, ::asio::buffer(msg), ec);
+            ::asio::write(*mySocket, myGatherBuffers, ec);
             if (ec)
             {
                 log<error>(O_LOG_TOKEN, "write error - %s", ec.message().c_str());
@@ -100,6 +189,52 @@ public:
         return result;
     }
 
+    std::size_t get_write_queue_size() const override
+    {
+        return myWriteQueueSize;
+    }
+
+    void dispatch(std::function<void()> f) override
+    {
+        if (myStrand) {
+            ::asio::dispatch(*myStrand, std::move(f));
+        } else {
+            f();
+        }
+    }
+
+    bool running_in_this_thread() const override
+    {
+        return !myStrand || myStrand->running_in_this_thread();
+    }
+
+    bool can_post() const override
+    {
+        return true;
+    }
+
+    void post(std::function<void()> f) override
+    {
+        if (myStrand) {
+            ::asio::post(*myStrand, std::move(f));
+        } else {
+            ::asio::post(mySocket->get_executor(), std::move(f));
+        }
+    }
+
+    /** With asynchronous writes, the listener is notified when the pending write of the queue completes. */
+    void request_write_ready() override
+    {
+        if (myWriteQueue.empty()) {
+            Transport::request_write_ready();
+        } else {
+            myWriteReadyRequested = true;
+        }
+    }
+
+    /**
+     * @note Messages still waiting in the outgoing queue are discarded.
+     */
     void close() override
     {
         log<trace>(O_LOG_TOKEN, "");
@@ -108,7 +243,7 @@ public:
             myState = State::CLOSED;
             log<debug>(O_LOG_TOKEN, "shutdown socket");
             ErrorCode ec;
-            mySocket->shutdown(::asio::ip::tcp::socket::shutdown_both, ec);
+            mySocket->shutdown(StreamProtocol::socket::shutdown_both, ec);
             if (ec) {
                 log<error>(O_LOG_TOKEN, "shutdown error - %s", ec.message().c_str());
             }
@@ -143,7 +278,163 @@ protected:
 
 private:
 
+    using StrandType = ::asio::strand<typename StreamProtocol::socket::executor_type>;
+
     std::string myBuffer;
+    StreamTransportConfig myConfig;
+    std::unique_ptr<StrandType> myStrand;
+    details::ReceiveBuffer myRecvBuffer;
+    std::size_t myRequestedLen = 0;
+    DataView myReadView;
+    bool myReadInProgress = false;
+    bool myDeliveringData = false;
+    std::vector<::asio::const_buffer> myGatherBuffers;
+    std::deque<std::string> myWriteQueue;
+    std::size_t myWriteQueueSize = 0;
+    std::size_t myWriteBatchCount = 0;      ///< number of queued messages passed to the pending async_write
+    bool myWriteInProgress = false;
+    bool myFlushPosted = false;
+    bool myWriteQueueHigh = false;
+    bool myWriteReadyRequested = false;
+
+    /**
+     * Start an asynchronous operation, binding its completion handler to the strand if the strand is used.
+     * @param initiation a function starting the operation with the passed completion handler
+     */
+    template<typename Initiation, typename Handler>
+    void start_async(Initiation&& initiation, Handler&& handler)
+    {
+        if (myStrand) {
+            initiation(::asio::bind_executor(*myStrand, std::forward<Handler>(handler)));
+        } else {
+            initiation(std::forward<Handler>(handler));
+        }
+    }
+
+    void enqueue_write(const DataView* buffers, std::size_t count)
+    {
+        std::size_t len = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            len += buffers[i].size();
+        }
+        myWriteQueue.emplace_back();
+        std::string& msg = myWriteQueue.back();
+        msg.reserve(len);
+        for (std::size_t i = 0; i < count; ++i) {
+            msg.append(buffers[i].data(), buffers[i].size());
+        }
+        myWriteQueueSize += len;
+        if ( !myWriteQueueHigh && myWriteQueueSize >= myConfig.writeQueueHighWatermark) {
+            myWriteQueueHigh = true;
+            if (myListener != nullptr) {
+                myListener->on_write_queue_high(*this, myWriteQueueSize);
+            }
+        }
+        if ( !myWriteInProgress && !myFlushPosted) {
+            //Let other messages written in this io_service turn join the write.
+            myFlushPosted = true;
+            auto sharedThis = std::static_pointer_cast<BasicStreamTransport<StreamProtocol>>(this->shared_from_this());
+            auto flush = std::bind(&BasicStreamTransport::flush_write_queue, sharedThis);
+            if (myStrand) {
+                ::asio::post(*myStrand, flush);
+            } else {
+                ::asio::post(mySocket->get_executor(), flush);
+            }
+        }
+    }
+
+    void flush_write_queue()
+    {
+        myFlushPosted = false;
+        if ( !myWriteInProgress && !myWriteQueue.empty() && myState == State::OPEN) {
+            start_write();
+        }
+    }
+
+    void start_write()
+    {
+        o_assert( !myWriteQueue.empty());
+        myWriteInProgress = true;
+        myWriteBatchCount = myWriteQueue.size();
+        myGatherBuffers.clear();
+        for (const std::string& msg : myWriteQueue) {
+            myGatherBuffers.push_back(::asio::buffer(msg));
+        }
+        auto sharedThis = std::static_pointer_cast<BasicStreamTransport<StreamProtocol>>(this->shared_from_this());
+        start_async([this](auto&& handler) {
+                        ::asio::async_write(*mySocket, myGatherBuffers, std::move(handler));
+                    },
+                    std::bind(&BasicStreamTransport::handle_write, sharedThis,
+                              std::placeholders::_1, std::placeholders::_2));
+    }
+
+    void handle_write(const ErrorCode& ec, std::size_t)
+    {
+        myWriteInProgress = false;
+        if (ec) {
+            if ( !(::asio::error::operation_aborted == ec && myState == State::CLOSED)) {
+                log<error>(O_LOG_TOKEN, "write error - %s", ec.message().c_str());
+                if (myListener != nullptr) {
+                    myListener->on_connection_error(*this, Error(ec));
+                }
+            }
+            myWriteQueue.clear();
+            myWriteQueueSize = 0;
+            myWriteBatchCount = 0;
+            myWriteReadyRequested = false;
+            close();
+            return;
+        }
+        for (; myWriteBatchCount > 0; --myWriteBatchCount) {
+            myWriteQueueSize -= myWriteQueue.front().size();
+            myWriteQueue.pop_front();
+        }
+        if (myWriteQueueHigh && myWriteQueueSize <= myConfig.writeQueueLowWatermark) {
+            myWriteQueueHigh = false;
+            if (myListener != nullptr) {
+                myListener->on_write_queue_low(*this, myWriteQueueSize);
+            }
+        }
+        if (myWriteReadyRequested) {
+            myWriteReadyRequested = false;
+            notify_write_ready();
+        }
+        if ( !myWriteQueue.empty() && myState == State::OPEN) {
+            start_write();
+        }
+    }
+
+    void start_read_some()
+    {
+        //Read at least a quarter of the buffer size at once, otherwise make room for it first.
+        myRecvBuffer.prepare(myRequestedLen, std::max<std::size_t>(myConfig.receiveBufferSize / 4u, 1u));
+        myReadInProgress = true;
+        auto sharedThis = std::static_pointer_cast<BasicStreamTransport<StreamProtocol>>(this->shared_from_this());
+        start_async([this](auto&& handler) {
+                        mySocket->async_read_some(::asio::buffer(myRecvBuffer.write_ptr(), myRecvBuffer.write_space()),
+                                                  std::move(handler));
+                    },
+                    std::bind(&BasicStreamTransport::handle_recv_some, sharedThis,
+                              std::placeholders::_1, std::placeholders::_2));
+    }
+
+    void handle_recv_some(const ErrorCode& ec, std::size_t bytesTransferred)
+    {
+        myReadInProgress = false;
+        if (ec) {
+            handle_recv(ec, bytesTransferred);
+        } else {
+            myRecvBuffer.commit(bytesTransferred);
+            o_assert(myListener != nullptr);
+            //The listener consumes all complete messages from the buffer with get_read_data().
+            myDeliveringData = true;
+            myListener->on_incoming_data(*this, myRecvBuffer.size());
+            myDeliveringData = false;
+            if (myState == State::OPEN) {
+                start_read_some();
+            }
+        }
+    }
 
     void handle_recv(const ErrorCode& ec, std::size_t bytesTransferred)
     {
@@ -0,0 +1,97 @@
+/*!
+ * \file
+ * \brief     Cercall client Transport for Asio local (Unix domain) stream sockets
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_CLIENTLOCALTRANSPORT_H
+#define CERCALL_ASIO_CLIENTLOCALTRANSPORT_H
+
+#include "cercall/asio/localtransport.h"
+#include "cercall/cercall.h"
+
+#ifdef CERCALL_ASIO_HAS_LOCAL_SOCKETS
+
+namespace cercall {
+namespace asio {
+
+class ClientLocalTransport : public LocalTransport
+{
+public:
+    /**
+     * @param path the path of the service socket, @see make_local_endpoint()
+     */
+    ClientLocalTransport(::asio::io_service& ios, const std::string& path)
+        : LocalTransport(ios), myEndpoint(make_local_endpoint(path)) {}
+
+    bool open() override
+    {
+        if (myState == State::NEW) {
+            ErrorCode ec;
+            mySocket->connect(myEndpoint, ec);
+            if (ec) {
+                myListener->on_connection_error(*this, Error(ec));
+                return false;
+            } else {
+                return LocalTransport::open();
+            }
+        } else {
+            const char* stateStr = (myState == State::OPEN) ? "OPEN" : "CLOSED";
+            log<error>(O_LOG_TOKEN, "can't open transport in %s state", stateStr);
+            return false;
+        }
+    }
+
+    void open(const cercall::Closure<bool>& cl) override
+    {
+        o_assert(myListener != nullptr);
+
+        if (myState == State::NEW) {
+            auto sharedThis = std::static_pointer_cast<ClientLocalTransport>(this->shared_from_this());
+            mySocket->async_connect(myEndpoint, std::bind(&ClientLocalTransport::handle_connect, sharedThis, cl,
+                                                          std::placeholders::_1));
+        } else {
+            const char* stateStr = (myState == State::OPEN) ? "OPEN" : "CLOSED";
+            log<error>(O_LOG_TOKEN, "can't open transport in %s state", stateStr);
+            Result<bool> result { false, Error { std::make_error_code(std::errc::already_connected) } };
+            cl(result);
+        }
+    }
+
+private:
+
+    void handle_connect(const cercall::Closure<bool>& cl, const ErrorCode& ec)
+    {
+        if (ec) {
+            log<error>(O_LOG_TOKEN, "connect error - %s", ec.message().c_str());
+            myListener->on_connection_error(*this, Error { ec });
+            cl(Result<bool> { false, Error { ec } });
+        } else {
+            bool result = LocalTransport::open();
+            cl(Result<bool> { result });
+        }
+    }
+
+    ::asio::local::stream_protocol::endpoint myEndpoint;
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_HAS_LOCAL_SOCKETS
+
+#endif // CERCALL_ASIO_CLIENTLOCALTRANSPORT_H
@@ -0,0 +1,90 @@
+/*!
+ * \file
+ * \brief     Cercall client in-process loopback transport
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_CLIENTLOOPBACKTRANSPORT_H
+#define CERCALL_ASIO_CLIENTLOOPBACKTRANSPORT_H
+
+#include "cercall/asio/loopbacktransport.h"
+#include "cercall/cercall.h"
+
+namespace cercall {
+namespace asio {
+
+/**
+ * @brief Client transport connecting to a LoopbackAcceptor of the same process.
+ * The service must use the io_service of the client.
+ */
+class ClientLoopbackTransport : public LoopbackTransport
+{
+public:
+    /**
+     * @param name the name of the service, @see LoopbackAcceptor
+     */
+    ClientLoopbackTransport(::asio::io_service& ios, const std::string& name)
+        : LoopbackTransport(ios), myName(name) {}
+
+    bool open() override
+    {
+        if (myState == State::NEW) {
+            loopback::ConnectFunction connect = loopback::Registry::instance().find(myName);
+            if ( !connect) {
+                log<error>(O_LOG_TOKEN, "no loopback service %s", myName.c_str());
+                myListener->on_connection_error(*this, Error { ECONNREFUSED, "loopback service not found" });
+                return false;
+            }
+            //The service is linked first, so that the messages written in on_connected() reach it.
+            connect(std::static_pointer_cast<LoopbackTransport>(this->shared_from_this()));
+            return LoopbackTransport::open();
+        } else {
+            const char* stateStr = (myState == State::OPEN) ? "OPEN" : "CLOSED";
+            log<error>(O_LOG_TOKEN, "can't open transport in %s state", stateStr);
+            return false;
+        }
+    }
+
+    void open(const cercall::Closure<bool>& cl) override
+    {
+        o_assert(myListener != nullptr);
+
+        if (myState == State::NEW) {
+            auto sharedThis = std::static_pointer_cast<ClientLoopbackTransport>(this->shared_from_this());
+            myIoService.post([sharedThis, cl]() {
+                if (sharedThis->open()) {
+                    cl(Result<bool> { true });
+                } else {
+                    cl(Result<bool> { false, Error { ECONNREFUSED, "loopback service not found" } });
+                }
+            });
+        } else {
+            const char* stateStr = (myState == State::OPEN) ? "OPEN" : "CLOSED";
+            log<error>(O_LOG_TOKEN, "can't open transport in %s state", stateStr);
+            Result<bool> result { false, Error { std::make_error_code(std::errc::already_connected) } };
+            cl(result);
+        }
+    }
+
+private:
+    std::string myName;
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_CLIENTLOOPBACKTRANSPORT_H
@@ -0,0 +1,134 @@
+/*!
+ * \file
+ * \brief     Cercall client shared memory ring Transport
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_CLIENTSHMTRANSPORT_H
+#define CERCALL_ASIO_CLIENTSHMTRANSPORT_H
+
+#include "cercall/asio/shmtransport.h"
+#include "cercall/cercall.h"
+
+#ifdef CERCALL_ASIO_HAS_SHM_TRANSPORT
+
+namespace cercall {
+namespace asio {
+
+/**
+ * @brief Client side of the shared memory ring transport.
+ * Connects to the local socket of a ShmAcceptor and receives the shared memory segment from it.
+ */
+class ClientShmTransport : public ShmTransport
+{
+public:
+    /**
+     * @param path the path of the service socket, @see make_local_endpoint()
+     */
+    ClientShmTransport(::asio::io_service& ios, const std::string& path)
+        : ShmTransport(ios), myEndpoint(make_local_endpoint(path)) {}
+
+    bool open() override
+    {
+        if (myState == State::NEW) {
+            ErrorCode ec;
+            mySocket->connect(myEndpoint, ec);
+            if ( !ec) {
+                ec = receive_segment();
+            }
+            if (ec) {
+                myListener->on_connection_error(*this, Error(ec));
+                return false;
+            } else {
+                return ShmTransport::open();
+            }
+        } else {
+            const char* stateStr = (myState == State::OPEN) ? "OPEN" : "CLOSED";
+            log<error>(O_LOG_TOKEN, "can't open transport in %s state", stateStr);
+            return false;
+        }
+    }
+
+    void open(const cercall::Closure<bool>& cl) override
+    {
+        o_assert(myListener != nullptr);
+
+        if (myState == State::NEW) {
+            auto sharedThis = std::static_pointer_cast<ClientShmTransport>(this->shared_from_this());
+            mySocket->async_connect(myEndpoint, std::bind(&ClientShmTransport::handle_connect, sharedThis, cl,
+                                                          std::placeholders::_1));
+        } else {
+            const char* stateStr = (myState == State::OPEN) ? "OPEN" : "CLOSED";
+            log<error>(O_LOG_TOKEN, "can't open transport in %s state", stateStr);
+            Result<bool> result { false, Error { std::make_error_code(std::errc::already_connected) } };
+            cl(result);
+        }
+    }
+
+private:
+
+    ErrorCode receive_segment()
+    {
+        ErrorCode ec;
+        int fds[shm::HANDSHAKE_FD_COUNT];
+        if (shm::receive_fds(mySocket->native_handle(), fds, ec)) {
+            ec = attach(fds[0], fds[1], fds[2], false);
+        }
+        return ec;
+    }
+
+    void handle_connect(const cercall::Closure<bool>& cl, const ErrorCode& ec)
+    {
+        if (ec) {
+            handle_open_error(cl, ec, "connect");
+        } else {
+            auto sharedThis = std::static_pointer_cast<ClientShmTransport>(this->shared_from_this());
+            mySocket->async_wait(::asio::socket_base::wait_read,
+                                 std::bind(&ClientShmTransport::handle_segment_ready, sharedThis, cl,
+                                           std::placeholders::_1));
+        }
+    }
+
+    void handle_segment_ready(const cercall::Closure<bool>& cl, ErrorCode ec)
+    {
+        if ( !ec) {
+            ec = receive_segment();
+        }
+        if (ec) {
+            handle_open_error(cl, ec, "segment");
+        } else {
+            bool result = ShmTransport::open();
+            cl(Result<bool> { result });
+        }
+    }
+
+    void handle_open_error(const cercall::Closure<bool>& cl, const ErrorCode& ec, const char* stage)
+    {
+        log<error>(O_LOG_TOKEN, "%s error - %s", stage, ec.message().c_str());
+        myListener->on_connection_error(*this, Error { ec });
+        cl(Result<bool> { false, Error { ec } });
+    }
+
+    ::asio::local::stream_protocol::endpoint myEndpoint;
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_HAS_SHM_TRANSPORT
+
+#endif // CERCALL_ASIO_CLIENTSHMTRANSPORT_H
@@ -0,0 +1,130 @@
+/*!
+ * \file
+ * \brief     Cercall client UDP datagram transport
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_CLIENTUDPTRANSPORT_H
+#define CERCALL_ASIO_CLIENTUDPTRANSPORT_H
+
+#include "cercall/asio/udptransport.h"
+#include "cercall/cercall.h"
+
+#ifdef CERCALL_ASIO_HAS_UDP_TRANSPORT
+
+namespace cercall {
+namespace asio {
+
+/**
+ * @brief Client transport sending datagrams to a UdpAcceptor.
+ * The transport has its own socket connected to the service address, so it receives
+ * only the datagrams of the service. Opening it does not contact the service.
+ */
+class ClientUdpTransport : public UdpTransport
+{
+public:
+    ClientUdpTransport(::asio::io_service& ios, const std::string& hostName, const std::string& serviceName,
+                       const DatagramConfig& config = DatagramConfig())
+        : UdpTransport(std::make_shared<DatagramSocket>(ios, config), nullptr),
+          myHostName(hostName), myServiceName(serviceName), myResolver(ios) {}
+
+    bool open() override
+    {
+        using ::asio::ip::udp;
+
+        if (myState == State::NEW) {
+            udp::resolver::query query(udp::v4(), myHostName, myServiceName);
+            ErrorCode ec;
+            udp::resolver::iterator iterator = myResolver.resolve(query, ec);
+            if ( !ec) {
+                ::asio::connect(mySocket->socket(), iterator, ec);
+            }
+            if (ec) {
+                myListener->on_connection_error(*this, Error(ec));
+                return false;
+            }
+            return open_socket();
+        } else {
+            const char* stateStr = (myState == State::OPEN) ? "OPEN" : "CLOSED";
+            log<error>(O_LOG_TOKEN, "can't open transport in %s state", stateStr);
+            return false;
+        }
+    }
+
+    void open(const cercall::Closure<bool>& cl) override
+    {
+        using ::asio::ip::udp;
+
+        o_assert(myListener != nullptr);
+
+        if (myState == State::NEW) {
+            udp::resolver::query query(udp::v4(), myHostName, myServiceName);
+            auto sharedThis = std::static_pointer_cast<ClientUdpTransport>(this->shared_from_this());
+            myResolver.async_resolve(query, [sharedThis, cl](const ErrorCode& ec, udp::resolver::iterator i) {
+                ErrorCode connectEc = ec;
+                if ( !connectEc) {
+                    ::asio::connect(sharedThis->mySocket->socket(), i, connectEc);
+                }
+                if (connectEc) {
+                    log<error>(O_LOG_TOKEN, "connect error - %s", connectEc.message().c_str());
+                    sharedThis->myListener->on_connection_error(*sharedThis, Error { connectEc });
+                    cl(Result<bool> { false, Error { connectEc } });
+                } else {
+                    cl(Result<bool> { sharedThis->open_socket() });
+                }
+            });
+        } else {
+            const char* stateStr = (myState == State::OPEN) ? "OPEN" : "CLOSED";
+            log<error>(O_LOG_TOKEN, "can't open transport in %s state", stateStr);
+            Result<bool> result { false, Error { std::make_error_code(std::errc::already_connected) } };
+            cl(result);
+        }
+    }
+
+    void close() override
+    {
+        if (myState == State::OPEN) {
+            mySocket->close();
+        }
+        UdpTransport::close();
+    }
+
+private:
+
+    bool open_socket()
+    {
+        std::weak_ptr<UdpTransport> weakThis = std::static_pointer_cast<UdpTransport>(shared_from_this());
+        mySocket->start_receive([weakThis](const Endpoint&, const DataView& datagram) {
+            std::shared_ptr<UdpTransport> tr = weakThis.lock();
+            if (tr) {
+                tr->deliver(datagram);
+            }
+        });
+        return UdpTransport::open();
+    }
+
+    std::string myHostName;
+    std::string myServiceName;
+    ::asio::ip::udp::resolver myResolver;
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_HAS_UDP_TRANSPORT
+
+#endif // CERCALL_ASIO_CLIENTUDPTRANSPORT_H
@@ -31,4 +31,8 @@
 namespace asio = boost::asio;
 #endif
 
+#if defined(ASIO_HAS_LOCAL_SOCKETS) || defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+#define CERCALL_ASIO_HAS_LOCAL_SOCKETS
+#endif
+
 #endif //CERCALL_ASIO_CONFIG_H
@@ -64,6 +64,24 @@ inline const Error& Error::operation_in_progress()
     return *err;
 }
 
+inline const Error& Error::function_not_supported()
+{
+    static std::unique_ptr<Error> err = cercall::make_unique<Error>(asio::ErrorCode(ENOSYS, asio::system_category()));
+    return *err;
+}
+
+inline const Error& Error::service_overloaded()
+{
+    static std::unique_ptr<Error> err = cercall::make_unique<Error>(asio::ErrorCode(EAGAIN, asio::system_category()));
+    return *err;
+}
+
+inline const Error& Error::quota_exceeded()
+{
+    static std::unique_ptr<Error> err = cercall::make_unique<Error>(asio::ErrorCode(EDQUOT, asio::system_category()));
+    return *err;
+}
+
 }   //namespace cercall
 
 #endif // CERCALL_ASIO_ERROR_CODE_H
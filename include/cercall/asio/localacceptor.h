@@ -0,0 +1,92 @@
+/*!
+ * \file
+ * \brief     Cercall Acceptor class for Asio local (Unix domain) stream sockets
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_LOCALACCEPTOR_H
+#define CERCALL_ASIO_LOCALACCEPTOR_H
+
+#include "cercall/asio/basicstreamacceptor.h"
+#include "cercall/asio/localtransport.h"
+
+#ifdef CERCALL_ASIO_HAS_LOCAL_SOCKETS
+
+#include <cstdio>
+
+namespace cercall {
+namespace asio {
+
+/**
+ * @brief Acceptor of local (Unix domain) stream socket connections.
+ * A socket file left over from a previous service instance is removed before binding,
+ * the socket file is also removed when the acceptor is closed.
+ * Sockets in the abstract namespace (path starting with '@') leave no file behind.
+ */
+class LocalAcceptor : public BasicStreamAcceptor<::asio::local::stream_protocol>
+{
+public:
+
+    /**
+     * @param path the path of the service socket, @see make_local_endpoint()
+     */
+    LocalAcceptor(::asio::io_service& ios, const std::string& path)
+        : BasicStreamAcceptor(ios, make_local_endpoint(path)), myPath(path)
+    {}
+
+    virtual ~LocalAcceptor() noexcept(false)
+    {
+        close();
+    }
+
+    void set_socket_options(::asio::local::stream_protocol::acceptor&) override
+    {
+    }
+
+    void open(int maxPendingClientConnections = -1) override
+    {
+        if ( !is_open()) {
+            remove_socket_file();
+        }
+        BasicStreamAcceptor::open(maxPendingClientConnections);
+    }
+
+    void close() override
+    {
+        if (is_open()) {
+            BasicStreamAcceptor::close();
+            remove_socket_file();
+        }
+    }
+
+private:
+    std::string myPath;
+
+    void remove_socket_file()
+    {
+        if ( !myPath.empty() && myPath[0] != '@') {
+            std::remove(myPath.c_str());
+        }
+    }
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_HAS_LOCAL_SOCKETS
+
+#endif // CERCALL_ASIO_LOCALACCEPTOR_H
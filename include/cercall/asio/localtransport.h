@@ -0,0 +1,59 @@
+/*!
+ * \file
+ * \brief     Cercall Transport for Asio local (Unix domain) stream sockets
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_LOCALTRANSPORT_H
+#define CERCALL_ASIO_LOCALTRANSPORT_H
+
+#include "cercall/asio/basicstreamtransport.h"
+
+#ifdef CERCALL_ASIO_HAS_LOCAL_SOCKETS
+
+namespace cercall {
+namespace asio {
+
+/**
+ * @brief Create a local socket endpoint.
+ * @param path the file system path of the socket; a path starting with '@' denotes a name
+ *        in the Linux abstract socket namespace (the '@' is replaced with a null character)
+ */
+inline ::asio::local::stream_protocol::endpoint make_local_endpoint(const std::string& path)
+{
+    if ( !path.empty() && path[0] == '@') {
+        return ::asio::local::stream_protocol::endpoint(std::string(1, '\0') + path.substr(1));
+    } else {
+        return ::asio::local::stream_protocol::endpoint(path);
+    }
+}
+
+class LocalTransport : public BasicStreamTransport<::asio::local::stream_protocol>
+{
+public:
+    using SocketType = typename BasicStreamTransport<::asio::local::stream_protocol>::SocketType;
+
+    LocalTransport(::asio::io_service& ios) : BasicStreamTransport(ios) {}
+    LocalTransport(SocketType s) : BasicStreamTransport(s) {}
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_HAS_LOCAL_SOCKETS
+
+#endif // CERCALL_ASIO_LOCALTRANSPORT_H
@@ -0,0 +1,99 @@
+/*!
+ * \file
+ * \brief     Cercall in-process loopback acceptor
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_LOOPBACKACCEPTOR_H
+#define CERCALL_ASIO_LOOPBACKACCEPTOR_H
+
+#include "cercall/acceptor.h"
+#include "cercall/asio/loopbacktransport.h"
+#include "cercall/log.h"
+
+namespace cercall {
+namespace asio {
+
+/**
+ * @brief Acceptor of ClientLoopbackTransport connections from the same process.
+ * While open, the acceptor is registered under its name in the process wide registry of loopback services.
+ * The clients must use the io_service of the acceptor.
+ */
+class LoopbackAcceptor : public Acceptor
+{
+public:
+
+    /**
+     * @param name the name of the service, unique in the process
+     */
+    LoopbackAcceptor(::asio::io_service& ios, const std::string& name)
+        : myIoService(ios), myName(name)
+    {
+        log<trace>(O_LOG_TOKEN, "");
+    }
+
+    virtual ~LoopbackAcceptor() noexcept(false)
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        close();
+    }
+
+    bool is_open() const override
+    {
+        return myOpen;
+    }
+
+    void open(int = -1) override
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        if (myListener == nullptr) {
+            throw std::logic_error("cercall::asio::LoopbackAcceptor: listener is NULL");
+        }
+        if (myOpen) {
+            return;
+        }
+        myOpen = loopback::Registry::instance().add(myName, [this](const std::shared_ptr<LoopbackTransport>& clientTr) {
+            o_assert(&clientTr->get_io_service() == &myIoService);
+            std::shared_ptr<LoopbackTransport> serviceTr { new LoopbackTransport(myIoService) };
+            LoopbackTransport::link(clientTr, serviceTr);
+            myListener->on_client_accepted(serviceTr);
+        });
+        if ( !myOpen) {
+            log<error>(O_LOG_TOKEN, "loopback service %s exists", myName.c_str());
+            myListener->on_accept_error(Error { EADDRINUSE, "loopback service name in use" });
+        }
+    }
+
+    void close() override
+    {
+        if (myOpen) {
+            log<debug>(O_LOG_TOKEN, "close acceptor");
+            loopback::Registry::instance().remove(myName);
+            myOpen = false;
+        }
+    }
+
+private:
+    ::asio::io_service& myIoService;
+    std::string myName;
+    bool myOpen = false;
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_LOOPBACKACCEPTOR_H
@@ -0,0 +1,297 @@
+/*!
+ * \file
+ * \brief     Cercall in-process loopback transport
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_LOOPBACKTRANSPORT_H
+#define CERCALL_ASIO_LOOPBACKTRANSPORT_H
+
+#include "cercall/transport.h"
+#include "cercall/asio/errorcode.h"
+#include "cercall/details/receivebuffer.h"
+#include "cercall/log.h"
+#include <map>
+#include <mutex>
+
+namespace cercall {
+namespace asio {
+
+class LoopbackTransport;
+
+namespace loopback {
+
+/**
+ * A function connecting a client transport to a loopback service.
+ * It creates the service side transport, links it with the client transport and notifies the service.
+ */
+using ConnectFunction = std::function<void(const std::shared_ptr<LoopbackTransport>& clientTransport)>;
+
+/** The loopback services of the process, by name. */
+class Registry
+{
+public:
+    static Registry& instance()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    /** @return false if a service of the name is registered already */
+    bool add(const std::string& name, ConnectFunction f)
+    {
+        std::lock_guard<std::mutex> lock { myMutex };
+        return myServices.emplace(name, std::move(f)).second;
+    }
+
+    void remove(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock { myMutex };
+        myServices.erase(name);
+    }
+
+    /** @return the connect function of the service, empty if no service of the name is registered */
+    ConnectFunction find(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock { myMutex };
+        auto found = myServices.find(name);
+        return (found != myServices.end()) ? found->second : ConnectFunction();
+    }
+
+private:
+    std::mutex myMutex;
+    std::map<std::string, ConnectFunction> myServices;
+};
+
+}   //namespace loopback
+
+/**
+ * @brief One end of an in-process connection between a client and a service.
+ * Written messages are appended directly to the receive buffer of the peer transport, which delivers them
+ * to its listener in a handler posted to the io_service. No sockets are involved, but the messages are still
+ * serialized, so the transport is a drop-in replacement of the socket transports.
+ * Both ends must be used by the thread running the io_service.
+ */
+class LoopbackTransport : public Transport
+{
+public:
+
+    LoopbackTransport(::asio::io_service& ios) : myIoService(ios)
+    {
+        log<trace>(O_LOG_TOKEN, "");
+    }
+
+    LoopbackTransport(const LoopbackTransport&) = delete;
+    LoopbackTransport& operator=(const LoopbackTransport&) = delete;
+
+    virtual ~LoopbackTransport() noexcept(false)
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        if (myState == State::OPEN) {
+            close();
+        }
+    }
+
+    /** Link the two transports, so that the data written to one is received by the other one. */
+    static void link(const std::shared_ptr<LoopbackTransport>& a, const std::shared_ptr<LoopbackTransport>& b)
+    {
+        a->myPeer = b;
+        b->myPeer = a;
+    }
+
+    ::asio::io_service& get_io_service()
+    {
+        return myIoService;
+    }
+
+    bool can_post() const override
+    {
+        return true;
+    }
+
+    void post(std::function<void()> f) override
+    {
+        myIoService.post(std::move(f));
+    }
+
+    bool is_open() override
+    {
+        return myState == State::OPEN;
+    }
+
+    /** Open the service side transport, which is already linked with its client. */
+    bool open() override
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        o_assert(myListener != nullptr);
+        o_assert(myState == State::NEW);
+        myState = State::OPEN;
+        myListener->on_connected(*this);
+        return true;
+    }
+
+    /** Not to be used, but to be overriden by derived classes. */
+    void open(const cercall::Closure<bool>&) override
+    {
+    }
+
+    void close() override
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        if (myState == State::OPEN) {
+            myState = State::CLOSED;
+            std::shared_ptr<LoopbackTransport> peer = myPeer.lock();
+            myPeer.reset();
+            if (peer) {
+                //The peer sees the end of the stream, like the peer of a closed socket.
+                myIoService.post([peer]() {
+                    peer->handle_peer_closed();
+                });
+            }
+            if (myListener) {
+                myListener->on_disconnected(*this);
+            }
+        }
+    }
+
+    void read(uint32_t len) override
+    {
+        myRequestedLen = len;
+        if ( !myDeliveringData) {
+            schedule_delivery();
+        }
+    }
+
+    bool reads_ahead() const override
+    {
+        return true;
+    }
+
+    DataView get_read_data() override
+    {
+        if (myRequestedLen > 0) {
+            //The consumed data stays in place until the next data is received.
+            o_assert(myRecvBuffer.size() >= myRequestedLen);
+            myReadView = DataView(myRecvBuffer.data(), myRequestedLen);
+            myRecvBuffer.consume(myRequestedLen);
+            myRequestedLen = 0;
+        }
+        return myReadView;
+    }
+
+    Error write(const std::string& msg) override
+    {
+        const DataView buffer(msg);
+        return write(&buffer, 1u);
+    }
+
+    Error write(const DataView* buffers, std::size_t count) override
+    {
+        if ( !is_open()) {
+            return Error { ENOTCONN, "loopback transport not connected" };
+        }
+        std::shared_ptr<LoopbackTransport> peer = myPeer.lock();
+        if ( !peer || peer->myState == State::CLOSED) {
+            //Like a write to a socket whose peer is gone, the write fails and closes the transport.
+            close();
+            return Error { EPIPE, "loopback peer closed" };
+        }
+        peer->receive(buffers, count);
+        return Error();
+    }
+
+protected:
+
+    enum class State
+    {
+        NEW, OPEN, CLOSED
+    };
+
+    State myState = State::NEW;
+    ::asio::io_service& myIoService;
+
+private:
+
+    std::weak_ptr<LoopbackTransport> myPeer;
+    details::ReceiveBuffer myRecvBuffer;
+    std::string myDeferredData;         ///< data received while the listener reads from myRecvBuffer
+    std::size_t myRequestedLen = 0;
+    DataView myReadView;
+    bool myDeliveringData = false;
+    bool myDeliveryPosted = false;
+
+    void receive(const DataView* buffers, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i) {
+            if (myDeliveringData) {
+                //Appending could move the data viewed by the listener.
+                myDeferredData.append(buffers[i].data(), buffers[i].size());
+            } else {
+                myRecvBuffer.append(buffers[i].data(), buffers[i].size());
+            }
+        }
+        schedule_delivery();
+    }
+
+    void schedule_delivery()
+    {
+        if (myDeliveryPosted || myState == State::CLOSED || myRequestedLen == 0
+            || myRecvBuffer.size() + myDeferredData.size() < myRequestedLen) {
+            return;
+        }
+        myDeliveryPosted = true;
+        auto sharedThis = std::static_pointer_cast<LoopbackTransport>(shared_from_this());
+        myIoService.post([sharedThis]() {
+            sharedThis->deliver();
+        });
+    }
+
+    void deliver()
+    {
+        myDeliveryPosted = false;
+        if (myState != State::OPEN || myListener == nullptr) {
+            return;
+        }
+        if ( !myDeferredData.empty()) {
+            myRecvBuffer.append(myDeferredData.data(), myDeferredData.size());
+            myDeferredData.clear();
+        }
+        if (myRequestedLen == 0 || myRecvBuffer.size() < myRequestedLen) {
+            return;
+        }
+        //The listener consumes all complete messages from the buffer with get_read_data().
+        myDeliveringData = true;
+        myListener->on_incoming_data(*this, myRecvBuffer.size());
+        myDeliveringData = false;
+        schedule_delivery();
+    }
+
+    void handle_peer_closed()
+    {
+        if (myState == State::OPEN) {
+            if (myListener != nullptr) {
+                myListener->on_connection_error(*this, Error(ErrorCode(::asio::error::eof)));
+            }
+            close();
+        }
+    }
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_LOOPBACKTRANSPORT_H
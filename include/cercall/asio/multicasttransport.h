@@ -0,0 +1,275 @@
+/*!
+ * \file
+ * \brief     Cercall multicast transports for service events
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_MULTICASTTRANSPORT_H
+#define CERCALL_ASIO_MULTICASTTRANSPORT_H
+
+#include "cercall/asio/udptransport.h"
+#include "cercall/cercall.h"
+
+#ifdef CERCALL_ASIO_HAS_UDP_TRANSPORT
+
+#include <arpa/inet.h>
+
+namespace cercall {
+namespace asio {
+
+/**
+ * @brief Configuration of a multicast event channel.
+ */
+struct MulticastConfig : DatagramConfig
+{
+    /** The time-to-live of the datagrams, 1 keeps them in the local network segment. */
+    int hops = 1;
+    /** Whether the datagrams are delivered to the subscribers on the publishing host too. */
+    bool loopback = true;
+};
+
+/**
+ * @brief The size of the sequence number, which precedes the messages in every multicast datagram.
+ */
+static constexpr std::size_t MULTICAST_SEQUENCE_SIZE = sizeof(uint32_t);
+
+/**
+ * @brief Service side of a multicast event channel, see Service::set_event_channel().
+ * Every message is sent once to the multicast group, in one datagram preceded by a sequence number,
+ * which lets the subscribers detect lost datagrams.
+ * The transport only sends, it does not need a listener.
+ */
+class MulticastPublisher : public UdpTransport
+{
+public:
+    /**
+     * @param groupAddress the address of the multicast group, e.g. "239.255.0.1"
+     * @param port the port of the subscribers
+     */
+    MulticastPublisher(::asio::io_service& ios, const std::string& groupAddress, unsigned short port,
+                       const MulticastConfig& config = MulticastConfig())
+        : MulticastPublisher(ios, Endpoint(::asio::ip::address::from_string(groupAddress), port), config) {}
+
+    bool open() override
+    {
+        if (myState != State::NEW) {
+            log<error>(O_LOG_TOKEN, "can't open transport twice");
+            return false;
+        }
+        ErrorCode ec;
+        ::asio::ip::udp::socket& socket = mySocket->socket();
+        socket.open(myGroup.protocol(), ec);
+        if ( !ec) {
+            socket.set_option(::asio::ip::multicast::hops(myConfig.hops), ec);
+        }
+        if ( !ec) {
+            socket.set_option(::asio::ip::multicast::enable_loopback(myConfig.loopback), ec);
+        }
+        if (ec) {
+            log<error>(O_LOG_TOKEN, "can't open multicast socket - %s", ec.message().c_str());
+            if (myListener) {
+                myListener->on_connection_error(*this, Error(ec));
+            }
+            return false;
+        }
+        myState = State::OPEN;
+        return true;
+    }
+
+    void open(const cercall::Closure<bool>& cl) override
+    {
+        cl(Result<bool> { open() });
+    }
+
+    void close() override
+    {
+        if (myState == State::OPEN) {
+            mySocket->close();
+        }
+        UdpTransport::close();
+    }
+
+    Error write(const std::string& msg) override
+    {
+        const DataView buffer(msg);
+        return write(&buffer, 1u);
+    }
+
+    /** Send the buffers in one datagram preceded by the next sequence number. */
+    Error write(const DataView* buffers, std::size_t count) override
+    {
+        const uint32_t seq = htonl(myNextSequence);
+        myBuffers.clear();
+        myBuffers.emplace_back(reinterpret_cast<const char*>(&seq), sizeof(seq));
+        myBuffers.insert(myBuffers.end(), buffers, buffers + count);
+        Error err = UdpTransport::write(myBuffers.data(), myBuffers.size());
+        if ( !err) {
+            ++myNextSequence;
+        }
+        return err;
+    }
+
+    /** @return the sequence number of the next datagram */
+    uint32_t get_next_sequence() const
+    {
+        return myNextSequence;
+    }
+
+private:
+    Endpoint myGroup;
+    MulticastConfig myConfig;
+    uint32_t myNextSequence = 0;
+    std::vector<DataView> myBuffers;
+
+    MulticastPublisher(::asio::io_service& ios, const Endpoint& group, const MulticastConfig& config)
+        : UdpTransport(std::make_shared<DatagramSocket>(ios, config), &group), myGroup(group), myConfig(config) {}
+};
+
+/**
+ * @brief Client side of a multicast event channel, see Client::open_event_channel().
+ * The transport joins the multicast group and passes the received messages to its listener.
+ * A gap in the sequence numbers means lost datagrams, it is reported to the gap handler,
+ * datagrams which arrive late, after a newer one, are dropped.
+ */
+class MulticastSubscriber : public UdpTransport
+{
+public:
+    /** The gap handler gets the number of datagrams lost since the last received datagram. */
+    using GapHandler = std::function<void(uint32_t lostCount)>;
+
+    /**
+     * @param groupAddress the address of the multicast group, e.g. "239.255.0.1"
+     * @param port the port the datagrams are sent to
+     */
+    MulticastSubscriber(::asio::io_service& ios, const std::string& groupAddress, unsigned short port,
+                        const DatagramConfig& config = DatagramConfig())
+        : UdpTransport(std::make_shared<DatagramSocket>(ios, config), nullptr),
+          myGroup(::asio::ip::address::from_string(groupAddress), port) {}
+
+    bool open() override
+    {
+        using ::asio::ip::udp;
+
+        if (myState != State::NEW) {
+            log<error>(O_LOG_TOKEN, "can't open transport twice");
+            return false;
+        }
+        ErrorCode ec;
+        udp::socket& socket = mySocket->socket();
+        socket.open(myGroup.protocol(), ec);
+        if ( !ec) {
+            socket.set_option(udp::socket::reuse_address(true), ec);
+        }
+        if ( !ec) {
+            socket.bind(udp::endpoint(myGroup.protocol(), myGroup.port()), ec);
+        }
+        if ( !ec) {
+            socket.set_option(::asio::ip::multicast::join_group(myGroup.address()), ec);
+        }
+        if (ec) {
+            log<error>(O_LOG_TOKEN, "can't join multicast group - %s", ec.message().c_str());
+            if (myListener) {
+                myListener->on_connection_error(*this, Error(ec));
+            }
+            mySocket->close();
+            return false;
+        }
+        std::weak_ptr<MulticastSubscriber> weakThis = std::static_pointer_cast<MulticastSubscriber>(shared_from_this());
+        mySocket->start_receive([weakThis](const Endpoint&, const DataView& datagram) {
+            std::shared_ptr<MulticastSubscriber> tr = weakThis.lock();
+            if (tr) {
+                tr->receive(datagram);
+            }
+        });
+        return UdpTransport::open();
+    }
+
+    void open(const cercall::Closure<bool>& cl) override
+    {
+        cl(Result<bool> { open() });
+    }
+
+    void close() override
+    {
+        if (myState == State::OPEN) {
+            mySocket->close();
+        }
+        UdpTransport::close();
+    }
+
+    Error write(const std::string&) override
+    {
+        return Error { EOPNOTSUPP, "multicast subscriber does not send" };
+    }
+
+    Error write(const DataView*, std::size_t) override
+    {
+        return Error { EOPNOTSUPP, "multicast subscriber does not send" };
+    }
+
+    void set_gap_handler(GapHandler h)
+    {
+        myGapHandler = std::move(h);
+    }
+
+    /** @return the number of datagrams lost since the transport was opened */
+    uint64_t get_lost_count() const
+    {
+        return myLostCount;
+    }
+
+private:
+    Endpoint myGroup;
+    GapHandler myGapHandler;
+    uint32_t myExpectedSequence = 0;
+    bool myHasSequence = false;
+    uint64_t myLostCount = 0;
+
+    void receive(const DataView& datagram)
+    {
+        if (datagram.size() < MULTICAST_SEQUENCE_SIZE) {
+            log<error>(O_LOG_TOKEN, "invalid multicast datagram dropped");
+            return;
+        }
+        uint32_t seq;
+        std::memcpy(&seq, datagram.data(), sizeof(seq));
+        seq = ntohl(seq);
+        //The difference is signed, so the sequence numbers may wrap around.
+        const int32_t diff = static_cast<int32_t>(seq - myExpectedSequence);
+        if (myHasSequence && diff < 0) {
+            log<debug>(O_LOG_TOKEN, "late datagram %u dropped", seq);
+            return;
+        }
+        if (myHasSequence && diff > 0) {
+            log<error>(O_LOG_TOKEN, "%d multicast datagrams lost", diff);
+            myLostCount += static_cast<uint32_t>(diff);
+            if (myGapHandler) {
+                myGapHandler(static_cast<uint32_t>(diff));
+            }
+        }
+        myHasSequence = true;
+        myExpectedSequence = seq + 1;
+        deliver(DataView(datagram.data() + MULTICAST_SEQUENCE_SIZE, datagram.size() - MULTICAST_SEQUENCE_SIZE));
+    }
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_HAS_UDP_TRANSPORT
+
+#endif // CERCALL_ASIO_MULTICASTTRANSPORT_H
@@ -0,0 +1,224 @@
+/*!
+ * \file
+ * \brief     Cercall sharded service - one service instance and event loop per thread
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_SHARDEDSERVICE_H
+#define CERCALL_ASIO_SHARDEDSERVICE_H
+
+#include "cercall/asio/config.h"
+#include "cercall/log.h"
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace cercall {
+namespace asio {
+
+/**
+ * @brief Runs several instances of a service, each one in its own thread with its own io_service.
+ * The shards share nothing, each service instance is single-threaded. Typically each shard listens
+ * on the same port with a TcpAcceptor with SO_REUSEPORT set, so the kernel distributes the client
+ * connections among the shards.
+ * A service instance is constructed, started, stopped and destroyed by the thread of its shard.
+ * The service events can be broadcast to the clients of all shards with broadcast_event().
+ */
+template<class ServiceType>
+class ShardedService
+{
+public:
+    using EventType = typename ServiceType::EventType;
+
+    /**
+     * A function creating the service instance of a shard, called by the shard thread.
+     * @param ios the io_service of the shard
+     * @param shardIndex index of the shard, from 0 to the number of shards - 1
+     */
+    using ServiceFactory = std::function<std::shared_ptr<ServiceType>(::asio::io_service& ios, unsigned shardIndex)>;
+
+    ShardedService(unsigned shardCount, ServiceFactory factory) : myFactory(factory)
+    {
+        o_assert(shardCount > 0);
+        for (unsigned i = 0; i < shardCount; ++i) {
+            myShards.emplace_back(new Shard);
+        }
+    }
+
+    ShardedService(const ShardedService&) = delete;
+    ShardedService& operator=(const ShardedService&) = delete;
+
+    ~ShardedService()
+    {
+        stop();
+    }
+
+    /**
+     * @brief Start the shard threads, create and start the service instances.
+     * The function returns when all service instances are started.
+     * @param maxPendingClientConnections @see Acceptor::open()
+     * @throw the exception thrown by the creation or start of a service instance, the started shards are stopped then
+     */
+    void start(int maxPendingClientConnections = -1)
+    {
+        if (myRunning) {
+            return;
+        }
+        myRunning = true;
+        std::vector<std::future<void>> started;
+        for (unsigned i = 0; i < myShards.size(); ++i) {
+            Shard& shard = *myShards[i];
+            std::shared_ptr<std::promise<void>> promise = std::make_shared<std::promise<void>>();
+            started.push_back(promise->get_future());
+            shard.myIoService.reset();
+            shard.myWork.reset(new ::asio::io_service::work(shard.myIoService));
+            shard.myIoService.post([this, &shard, i, promise, maxPendingClientConnections]() {
+                try {
+                    shard.myService = myFactory(shard.myIoService, i);
+                    shard.myService->start(maxPendingClientConnections);
+                    promise->set_value();
+                } catch (...) {
+                    shard.myService.reset();
+                    promise->set_exception(std::current_exception());
+                }
+            });
+            shard.myThread = std::thread(&ShardedService::run_shard, std::ref(shard));
+        }
+        try {
+            for (std::future<void>& f : started) {
+                f.get();
+            }
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+
+    /**
+     * @brief Stop and destroy the service instances, join the shard threads.
+     * Must not be called from a shard thread.
+     */
+    void stop()
+    {
+        if ( !myRunning) {
+            return;
+        }
+        for (std::unique_ptr<Shard>& shard : myShards) {
+            Shard* s = shard.get();
+            s->myIoService.post([s]() {
+                if (s->myService) {
+                    s->myService->stop();
+                    s->myService.reset();
+                }
+                s->myWork.reset();
+                s->myIoService.stop();
+            });
+        }
+        for (std::unique_ptr<Shard>& shard : myShards) {
+            if (shard->myThread.joinable()) {
+                shard->myThread.join();
+            }
+        }
+        myRunning = false;
+    }
+
+    unsigned get_shard_count() const
+    {
+        return static_cast<unsigned>(myShards.size());
+    }
+
+    /** @return the io_service of the shard */
+    ::asio::io_service& get_io_service(unsigned shardIndex)
+    {
+        return myShards.at(shardIndex)->myIoService;
+    }
+
+    /**
+     * @brief Run the function with the service instance of each shard, in the shard thread.
+     * The function returns immediately, the function object is copied to each shard.
+     */
+    void for_each_shard(std::function<void(ServiceType&)> f)
+    {
+        for (std::unique_ptr<Shard>& shard : myShards) {
+            Shard* s = shard.get();
+            s->myIoService.post([s, f]() {
+                if (s->myService) {
+                    f(*s->myService);
+                }
+            });
+        }
+    }
+
+    /**
+     * @brief Broadcast a non-polymorphic event to the clients of all shards.
+     * May be called from any thread, including the shard threads.
+     */
+    template<typename E = EventType>
+    typename std::enable_if<!std::is_polymorphic<E>{}>::type
+    broadcast_event(const E& ev)
+    {
+        for_each_shard([ev](ServiceType& service) {
+            service.broadcast_event(ev);
+        });
+    }
+
+    /**
+     * @brief Broadcast a polymorphic event to the clients of all shards.
+     * Each shard constructs its own event object from copies of the arguments.
+     * May be called from any thread, including the shard threads.
+     */
+    template<typename DerivedET, typename... EventArgs>
+    typename std::enable_if<std::is_polymorphic<EventType>{} && std::is_base_of<EventType, DerivedET>{}>::type
+    broadcast_event(const EventArgs&... args)
+    {
+        std::function<void(ServiceType&)> f = std::bind([](ServiceType& service, const EventArgs&... a) {
+            service.template broadcast_event<DerivedET>(a...);
+        }, std::placeholders::_1, args...);
+        for_each_shard(f);
+    }
+
+private:
+
+    struct Shard
+    {
+        ::asio::io_service myIoService;
+        std::unique_ptr<::asio::io_service::work> myWork;
+        std::shared_ptr<ServiceType> myService;
+        std::thread myThread;
+    };
+
+    ServiceFactory myFactory;
+    std::vector<std::unique_ptr<Shard>> myShards;
+    bool myRunning = false;
+
+    static void run_shard(Shard& shard)
+    {
+        try {
+            shard.myIoService.run();
+        } catch (const std::exception& e) {
+            log<error>(O_LOG_TOKEN, "shard stopped by exception: %s", e.what());
+            shard.myService.reset();    //the service must be destroyed by its own thread
+        }
+    }
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_SHARDEDSERVICE_H
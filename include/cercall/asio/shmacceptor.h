@@ -0,0 +1,102 @@
+/*!
+ * \file
+ * \brief     Cercall acceptor of shared memory ring transport connections
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_SHMACCEPTOR_H
+#define CERCALL_ASIO_SHMACCEPTOR_H
+
+#include "cercall/asio/localacceptor.h"
+#include "cercall/asio/shmtransport.h"
+
+#ifdef CERCALL_ASIO_HAS_SHM_TRANSPORT
+
+namespace cercall {
+namespace asio {
+
+/**
+ * @brief Acceptor of shared memory ring transport connections.
+ * Clients connect to a local socket, for each accepted client a new shared memory segment
+ * with a pair of rings is created and passed to the client together with the wake-up events.
+ */
+class ShmAcceptor : public LocalAcceptor
+{
+public:
+
+    /**
+     * @param path the path of the service socket, @see make_local_endpoint()
+     * @param ringCapacity the capacity of each ring in bytes, rounded up to a power of 2
+     */
+    ShmAcceptor(::asio::io_service& ios, const std::string& path,
+                std::size_t ringCapacity = shm::DEFAULT_RING_CAPACITY)
+        : LocalAcceptor(ios, path), myIoService(ios), myRingCapacity(shm::ring_capacity(ringCapacity))
+    {}
+
+    /** The shared memory transport is driven by a single thread. */
+    bool enable_multi_threading() override
+    {
+        return false;
+    }
+
+protected:
+
+    std::shared_ptr<Transport> create_transport(SocketPtr socket) override
+    {
+        ErrorCode ec;
+        int segmentFd = shm::create_segment(myRingCapacity, ec);
+        int clientEventFd = -1;
+        int serviceEventFd = -1;
+        if (segmentFd >= 0) {
+            clientEventFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            serviceEventFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (clientEventFd < 0 || serviceEventFd < 0) {
+                ec = shm::last_error();
+            } else {
+                const int fds[shm::HANDSHAKE_FD_COUNT] = { segmentFd, clientEventFd, serviceEventFd };
+                shm::send_fds(socket->native_handle(), fds, ec);
+            }
+        }
+        if (ec) {
+            log<error>(O_LOG_TOKEN, "can't set up shared memory - %s", ec.message().c_str());
+            for (int fd : { segmentFd, clientEventFd, serviceEventFd }) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            }
+            return nullptr;
+        }
+        std::shared_ptr<ShmTransport> clientTr { new ShmTransport(myIoService, socket, segmentFd,
+                                                                  serviceEventFd, clientEventFd) };
+        if (clientTr->get_attach_error()) {
+            return nullptr;
+        }
+        clientTr->set_config(get_transport_config());
+        return clientTr;
+    }
+
+private:
+    ::asio::io_service& myIoService;
+    std::size_t myRingCapacity;
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_HAS_SHM_TRANSPORT
+
+#endif // CERCALL_ASIO_SHMACCEPTOR_H
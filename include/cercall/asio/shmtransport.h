@@ -0,0 +1,633 @@
+/*!
+ * \file
+ * \brief     Cercall shared memory ring Transport
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_SHMTRANSPORT_H
+#define CERCALL_ASIO_SHMTRANSPORT_H
+
+#include "cercall/transport.h"
+#include "cercall/asio/localtransport.h"
+#include "cercall/details/receivebuffer.h"
+#include "cercall/details/spscring.h"
+#include "cercall/log.h"
+
+#if defined(CERCALL_ASIO_HAS_LOCAL_SOCKETS) && defined(__linux__)
+#define CERCALL_ASIO_HAS_SHM_TRANSPORT
+
+#include <cerrno>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cercall {
+namespace asio {
+namespace shm {
+
+/**
+ * Layout of the shared memory segment: the header, followed by the client-to-service ring
+ * and the service-to-client ring.
+ */
+struct SegmentHeader
+{
+    static constexpr std::uint32_t MAGIC = 0x43657243u;     //"CerC"
+    static constexpr std::uint32_t VERSION = 1u;
+
+    alignas(64) std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t ringCapacity;
+};
+
+static constexpr std::size_t DEFAULT_RING_CAPACITY = 1024u * 1024u;
+static constexpr std::size_t MIN_RING_CAPACITY = 4096u;
+
+/** Number of file descriptors passed from the service to the client: segment, client event, service event. */
+static constexpr std::size_t HANDSHAKE_FD_COUNT = 3u;
+
+inline std::size_t segment_size(std::size_t ringCapacity)
+{
+    return sizeof(SegmentHeader) + 2u * details::SpscRing::memory_size(ringCapacity);
+}
+
+inline void* ring_memory(void* segment, std::size_t ringCapacity, bool serviceToClient)
+{
+    char* mem = static_cast<char*>(segment) + sizeof(SegmentHeader);
+    return serviceToClient ? mem + details::SpscRing::memory_size(ringCapacity) : mem;
+}
+
+inline ErrorCode last_error()
+{
+    return ErrorCode(errno, system_category());
+}
+
+/** Round the capacity up to a power of 2, not less than MIN_RING_CAPACITY. */
+inline std::size_t ring_capacity(std::size_t requested)
+{
+    std::size_t capacity = MIN_RING_CAPACITY;
+    while (capacity < requested) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+/**
+ * Create an initialized shared memory segment.
+ * @return the file descriptor of the segment, or -1 on error
+ */
+inline int create_segment(std::size_t ringCapacity, ErrorCode& ec)
+{
+    int fd = ::memfd_create("cercall_shm", MFD_CLOEXEC);
+    if (fd < 0) {
+        ec = last_error();
+        return -1;
+    }
+    const std::size_t size = segment_size(ringCapacity);
+    void* mem = MAP_FAILED;
+    if (::ftruncate(fd, static_cast<off_t>(size)) == 0) {
+        mem = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mem == MAP_FAILED) {
+        ec = last_error();
+        ::close(fd);
+        return -1;
+    }
+    SegmentHeader* hdr = new (mem) SegmentHeader;
+    hdr->magic = SegmentHeader::MAGIC;
+    hdr->version = SegmentHeader::VERSION;
+    hdr->ringCapacity = ringCapacity;
+    details::SpscRing::init(ring_memory(mem, ringCapacity, false));
+    details::SpscRing::init(ring_memory(mem, ringCapacity, true));
+    ::munmap(mem, size);
+    return fd;
+}
+
+/** Pass file descriptors over a connected local socket. */
+inline bool send_fds(int sock, const int (&fds)[HANDSHAKE_FD_COUNT], ErrorCode& ec)
+{
+    char data = 'C';
+    iovec iov { &data, sizeof(data) };
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (::sendmsg(sock, &msg, MSG_NOSIGNAL) != sizeof(data)) {
+        ec = last_error();
+        return false;
+    }
+    return true;
+}
+
+/** Receive file descriptors passed with send_fds(). */
+inline bool receive_fds(int sock, int (&fds)[HANDSHAKE_FD_COUNT], ErrorCode& ec)
+{
+    char data = 0;
+    iovec iov { &data, sizeof(data) };
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t res;
+    do {
+        res = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (res < 0 && errno == EINTR);
+    if (res <= 0) {
+        ec = (res == 0) ? ErrorCode(::asio::error::eof) : last_error();
+        return false;
+    }
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        ec = ErrorCode(EPROTO, system_category());
+        return false;
+    }
+    std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    return true;
+}
+
+}   //namespace shm
+
+/**
+ * @brief A Transport moving messages through a pair of lock-free rings in a shared memory segment.
+ * The segment and two eventfd objects are set up by ShmAcceptor and passed to the client over
+ * a local socket, which is then only used to detect the disconnection of the peer.
+ * The peer is woken up with its eventfd only when a ring goes from empty to non-empty,
+ * or when the peer waits for free space in a full ring.
+ * The write() function never blocks - data which does not fit in the ring waits in a local
+ * buffer until the peer consumes data from the ring. The listener is notified when the buffer
+ * crosses the watermarks of StreamTransportConfig.
+ * The received messages are parsed in place in the ring, only a message which wraps around
+ * the end of the ring is copied to a local buffer.
+ */
+class ShmTransport : public Transport
+{
+public:
+    using SocketType = std::shared_ptr<::asio::local::stream_protocol::socket>;
+
+    ShmTransport(::asio::io_service& ios)
+        : mySocket { std::make_shared<::asio::local::stream_protocol::socket>(ios) }, myEvent(ios)
+    {
+        log<trace>(O_LOG_TOKEN, "io_service param");
+    }
+
+    /**
+     * Construct the service side of the transport from an accepted socket.
+     * The file descriptors are owned by the transport.
+     */
+    ShmTransport(::asio::io_service& ios, SocketType s, int segmentFd, int eventFd, int peerEventFd)
+        : mySocket(s), myEvent(ios)
+    {
+        log<trace>(O_LOG_TOKEN, "socket param");
+        myAttachError = attach(segmentFd, eventFd, peerEventFd, true);
+    }
+
+    ShmTransport(const ShmTransport&) = delete;
+    ShmTransport& operator=(const ShmTransport&) = delete;
+
+    virtual ~ShmTransport() noexcept(false)
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        if (myState != State::CLOSED) {
+            close();
+        }
+        release_segment();
+    }
+
+    bool is_open() override
+    {
+        return myState == State::OPEN;
+    }
+
+    /**
+     * Set the transport configuration.
+     * Only the write queue watermarks apply, the writes are always asynchronous.
+     */
+    void set_config(const StreamTransportConfig& config)
+    {
+        o_assert(config.writeQueueLowWatermark <= config.writeQueueHighWatermark);
+        myConfig = config;
+    }
+
+    const StreamTransportConfig& get_config() const
+    {
+        return myConfig;
+    }
+
+    /** @return error of attaching to the shared memory segment */
+    const ErrorCode& get_attach_error() const
+    {
+        return myAttachError;
+    }
+
+    void read(uint32_t len) override
+    {
+        myRequestedLen = len;
+    }
+
+    bool reads_ahead() const override
+    {
+        return true;
+    }
+
+    DataView get_read_data() override
+    {
+        if (myRequestedLen > 0) {
+            //The consumed data stays in place until the transport handles new data.
+            if (myReadingRing) {
+                o_assert(myRingData.size() - myRingReadPos >= myRequestedLen);
+                myReadView = DataView(myRingData.data() + myRingReadPos, myRequestedLen);
+                myRingReadPos += myRequestedLen;
+            } else {
+                o_assert(myRecvBuffer.size() >= myRequestedLen);
+                myReadView = DataView(myRecvBuffer.data(), myRequestedLen);
+                myRecvBuffer.consume(myRequestedLen);
+            }
+            myRequestedLen = 0;
+        }
+        return myReadView;
+    }
+
+    Error write(const std::string& msg) override
+    {
+        const DataView buffer(msg);
+        return write(&buffer, 1u);
+    }
+
+    Error write(const DataView* buffers, std::size_t count) override
+    {
+        if ( !is_open()) {
+            return Error { ENOTCONN, "transport not connected" };
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            write_data(buffers[i].data(), buffers[i].size());
+        }
+        if ( !check_rings()) {
+            return Error { EPROTO, "shared memory ring corrupted" };
+        }
+        const std::size_t queued = get_write_queue_size();
+        if ( !myWriteQueueHigh && queued >= myConfig.writeQueueHighWatermark) {
+            myWriteQueueHigh = true;
+            if (myListener != nullptr) {
+                myListener->on_write_queue_high(*this, queued);
+            }
+        }
+        return Error();
+    }
+
+    std::size_t get_write_queue_size() const override
+    {
+        return myPendingTx.size() - myPendingTxOffset;
+    }
+
+    bool can_post() const override
+    {
+        return true;
+    }
+
+    void post(std::function<void()> f) override
+    {
+        ::asio::post(mySocket->get_executor(), std::move(f));
+    }
+
+    void close() override
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        if (myState == State::OPEN) {
+            myState = State::CLOSED;
+            ErrorCode ec;
+            mySocket->shutdown(::asio::local::stream_protocol::socket::shutdown_both, ec);
+            mySocket->close(ec);
+            myEvent.close(ec);
+            if ( !myReadingRing) {
+                release_segment();      //otherwise released when the listener returns
+            }
+            if (myListener) {
+                myListener->on_disconnected(*this);
+            }
+        }
+    }
+
+    bool open() override
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        o_assert(myListener != nullptr);
+        o_assert(myState == State::NEW);
+        if (myAttachError || mySegment == nullptr) {
+            return false;
+        }
+        myState = State::OPEN;
+        myListener->on_connected(*this);
+        auto sharedThis = std::static_pointer_cast<ShmTransport>(this->shared_from_this());
+        start_wait_event(sharedThis);
+        mySocket->async_read_some(::asio::buffer(&myPeerByte, sizeof(myPeerByte)),
+                                  std::bind(&ShmTransport::handle_peer_read, sharedThis,
+                                            std::placeholders::_1, std::placeholders::_2));
+        return true;
+    }
+
+protected:
+
+    enum class State
+    {
+        NEW, OPEN, CLOSED
+    };
+
+    State myState = State::NEW;
+    SocketType mySocket;
+
+    /**
+     * Map the shared memory segment and take ownership of the file descriptors.
+     * @param serviceSide true for the service side of the connection
+     */
+    ErrorCode attach(int segmentFd, int eventFd, int peerEventFd, bool serviceSide)
+    {
+        ErrorCode ec;
+        myPeerEventFd = peerEventFd;
+        myEvent.assign(eventFd, ec);
+        if (ec) {
+            ::close(eventFd);
+        }
+        struct stat st;
+        if ( !ec && ::fstat(segmentFd, &st) != 0) {
+            ec = shm::last_error();
+        }
+        if ( !ec) {
+            void* mem = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ | PROT_WRITE,
+                               MAP_SHARED, segmentFd, 0);
+            if (mem == MAP_FAILED) {
+                ec = shm::last_error();
+            } else {
+                mySegment = mem;
+                mySegmentSize = static_cast<std::size_t>(st.st_size);
+            }
+        }
+        ::close(segmentFd);
+        if ( !ec) {
+            const shm::SegmentHeader* hdr = static_cast<const shm::SegmentHeader*>(mySegment);
+            const std::size_t capacity = static_cast<std::size_t>(hdr->ringCapacity);
+            if (hdr->magic != shm::SegmentHeader::MAGIC || hdr->version != shm::SegmentHeader::VERSION
+                    || mySegmentSize < shm::segment_size(capacity)) {
+                ec = ErrorCode(EPROTO, system_category());
+            } else {
+                myTxRing = details::SpscRing(shm::ring_memory(mySegment, capacity, serviceSide), capacity);
+                myRxRing = details::SpscRing(shm::ring_memory(mySegment, capacity, !serviceSide), capacity);
+            }
+        }
+        if (ec) {
+            log<error>(O_LOG_TOKEN, "attach error - %s", ec.message().c_str());
+            release_segment();
+        }
+        return ec;
+    }
+
+private:
+
+    ::asio::posix::stream_descriptor myEvent;
+    int myPeerEventFd = -1;
+    std::uint64_t myEventValue = 0;
+    char myPeerByte = 0;
+    void* mySegment = nullptr;
+    std::size_t mySegmentSize = 0;
+    ErrorCode myAttachError;
+    StreamTransportConfig myConfig;
+    details::SpscRing myTxRing;
+    details::SpscRing myRxRing;
+    details::ReceiveBuffer myRecvBuffer;
+    DataView myRingData;
+    std::size_t myRingReadPos = 0;
+    bool myReadingRing = false;
+    DataView myReadView;
+    std::size_t myRequestedLen = 0;
+    std::string myPendingTx;
+    std::size_t myPendingTxOffset = 0;
+    bool myWriteQueueHigh = false;
+
+    void release_segment()
+    {
+        if (mySegment != nullptr) {
+            ::munmap(mySegment, mySegmentSize);
+            mySegment = nullptr;
+        }
+        if (myPeerEventFd >= 0) {
+            ::close(myPeerEventFd);
+            myPeerEventFd = -1;
+        }
+    }
+
+    void signal_peer()
+    {
+        const std::uint64_t one = 1u;
+        if (::write(myPeerEventFd, &one, sizeof(one)) < 0) {
+            log<error>(O_LOG_TOKEN, "eventfd write error - %s", shm::last_error().message().c_str());
+        }
+    }
+
+    void write_data(const char* data, std::size_t len)
+    {
+        if (myPendingTx.empty()) {
+            std::size_t written = write_to_ring(data, len);
+            if (written < len) {
+                myPendingTx.assign(data + written, len - written);
+                flush_pending();
+            }
+        } else {
+            myPendingTx.append(data, len);
+        }
+    }
+
+    std::size_t write_to_ring(const char* data, std::size_t len)
+    {
+        bool wasEmpty = false;
+        std::size_t written = myTxRing.write(data, len, wasEmpty);
+        if (wasEmpty) {
+            signal_peer();
+        }
+        return written;
+    }
+
+    /** Move pending data to the ring until it's empty or the ring is full. */
+    void flush_pending()
+    {
+        while (myPendingTxOffset < myPendingTx.size()) {
+            myPendingTxOffset += write_to_ring(myPendingTx.data() + myPendingTxOffset,
+                                               myPendingTx.size() - myPendingTxOffset);
+            if (myPendingTxOffset < myPendingTx.size() && !myTxRing.wait_for_space()) {
+                break;      //the peer wakes us up when it frees space
+            }
+        }
+        if (myPendingTxOffset == myPendingTx.size()) {
+            myPendingTx.clear();
+            myPendingTxOffset = 0;
+        } else if (myPendingTxOffset >= myPendingTx.size() / 2u) {
+            myPendingTx.erase(0, myPendingTxOffset);
+            myPendingTxOffset = 0;
+        }
+        const std::size_t queued = get_write_queue_size();
+        if (myWriteQueueHigh && queued <= myConfig.writeQueueLowWatermark) {
+            myWriteQueueHigh = false;
+            if (myListener != nullptr) {
+                myListener->on_write_queue_low(*this, queued);
+            }
+        }
+    }
+
+    void start_wait_event(const std::shared_ptr<ShmTransport>& sharedThis)
+    {
+        myEvent.async_read_some(::asio::buffer(&myEventValue, sizeof(myEventValue)),
+                                std::bind(&ShmTransport::handle_event, sharedThis,
+                                          std::placeholders::_1, std::placeholders::_2));
+    }
+
+    void handle_event(const ErrorCode& ec, std::size_t)
+    {
+        if (ec) {
+            if ( !(::asio::error::operation_aborted == ec && myState == State::CLOSED)) {
+                handle_error(ec);
+            }
+            return;
+        }
+        //Consume all data from the ring. The listener parses the data in place while it lies
+        //contiguously in the ring, a message which wraps around the end of the ring is completed
+        //in the receive buffer.
+        while (myState == State::OPEN) {
+            const bool delivered = myRecvBuffer.empty() ? deliver_from_ring() : deliver_from_buffer();
+            if ( !delivered) {
+                break;
+            }
+        }
+        if (myState == State::OPEN) {
+            flush_pending();
+        }
+        if (myState == State::OPEN && check_rings()) {
+            start_wait_event(std::static_pointer_cast<ShmTransport>(this->shared_from_this()));
+        }
+    }
+
+    /**
+     * Pass the contiguous data of the ring to the listener, move the incomplete message
+     * which remains after it to the receive buffer.
+     * @return false when the ring is empty
+     */
+    bool deliver_from_ring()
+    {
+        std::size_t len = 0;
+        const char* data = myRxRing.peek(len);
+        if (len == 0) {
+            return false;
+        }
+        myRingData = DataView(data, len);
+        myRingReadPos = 0;
+        myReadingRing = true;
+        o_assert(myListener != nullptr);
+        myListener->on_incoming_data(*this, len);
+        myReadingRing = false;
+        if (myState != State::OPEN) {
+            release_segment();      //closed by the listener
+            return false;
+        }
+        myRecvBuffer.append(data + myRingReadPos, len - myRingReadPos);
+        if (myRxRing.consume(len)) {
+            signal_peer();
+        }
+        return true;
+    }
+
+    /**
+     * Copy the data from the ring to the receive buffer, only up to the end of the requested
+     * message, so that the following messages are parsed in place again.
+     * @return false when the ring is empty
+     */
+    bool deliver_from_buffer()
+    {
+        const std::size_t missing = (myRequestedLen > myRecvBuffer.size()) ? myRequestedLen - myRecvBuffer.size()
+                                                                           : myRxRing.capacity();
+        myRecvBuffer.prepare(myRequestedLen, missing);
+        bool wakeWriter = false;
+        std::size_t len = myRxRing.read(myRecvBuffer.write_ptr(), missing, wakeWriter);
+        if (wakeWriter) {
+            signal_peer();
+        }
+        if (len == 0) {
+            return false;
+        }
+        myRecvBuffer.commit(len);
+        o_assert(myListener != nullptr);
+        myListener->on_incoming_data(*this, myRecvBuffer.size());
+        return true;
+    }
+
+    void handle_peer_read(const ErrorCode& ec, std::size_t)
+    {
+        if (ec) {
+            if ( !(::asio::error::operation_aborted == ec && myState == State::CLOSED)) {
+                handle_error(ec);
+            }
+        } else if (myState == State::OPEN) {
+            //Nothing is expected from the peer on the socket, just keep watching it.
+            auto sharedThis = std::static_pointer_cast<ShmTransport>(this->shared_from_this());
+            mySocket->async_read_some(::asio::buffer(&myPeerByte, sizeof(myPeerByte)),
+                                      std::bind(&ShmTransport::handle_peer_read, sharedThis,
+                                                std::placeholders::_1, std::placeholders::_2));
+        }
+    }
+
+    /**
+     * The peer has access to the positions of the rings. Inconsistent positions are a protocol error,
+     * which closes the connection.
+     * @return false when the connection was closed
+     */
+    bool check_rings()
+    {
+        if (myRxRing.is_corrupted() || myTxRing.is_corrupted()) {
+            handle_error(ErrorCode(EPROTO, system_category()));
+            return false;
+        }
+        return true;
+    }
+
+    void handle_error(const ErrorCode& ec)
+    {
+        log<error>(O_LOG_TOKEN, "error - %s", ec.message().c_str());
+        if (myListener != nullptr) {
+            myListener->on_connection_error(*this, Error(ec));
+        }
+        close();
+    }
+
+    /** Not to be used, but to be overriden by derived classes. */
+    void open(const cercall::Closure<bool>&) override
+    {
+    }
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_HAS_LOCAL_SOCKETS && __linux__
+
+#endif // CERCALL_ASIO_SHMTRANSPORT_H
@@ -26,18 +26,61 @@
 namespace cercall {
 namespace asio {
 
+#ifdef SO_REUSEPORT
+#define CERCALL_ASIO_HAS_REUSE_PORT
+/** The SO_REUSEPORT socket option, a SettableSocketOption of asio. */
+class ReusePortOption
+{
+public:
+    explicit ReusePortOption(bool enable) : myValue(enable ? 1 : 0) {}
+
+    template<typename Protocol>
+    int level(const Protocol&) const    {   return SOL_SOCKET;  }
+
+    template<typename Protocol>
+    int name(const Protocol&) const     {   return SO_REUSEPORT;    }
+
+    template<typename Protocol>
+    const int* data(const Protocol&) const  {   return &myValue;    }
+
+    template<typename Protocol>
+    std::size_t size(const Protocol&) const {   return sizeof(myValue); }
+
+private:
+    int myValue;
+};
+#endif
+
 class TcpAcceptor : public BasicStreamAcceptor<::asio::ip::tcp>
 {
 public:
 
-    TcpAcceptor(::asio::io_service& ios, unsigned short port)
-        : BasicStreamAcceptor(ios, ::asio::ip::tcp::endpoint(::asio::ip::tcp::v4(), port))
-    {}
+    /**
+     * @param reusePort when true, the SO_REUSEPORT option is set, so that several acceptors can listen
+     *        on the same port and the kernel distributes the incoming connections among them
+     */
+    TcpAcceptor(::asio::io_service& ios, unsigned short port, bool reusePort = false)
+        : BasicStreamAcceptor(ios, ::asio::ip::tcp::endpoint(::asio::ip::tcp::v4(), port)), myReusePort(reusePort)
+    {
+#ifndef CERCALL_ASIO_HAS_REUSE_PORT
+        if (reusePort) {
+            throw std::runtime_error("cercall::asio::TcpAcceptor: SO_REUSEPORT not supported");
+        }
+#endif
+    }
 
     void set_socket_options(::asio::ip::tcp::acceptor& acc) override
     {
         acc.set_option(::asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef CERCALL_ASIO_HAS_REUSE_PORT
+        if (myReusePort) {
+            acc.set_option(ReusePortOption(true));
+        }
+#endif
     }
+
+private:
+    bool myReusePort;
 };
 
 
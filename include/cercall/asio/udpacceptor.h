@@ -0,0 +1,204 @@
+/*!
+ * \file
+ * \brief     Cercall UDP datagram acceptor
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_UDPACCEPTOR_H
+#define CERCALL_ASIO_UDPACCEPTOR_H
+
+#include "cercall/acceptor.h"
+#include "cercall/asio/udptransport.h"
+#include "cercall/log.h"
+
+#ifdef CERCALL_ASIO_HAS_UDP_TRANSPORT
+
+#include <map>
+#include <vector>
+
+namespace cercall {
+namespace asio {
+
+/**
+ * @brief Acceptor of a UDP service.
+ * The acceptor receives the datagrams of all clients on one socket. The first datagram from a new
+ * sender address creates a UdpTransport for it, which is passed to the service as an accepted client.
+ * The service transports send their datagrams through the acceptor's socket.
+ * The number of senders is limited by DatagramConfig::maxSenders, the transport of a sender which sends nothing
+ * for DatagramConfig::senderIdleTimeout is closed.
+ */
+class UdpAcceptor : public Acceptor
+{
+public:
+
+    UdpAcceptor(::asio::io_service& ios, unsigned short port, const DatagramConfig& config = DatagramConfig())
+        : mySocket(std::make_shared<DatagramSocket>(ios, config)), myEndpoint(::asio::ip::udp::v4(), port),
+          myIoService(ios)
+    {
+        log<trace>(O_LOG_TOKEN, "");
+    }
+
+    virtual ~UdpAcceptor() noexcept(false)
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        close();
+    }
+
+    bool is_open() const override
+    {
+        return myOpen;
+    }
+
+    void open(int = -1) override
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        if (myListener == nullptr) {
+            throw std::logic_error("cercall::asio::UdpAcceptor: listener is NULL");
+        }
+        if (myOpen) {
+            return;
+        }
+        ErrorCode ec;
+        ::asio::ip::udp::socket& socket = mySocket->socket();
+        socket.open(myEndpoint.protocol(), ec);
+        if ( !ec) {
+            socket.set_option(::asio::ip::udp::socket::reuse_address(true), ec);
+        }
+        if ( !ec) {
+            socket.bind(myEndpoint, ec);
+        }
+        if (ec) {
+            log<error>(O_LOG_TOKEN, "open error - %s", ec.message().c_str());
+            myListener->on_accept_error(Error(ec));
+            return;
+        }
+        myOpen = true;
+        mySocket->start_receive([this](const Endpoint& sender, const DataView& datagram) {
+            handle_datagram(sender, datagram);
+        });
+        if (mySocket->get_config().senderIdleTimeout.count() > 0) {
+            myExpiryTimer = std::make_shared<::asio::steady_timer>(myIoService);
+            wait_expiry();
+        }
+    }
+
+    /**
+     * Close the socket, the service transports cannot send any more datagrams.
+     */
+    void close() override
+    {
+        if (myOpen) {
+            log<debug>(O_LOG_TOKEN, "close acceptor");
+            myOpen = false;
+            mySocket->close();
+            myExpiryTimer.reset();      //cancels the wait
+            for (auto& client : myClients) {
+                if (auto clientTr = client.second.transport.lock()) {
+                    clientTr->set_close_handler(nullptr);
+                }
+            }
+            myClients.clear();
+        }
+    }
+
+private:
+    using Endpoint = DatagramSocket::Endpoint;
+    using Clock = std::chrono::steady_clock;
+
+    struct Sender
+    {
+        std::weak_ptr<UdpTransport> transport;
+        Clock::time_point lastActive;
+    };
+
+    std::shared_ptr<DatagramSocket> mySocket;
+    Endpoint myEndpoint;
+    ::asio::io_service& myIoService;
+    std::map<Endpoint, Sender> myClients;
+    std::shared_ptr<::asio::steady_timer> myExpiryTimer;    ///< owned by the acceptor, the handler holds a weak_ptr
+    bool myOpen = false;
+
+    void handle_datagram(const Endpoint& sender, const DataView& datagram)
+    {
+        std::shared_ptr<UdpTransport> clientTr;
+        auto found = myClients.find(sender);
+        if (found != myClients.end()) {
+            clientTr = found->second.transport.lock();
+        }
+        if ( !clientTr) {
+            if (myClients.size() >= mySocket->get_config().maxSenders) {
+                close_idle_senders();
+            }
+            if (myClients.size() >= mySocket->get_config().maxSenders) {
+                log<debug>(O_LOG_TOKEN, "too many senders, datagram from %s dropped",
+                           sender.address().to_string().c_str());
+                return;
+            }
+            clientTr = std::make_shared<UdpTransport>(mySocket, &sender);
+            clientTr->set_close_handler([this, sender](UdpTransport&) {
+                myClients.erase(sender);
+            });
+            myClients[sender].transport = clientTr;
+            myListener->on_client_accepted(clientTr);
+        }
+        myClients[sender].lastActive = Clock::now();
+        clientTr->deliver(datagram);
+    }
+
+    void wait_expiry()
+    {
+        std::weak_ptr<::asio::steady_timer> weakTimer = myExpiryTimer;
+        myExpiryTimer->expires_after(mySocket->get_config().senderIdleTimeout / 2);
+        myExpiryTimer->async_wait([this, weakTimer](const ErrorCode& ec) {
+            if (ec || weakTimer.expired()) {
+                return;     //the acceptor is closed
+            }
+            close_idle_senders();
+            if (myExpiryTimer != nullptr) {
+                wait_expiry();
+            }
+        });
+    }
+
+    void close_idle_senders()
+    {
+        const Clock::time_point idleSince = Clock::now() - mySocket->get_config().senderIdleTimeout;
+        std::vector<std::shared_ptr<UdpTransport>> idle;
+        for (auto it = myClients.begin(); it != myClients.end(); ) {
+            std::shared_ptr<UdpTransport> clientTr = it->second.transport.lock();
+            if ( !clientTr) {
+                it = myClients.erase(it);   //released by the service without being closed
+                continue;
+            }
+            if (it->second.lastActive < idleSince) {
+                idle.push_back(std::move(clientTr));
+            }
+            ++it;
+        }
+        for (std::shared_ptr<UdpTransport>& clientTr : idle) {
+            log<debug>(O_LOG_TOKEN, "closing the transport of an idle sender");
+            clientTr->close();      //the close handler forgets the sender
+        }
+    }
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_HAS_UDP_TRANSPORT
+
+#endif // CERCALL_ASIO_UDPACCEPTOR_H
@@ -0,0 +1,444 @@
+/*!
+ * \file
+ * \brief     Cercall UDP datagram transport
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_UDPTRANSPORT_H
+#define CERCALL_ASIO_UDPTRANSPORT_H
+
+#include "cercall/transport.h"
+#include "cercall/asio/errorcode.h"
+#include "cercall/details/receivebuffer.h"
+#include "cercall/log.h"
+
+#ifdef __linux__
+#define CERCALL_ASIO_HAS_UDP_TRANSPORT
+#endif
+
+#ifdef CERCALL_ASIO_HAS_UDP_TRANSPORT
+
+#include <sys/socket.h>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+namespace cercall {
+namespace asio {
+
+/**
+ * @brief Configuration of a datagram transport.
+ */
+struct DatagramConfig
+{
+    /**
+     * The maximum size of a datagram, each message including its header must fit in one datagram.
+     * The default fits in an Ethernet frame, so the datagrams are not fragmented.
+     */
+    std::size_t maxDatagramSize = 1472u;
+    /** The maximum number of datagrams passed to one sendmmsg or recvmmsg system call. */
+    unsigned batchSize = 32u;
+    /** UdpAcceptor: the maximum number of senders with a service transport, datagrams of new senders are dropped. */
+    std::size_t maxSenders = 1024u;
+    /** UdpAcceptor: the service transport of a sender is closed when it sends nothing for this time, 0 never. */
+    std::chrono::milliseconds senderIdleTimeout { 60000 };
+};
+
+/**
+ * @brief A UDP socket, which sends the datagrams queued in one io_service turn with one sendmmsg call,
+ * and receives the datagrams with recvmmsg in batches.
+ * The socket is shared by the acceptor and all the service transports of a UDP service.
+ */
+class DatagramSocket : public std::enable_shared_from_this<DatagramSocket>
+{
+public:
+    using Endpoint = ::asio::ip::udp::endpoint;
+    /** The receive handler, the datagram is valid during the call only. */
+    using ReceiveHandler = std::function<void(const Endpoint& sender, const DataView& datagram)>;
+
+    DatagramSocket(::asio::io_service& ios, const DatagramConfig& config)
+        : mySocket(ios), myConfig(config)
+    {
+        o_assert(config.batchSize > 0);
+    }
+
+    ::asio::ip::udp::socket& socket()
+    {
+        return mySocket;
+    }
+
+    const DatagramConfig& get_config() const
+    {
+        return myConfig;
+    }
+
+    /**
+     * Queue a datagram for sending.
+     * @param to the destination, nullptr for a connected socket
+     * @return EMSGSIZE error if the data do not fit in a datagram
+     */
+    Error send(const Endpoint* to, const DataView* buffers, std::size_t count)
+    {
+        std::size_t len = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            len += buffers[i].size();
+        }
+        if (len > myConfig.maxDatagramSize) {
+            return Error { EMSGSIZE, "message does not fit in a datagram" };
+        }
+        mySendQueue.emplace_back();
+        Datagram& dgram = mySendQueue.back();
+        if (to != nullptr) {
+            dgram.to = *to;
+            dgram.hasDestination = true;
+        }
+        dgram.data.reserve(len);
+        for (std::size_t i = 0; i < count; ++i) {
+            dgram.data.append(buffers[i].data(), buffers[i].size());
+        }
+        if ( !myFlushPosted && !myWaitingForWrite) {
+            //Let other datagrams written in this io_service turn join the sendmmsg call.
+            myFlushPosted = true;
+            auto sharedThis = shared_from_this();
+            ::asio::post(mySocket.get_executor(), [sharedThis]() {
+                sharedThis->myFlushPosted = false;
+                sharedThis->flush();
+            });
+        }
+        return Error();
+    }
+
+    /** Start receiving datagrams, the handler is called for every received datagram. */
+    void start_receive(ReceiveHandler handler)
+    {
+        myReceiveHandler = std::move(handler);
+        const std::size_t slotSize = myConfig.maxDatagramSize;
+        myRecvStorage.resize(slotSize * myConfig.batchSize);
+        myRecvIov.resize(myConfig.batchSize);
+        myRecvAddr.resize(myConfig.batchSize);
+        myRecvMsgs.resize(myConfig.batchSize);
+        wait_receive();
+    }
+
+    void close()
+    {
+        myReceiveHandler = nullptr;
+        mySendQueue.clear();
+        ErrorCode ec;
+        mySocket.close(ec);
+    }
+
+private:
+
+    struct Datagram
+    {
+        Endpoint to;
+        bool hasDestination = false;
+        std::string data;
+    };
+
+    ::asio::ip::udp::socket mySocket;
+    DatagramConfig myConfig;
+    std::deque<Datagram> mySendQueue;
+    std::vector<iovec> mySendIov;
+    std::vector<mmsghdr> mySendMsgs;
+    bool myFlushPosted = false;
+    bool myWaitingForWrite = false;
+    ReceiveHandler myReceiveHandler;
+    std::vector<char> myRecvStorage;
+    std::vector<iovec> myRecvIov;
+    std::vector<sockaddr_storage> myRecvAddr;
+    std::vector<mmsghdr> myRecvMsgs;
+
+    void flush()
+    {
+        while ( !mySendQueue.empty() && mySocket.is_open()) {
+            const std::size_t count = std::min<std::size_t>(mySendQueue.size(), myConfig.batchSize);
+            mySendIov.resize(count);
+            mySendMsgs.resize(count);
+            for (std::size_t i = 0; i < count; ++i) {
+                Datagram& dgram = mySendQueue[i];
+                mySendIov[i].iov_base = &dgram.data[0];
+                mySendIov[i].iov_len = dgram.data.size();
+                std::memset(&mySendMsgs[i], 0, sizeof(mySendMsgs[i]));
+                mySendMsgs[i].msg_hdr.msg_iov = &mySendIov[i];
+                mySendMsgs[i].msg_hdr.msg_iovlen = 1;
+                if (dgram.hasDestination) {
+                    mySendMsgs[i].msg_hdr.msg_name = dgram.to.data();
+                    mySendMsgs[i].msg_hdr.msg_namelen = static_cast<socklen_t>(dgram.to.size());
+                }
+            }
+            int sent = ::sendmmsg(mySocket.native_handle(), mySendMsgs.data(), static_cast<unsigned>(count),
+                                  MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    wait_write();
+                    return;
+                }
+                //Datagrams are unreliable, the failed datagram is dropped.
+                log<error>(O_LOG_TOKEN, "sendmmsg error - %s", std::strerror(errno));
+                sent = 1;
+            }
+            mySendQueue.erase(mySendQueue.begin(), mySendQueue.begin() + sent);
+        }
+    }
+
+    void wait_write()
+    {
+        myWaitingForWrite = true;
+        auto sharedThis = shared_from_this();
+        mySocket.async_wait(::asio::ip::udp::socket::wait_write, [sharedThis](const ErrorCode& ec) {
+            sharedThis->myWaitingForWrite = false;
+            if ( !ec) {
+                sharedThis->flush();
+            }
+        });
+    }
+
+    void wait_receive()
+    {
+        auto sharedThis = shared_from_this();
+        mySocket.async_wait(::asio::ip::udp::socket::wait_read, [sharedThis](const ErrorCode& ec) {
+            if (ec) {
+                if (ec != ::asio::error::operation_aborted) {
+                    log<error>(O_LOG_TOKEN, "wait error - %s", ec.message().c_str());
+                }
+            } else if (sharedThis->myReceiveHandler) {
+                sharedThis->receive();
+                if (sharedThis->myReceiveHandler) {
+                    sharedThis->wait_receive();
+                }
+            }
+        });
+    }
+
+    void receive()
+    {
+        const std::size_t slotSize = myConfig.maxDatagramSize;
+        for (unsigned i = 0; i < myConfig.batchSize; ++i) {
+            myRecvIov[i].iov_base = &myRecvStorage[i * slotSize];
+            myRecvIov[i].iov_len = slotSize;
+            std::memset(&myRecvMsgs[i], 0, sizeof(myRecvMsgs[i]));
+            myRecvMsgs[i].msg_hdr.msg_iov = &myRecvIov[i];
+            myRecvMsgs[i].msg_hdr.msg_iovlen = 1;
+            myRecvMsgs[i].msg_hdr.msg_name = &myRecvAddr[i];
+            myRecvMsgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        }
+        int received = ::recvmmsg(mySocket.native_handle(), myRecvMsgs.data(), myConfig.batchSize, MSG_DONTWAIT, nullptr);
+        if (received < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                //E.g. ECONNREFUSED reported for a connected socket, when the peer is not listening.
+                log<debug>(O_LOG_TOKEN, "recvmmsg error - %s", std::strerror(errno));
+            }
+            return;
+        }
+        for (int i = 0; i < received && myReceiveHandler; ++i) {
+            const msghdr& hdr = myRecvMsgs[i].msg_hdr;
+            if (hdr.msg_flags & MSG_TRUNC) {
+                log<error>(O_LOG_TOKEN, "datagram larger than %zu bytes dropped", slotSize);
+                continue;
+            }
+            Endpoint sender;
+            if (hdr.msg_namelen > 0 && hdr.msg_namelen <= sender.capacity()) {
+                std::memcpy(sender.data(), hdr.msg_name, hdr.msg_namelen);
+                sender.resize(hdr.msg_namelen);
+            }
+            ReceiveHandler handler = myReceiveHandler;      //the handler may close the socket
+            handler(sender, DataView(&myRecvStorage[i * slotSize], myRecvMsgs[i].msg_len));
+        }
+    }
+};
+
+/**
+ * @brief Transport of UDP datagrams.
+ * Every message is sent in one datagram. Messages larger than the maximum datagram size are rejected
+ * by write() with the EMSGSIZE error.
+ * Datagrams may be lost or reordered, so the transport is suitable for one-way calls and events only,
+ * clients refuse to send calls, which expect a result, through it.
+ * A service transport is created by UdpAcceptor for every sender address. It shares the acceptor's socket,
+ * so there is no kernel state per client, and it is never closed because of the peer - the service closes it.
+ */
+class UdpTransport : public Transport
+{
+public:
+    using Endpoint = DatagramSocket::Endpoint;
+
+    /**
+     * @param socket the datagram socket
+     * @param peer the peer address, or nullptr when the socket is connected to the peer
+     */
+    UdpTransport(std::shared_ptr<DatagramSocket> socket, const Endpoint* peer)
+        : mySocket(std::move(socket)), myHasPeer(peer != nullptr)
+    {
+        if (peer != nullptr) {
+            myPeer = *peer;
+        }
+    }
+
+    UdpTransport(const UdpTransport&) = delete;
+    UdpTransport& operator=(const UdpTransport&) = delete;
+
+    virtual ~UdpTransport() noexcept(false)
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        if (myState == State::OPEN) {
+            close();
+        }
+    }
+
+    bool is_open() override
+    {
+        return myState == State::OPEN;
+    }
+
+    bool is_reliable() const override
+    {
+        return false;
+    }
+
+    bool can_post() const override
+    {
+        return true;
+    }
+
+    void post(std::function<void()> f) override
+    {
+        ::asio::post(mySocket->socket().get_executor(), std::move(f));
+    }
+
+    /** Open the service transport. */
+    bool open() override
+    {
+        o_assert(myListener != nullptr);
+        o_assert(myState == State::NEW);
+        myState = State::OPEN;
+        myListener->on_connected(*this);
+        return true;
+    }
+
+    /** Not to be used, but to be overriden by derived classes. */
+    void open(const cercall::Closure<bool>&) override
+    {
+    }
+
+    void close() override
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        if (myState == State::OPEN) {
+            myState = State::CLOSED;
+            if (myCloseHandler) {
+                auto closeHandler = std::move(myCloseHandler);
+                closeHandler(*this);
+            }
+            if (myListener) {
+                myListener->on_disconnected(*this);
+            }
+        }
+    }
+
+    void read(uint32_t len) override
+    {
+        myRequestedLen = len;
+    }
+
+    bool reads_ahead() const override
+    {
+        return true;
+    }
+
+    DataView get_read_data() override
+    {
+        if (myRequestedLen > 0) {
+            o_assert(myRecvBuffer.size() >= myRequestedLen);
+            myReadView = DataView(myRecvBuffer.data(), myRequestedLen);
+            myRecvBuffer.consume(myRequestedLen);
+            myRequestedLen = 0;
+        }
+        return myReadView;
+    }
+
+    Error write(const std::string& msg) override
+    {
+        const DataView buffer(msg);
+        return write(&buffer, 1u);
+    }
+
+    Error write(const DataView* buffers, std::size_t count) override
+    {
+        if ( !is_open()) {
+            return Error { ENOTCONN, "transport not open" };
+        }
+        return mySocket->send(myHasPeer ? &myPeer : nullptr, buffers, count);
+    }
+
+    /**
+     * Pass a received datagram to the listener.
+     * The datagram holds complete messages, so a lost datagram does not break the message stream.
+     * The bytes of a truncated message left in the datagram are dropped, the listener's messenger
+     * drops its part of the message, see Transport::is_reliable().
+     */
+    void deliver(const DataView& datagram)
+    {
+        if (myState != State::OPEN) {
+            return;
+        }
+        myRecvBuffer.append(datagram.data(), datagram.size());
+        if (myRequestedLen > 0 && myRecvBuffer.size() >= myRequestedLen) {
+            o_assert(myListener != nullptr);
+            myListener->on_incoming_data(*this, myRecvBuffer.size());
+        }
+        if (myRecvBuffer.size() > 0) {
+            log<error>(O_LOG_TOKEN, "%zu bytes of a truncated datagram dropped", myRecvBuffer.size());
+            myRecvBuffer.consume(myRecvBuffer.size());
+        }
+    }
+
+    /** Set the function called when the transport is closed, used by the acceptor to forget the transport. */
+    void set_close_handler(std::function<void(UdpTransport&)> h)
+    {
+        myCloseHandler = std::move(h);
+    }
+
+protected:
+
+    enum class State
+    {
+        NEW, OPEN, CLOSED
+    };
+
+    State myState = State::NEW;
+    std::shared_ptr<DatagramSocket> mySocket;
+
+private:
+    Endpoint myPeer;
+    bool myHasPeer;
+    std::function<void(UdpTransport&)> myCloseHandler;
+    details::ReceiveBuffer myRecvBuffer;
+    std::size_t myRequestedLen = 0;
+    DataView myReadView;
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_HAS_UDP_TRANSPORT
+
+#endif // CERCALL_ASIO_UDPTRANSPORT_H
@@ -0,0 +1,546 @@
+/*!
+ * \file
+ * \brief     Cercall io_uring instance driven by an Asio io_service
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_URING_H
+#define CERCALL_ASIO_URING_H
+
+#include "cercall/asio/config.h"
+#include "cercall/asio/errorcode.h"
+#include "cercall/log.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_ACCEPT_MULTISHOT) && defined(IORING_RSRC_REGISTER_SPARSE)
+#define CERCALL_ASIO_HAS_URING
+#endif
+#endif
+#endif
+
+#ifdef CERCALL_ASIO_HAS_URING
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace cercall {
+namespace asio {
+
+/**
+ * @brief Configuration of an io_uring instance.
+ */
+struct UringConfig
+{
+    /** Number of submission queue entries, the completion queue is twice as large. */
+    unsigned queueEntries = 256u;
+    /**
+     * Number of slots in the registered buffer table. Each connection registers its receive buffer
+     * in a slot, connections which find no free slot receive into unregistered memory.
+     */
+    unsigned registeredBufferSlots = 256u;
+    /** How long Uring::shutdown() waits for the cancelled operations to complete. */
+    std::chrono::milliseconds cancelTimeout { 1000 };
+};
+
+/**
+ * @brief An io_uring instance, which delivers its completions through an Asio io_service.
+ * The completion queue is signaled with an eventfd watched by the io_service, so the completion
+ * handlers run in the io_service thread, like the handlers of Asio operations.
+ * Submission queue entries prepared while completions are processed are submitted together
+ * when the processing ends, entries prepared elsewhere are submitted together in a handler
+ * posted to the io_service - so each io_service turn makes at most one io_uring_enter system call.
+ * The object is used by a single thread.
+ */
+class Uring : public std::enable_shared_from_this<Uring>
+{
+public:
+    /**
+     * A completion handler.
+     * @param res the result of the operation - a negative errno value on error
+     * @param flags the completion flags, IORING_CQE_F_MORE when more completions of a multishot operation follow
+     */
+    using Handler = std::function<void(int res, unsigned flags)>;
+
+    /**
+     * Create an io_uring instance.
+     * @throw std::system_error if the io_uring cannot be set up
+     */
+    static std::shared_ptr<Uring> create(::asio::io_service& ios, const UringConfig& config = UringConfig())
+    {
+        std::shared_ptr<Uring> ring { new Uring(ios) };
+        ring->setup(config);
+        ring->start_wait_completions();
+        return ring;
+    }
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    ~Uring()
+    {
+        shutdown();
+    }
+
+    /**
+     * Cancel all operations, release the io_uring resources and the completion handlers.
+     * No handler is called after shutdown.
+     * The handlers are released only when their operations have completed, as they may hold the last
+     * references to the buffers used by the kernel. The handlers of operations which don't complete
+     * within UringConfig::cancelTimeout are never released.
+     */
+    void shutdown()
+    {
+        if (myRingFd < 0) {
+            return;
+        }
+        ErrorCode ec;
+        myEvent.close(ec);
+        cancel_all();
+        ::close(myRingFd);
+        myRingFd = -1;
+        if (mySqRing != MAP_FAILED) {
+            ::munmap(mySqRing, mySqRingSize);
+        }
+        if (myCqRing != MAP_FAILED && myCqRing != mySqRing) {
+            ::munmap(myCqRing, myCqRingSize);
+        }
+        if (mySqes != MAP_FAILED) {
+            ::munmap(mySqes, mySqesSize);
+        }
+        mySqRing = myCqRing = mySqes = MAP_FAILED;
+    }
+
+    bool is_open() const
+    {
+        return myRingFd >= 0;
+    }
+
+    ::asio::io_service& get_io_service()
+    {
+        return myIoService;
+    }
+
+    /** @return true if the ring has a registered buffer table */
+    bool has_registered_buffers() const
+    {
+        return !myBufferSlots.empty();
+    }
+
+    /**
+     * Get a submission queue entry for a new operation.
+     * @param handler the completion handler, empty if the completion shall be ignored
+     * @return the cleared entry with the user_data set, nullptr if the ring is shut down
+     */
+    io_uring_sqe* prepare(Handler handler)
+    {
+        if (myRingFd < 0) {
+            return nullptr;
+        }
+        if (mySqeTail - load_acquire(mySqHead) >= mySqEntries) {
+            submit();       //make room in the submission queue
+            if (mySqeTail - load_acquire(mySqHead) >= mySqEntries) {
+                log<error>(O_LOG_TOKEN, "submission queue full");
+                return nullptr;
+            }
+        }
+        const unsigned index = mySqeTail & mySqMask;
+        io_uring_sqe* sqe = &static_cast<io_uring_sqe*>(mySqes)[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        mySqArray[index] = index;
+        ++mySqeTail;
+        if (handler) {
+            const std::uint64_t id = ++myLastOpId;
+            myHandlers.emplace(id, std::move(handler));
+            sqe->user_data = id;
+        }
+        schedule_submit();
+        return sqe;
+    }
+
+    /** @return the user_data of the last prepared entry, identifying the operation for cancel() */
+    std::uint64_t get_last_operation_id() const
+    {
+        return myLastOpId;
+    }
+
+    /** Request cancellation of the operation, its handler is called with -ECANCELED. */
+    void cancel(std::uint64_t opId)
+    {
+        io_uring_sqe* sqe = prepare(Handler());
+        if (sqe != nullptr) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = opId;
+        }
+    }
+
+    /**
+     * Register the memory in a free slot of the registered buffer table.
+     * @return the slot index, or -1 when no slot is free
+     */
+    int register_buffer(void* base, std::size_t len)
+    {
+        for (std::size_t slot = 0; myRingFd >= 0 && slot < myBufferSlots.size(); ++slot) {
+            if ( !myBufferSlots[slot]) {
+                iovec iov { base, len };
+                if (update_buffer(static_cast<unsigned>(slot), iov)) {
+                    myBufferSlots[slot] = true;
+                    return static_cast<int>(slot);
+                }
+                return -1;
+            }
+        }
+        return -1;
+    }
+
+    void unregister_buffer(int slot)
+    {
+        if (slot >= 0 && static_cast<std::size_t>(slot) < myBufferSlots.size() && myBufferSlots[slot]) {
+            iovec iov { nullptr, 0 };
+            if (myRingFd >= 0) {
+                update_buffer(static_cast<unsigned>(slot), iov);
+            }
+            myBufferSlots[slot] = false;
+        }
+    }
+
+    /** Submit the prepared entries now. */
+    void submit()
+    {
+        while (myRingFd >= 0) {
+            const unsigned toSubmit = mySqeTail - load_acquire(mySqHead);
+            if (toSubmit == 0) {
+                break;
+            }
+            store_release(mySqTail, mySqeTail);
+            int res = enter(toSubmit, 0u);
+            if (res < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                //EBUSY/EAGAIN - the completion queue is full, the entries are submitted after completions are reaped
+                if (errno != EBUSY && errno != EAGAIN) {
+                    log<error>(O_LOG_TOKEN, "io_uring_enter error - %s", std::strerror(errno));
+                }
+                break;
+            }
+            if (static_cast<unsigned>(res) >= toSubmit) {
+                break;
+            }
+        }
+    }
+
+private:
+
+    ::asio::io_service& myIoService;
+    ::asio::posix::stream_descriptor myEvent;
+    std::uint64_t myEventValue = 0;
+    int myRingFd = -1;
+    void* mySqRing = MAP_FAILED;
+    void* myCqRing = MAP_FAILED;
+    void* mySqes = MAP_FAILED;
+    std::size_t mySqRingSize = 0;
+    std::size_t myCqRingSize = 0;
+    std::size_t mySqesSize = 0;
+    unsigned* mySqHead = nullptr;
+    unsigned* mySqTail = nullptr;
+    unsigned* mySqFlags = nullptr;
+    unsigned* mySqArray = nullptr;
+    unsigned mySqMask = 0;
+    unsigned mySqEntries = 0;
+    unsigned mySqeTail = 0;
+    unsigned* myCqHead = nullptr;
+    unsigned* myCqTail = nullptr;
+    unsigned myCqMask = 0;
+    io_uring_cqe* myCqes = nullptr;
+    std::uint64_t myLastOpId = 0;
+    std::unordered_map<std::uint64_t, Handler> myHandlers;
+    std::vector<bool> myBufferSlots;
+    bool myProcessingCompletions = false;
+    bool mySubmitPosted = false;
+    std::chrono::milliseconds myCancelTimeout { 0 };
+
+    explicit Uring(::asio::io_service& ios) : myIoService(ios), myEvent(ios) {}
+
+    static unsigned load_acquire(const unsigned* p)
+    {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+
+    static void store_release(unsigned* p, unsigned v)
+    {
+        __atomic_store_n(p, v, __ATOMIC_RELEASE);
+    }
+
+    int enter(unsigned toSubmit, unsigned flags)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, myRingFd, toSubmit, 0u, flags, nullptr, 0u));
+    }
+
+    int register_op(unsigned opcode, const void* arg, unsigned nrArgs)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_register, myRingFd, opcode, arg, nrArgs));
+    }
+
+    static void throw_system_error(const char* what)
+    {
+        throw std::system_error(errno, std::system_category(), what);
+    }
+
+    void setup(const UringConfig& config)
+    {
+        myCancelTimeout = config.cancelTimeout;
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        myRingFd = static_cast<int>(::syscall(__NR_io_uring_setup, config.queueEntries, &params));
+        if (myRingFd < 0) {
+            throw_system_error("io_uring_setup");
+        }
+        mySqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        myCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap) {
+            mySqRingSize = myCqRingSize = std::max(mySqRingSize, myCqRingSize);
+        }
+        mySqRing = ::mmap(nullptr, mySqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          myRingFd, IORING_OFF_SQ_RING);
+        if (mySqRing == MAP_FAILED) {
+            throw_setup_error("mmap sq ring");
+        }
+        if (singleMmap) {
+            myCqRing = mySqRing;
+        } else {
+            myCqRing = ::mmap(nullptr, myCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              myRingFd, IORING_OFF_CQ_RING);
+            if (myCqRing == MAP_FAILED) {
+                throw_setup_error("mmap cq ring");
+            }
+        }
+        mySqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        mySqes = ::mmap(nullptr, mySqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        myRingFd, IORING_OFF_SQES);
+        if (mySqes == MAP_FAILED) {
+            throw_setup_error("mmap sqes");
+        }
+        char* sq = static_cast<char*>(mySqRing);
+        mySqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        mySqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        mySqFlags = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+        mySqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        mySqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        mySqEntries = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+        mySqeTail = *mySqTail;
+        char* cq = static_cast<char*>(myCqRing);
+        myCqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        myCqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        myCqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        myCqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        int efd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (efd < 0) {
+            throw_setup_error("eventfd");
+        }
+        ErrorCode ec;
+        myEvent.assign(efd, ec);
+        if (ec) {
+            ::close(efd);
+            errno = ec.value();
+            throw_setup_error("eventfd assign");
+        }
+        if (register_op(IORING_REGISTER_EVENTFD, &efd, 1u) < 0) {
+            throw_setup_error("register eventfd");
+        }
+        if (config.registeredBufferSlots > 0) {
+            io_uring_rsrc_register reg;
+            std::memset(&reg, 0, sizeof(reg));
+            reg.nr = config.registeredBufferSlots;
+            reg.flags = IORING_RSRC_REGISTER_SPARSE;
+            if (register_op(IORING_REGISTER_BUFFERS2, &reg, sizeof(reg)) == 0) {
+                myBufferSlots.resize(config.registeredBufferSlots, false);
+            } else {
+                log<debug>(O_LOG_TOKEN, "registered buffers not supported - %s", std::strerror(errno));
+            }
+        }
+    }
+
+    void throw_setup_error(const char* what)
+    {
+        const int err = errno;
+        shutdown();
+        errno = err;
+        throw_system_error(what);
+    }
+
+    bool update_buffer(unsigned slot, iovec& iov)
+    {
+        io_uring_rsrc_update2 update;
+        std::memset(&update, 0, sizeof(update));
+        update.offset = slot;
+        update.data = reinterpret_cast<std::uintptr_t>(&iov);
+        update.nr = 1;
+        if (register_op(IORING_REGISTER_BUFFERS_UPDATE, &update, sizeof(update)) < 0) {
+            log<error>(O_LOG_TOKEN, "buffer update error - %s", std::strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    void schedule_submit()
+    {
+        if ( !myProcessingCompletions && !mySubmitPosted) {
+            mySubmitPosted = true;
+            std::weak_ptr<Uring> weakThis = shared_from_this();
+            myIoService.post([weakThis]() {
+                std::shared_ptr<Uring> ring = weakThis.lock();
+                if (ring) {
+                    ring->mySubmitPosted = false;
+                    ring->submit();
+                }
+            });
+        }
+    }
+
+    void start_wait_completions()
+    {
+        std::weak_ptr<Uring> weakThis = shared_from_this();
+        myEvent.async_read_some(::asio::buffer(&myEventValue, sizeof(myEventValue)),
+                                [weakThis](const ErrorCode& ec, std::size_t) {
+            std::shared_ptr<Uring> ring = weakThis.lock();
+            if (ring && ring->is_open()) {
+                if (ec) {
+                    log<error>(O_LOG_TOKEN, "eventfd error - %s", ec.message().c_str());
+                } else {
+                    ring->process_completions();
+                    ring->start_wait_completions();
+                }
+            }
+        });
+    }
+
+    void process_completions()
+    {
+        std::shared_ptr<Uring> sharedThis = shared_from_this();     //a handler may release the last reference
+        myProcessingCompletions = true;
+        bool more = true;
+        while (more && myRingFd >= 0) {
+            unsigned head = *myCqHead;
+            const unsigned tail = load_acquire(myCqTail);
+            while (head != tail && myRingFd >= 0) {
+                const io_uring_cqe cqe = myCqes[head & myCqMask];
+                store_release(myCqHead, ++head);
+                complete(cqe);
+            }
+            //Completions which did not fit in the completion queue are flushed by io_uring_enter.
+            more = myRingFd >= 0 && (load_acquire(mySqFlags) & IORING_SQ_CQ_OVERFLOW) != 0;
+            if (more) {
+                enter(0u, IORING_ENTER_GETEVENTS);
+            }
+        }
+        myProcessingCompletions = false;
+        submit();
+    }
+
+    /** Cancel the operations in flight and reap their completions without calling the handlers. */
+    void cancel_all()
+    {
+        if (myHandlers.empty() || myCqes == nullptr) {
+            return;
+        }
+        myProcessingCompletions = true;     //submitted below, not in a posted handler
+        for (const auto& entry : myHandlers) {
+            cancel(entry.first);
+        }
+        submit();
+        const auto deadline = std::chrono::steady_clock::now() + myCancelTimeout;
+        while ( !myHandlers.empty() && std::chrono::steady_clock::now() < deadline) {
+            unsigned head = *myCqHead;
+            const unsigned tail = load_acquire(myCqTail);
+            if (head == tail) {
+                wait_completion(deadline);
+                continue;
+            }
+            while (head != tail) {
+                const io_uring_cqe cqe = myCqes[head & myCqMask];
+                store_release(myCqHead, ++head);
+                auto found = myHandlers.find(cqe.user_data);
+                if (found != myHandlers.end() && !(cqe.flags & IORING_CQE_F_MORE)) {
+                    Handler handler = std::move(found->second);
+                    myHandlers.erase(found);    //the owner is released with the handler at the end of the scope
+                }
+            }
+        }
+        myProcessingCompletions = false;
+        if ( !myHandlers.empty()) {
+            log<error>(O_LOG_TOKEN, "%zu operations not cancelled, their handlers are kept", myHandlers.size());
+            //Deliberately leaked, the kernel may still use the buffers of the handlers' owners.
+            new decltype(myHandlers)(std::move(myHandlers));
+            myHandlers.clear();
+        }
+    }
+
+    /** Wait for a completion until the deadline. */
+    void wait_completion(std::chrono::steady_clock::time_point deadline)
+    {
+        const auto timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 deadline - std::chrono::steady_clock::now());
+        __kernel_timespec ts;
+        ts.tv_sec = static_cast<long long>(std::max<long long>(timeout.count(), 0) / 1000000000);
+        ts.tv_nsec = static_cast<long long>(std::max<long long>(timeout.count(), 0) % 1000000000);
+        io_uring_getevents_arg arg;
+        std::memset(&arg, 0, sizeof(arg));
+        arg.ts = reinterpret_cast<std::uintptr_t>(&ts);
+        ::syscall(__NR_io_uring_enter, myRingFd, 0u, 1u, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                  &arg, sizeof(arg));
+    }
+
+    void complete(const io_uring_cqe& cqe)
+    {
+        if (cqe.user_data == 0) {
+            return;
+        }
+        auto found = myHandlers.find(cqe.user_data);
+        if (found == myHandlers.end()) {
+            return;
+        }
+        if (cqe.flags & IORING_CQE_F_MORE) {
+            Handler handler = found->second;    //the handler stays registered for more completions
+            handler(cqe.res, cqe.flags);
+        } else {
+            Handler handler = std::move(found->second);
+            myHandlers.erase(found);
+            handler(cqe.res, cqe.flags);
+        }
+    }
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_HAS_URING
+
+#endif // CERCALL_ASIO_URING_H
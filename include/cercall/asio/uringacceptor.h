@@ -0,0 +1,184 @@
+/*!
+ * \file
+ * \brief     Cercall io_uring TCP acceptor
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_URINGACCEPTOR_H
+#define CERCALL_ASIO_URINGACCEPTOR_H
+
+#include "cercall/acceptor.h"
+#include "cercall/asio/uringtransport.h"
+#include "cercall/log.h"
+
+#ifdef CERCALL_ASIO_HAS_URING
+
+namespace cercall {
+namespace asio {
+
+/**
+ * @brief TCP acceptor, which accepts clients with a multishot io_uring accept operation
+ * and creates UringTransport objects sharing the acceptor's ring.
+ * All I/O of the service goes through one ring, whose completions are processed by the io_service,
+ * so the acceptor and its transports are driven by a single thread.
+ */
+class UringAcceptor : public Acceptor
+{
+public:
+
+    /**
+     * @throw std::system_error if the io_uring cannot be set up
+     */
+    UringAcceptor(::asio::io_service& ios, unsigned short port, const UringConfig& config = UringConfig())
+        : myRing(Uring::create(ios, config)), myEndpoint(::asio::ip::tcp::v4(), port), myAcceptor(ios)
+    {
+        log<trace>(O_LOG_TOKEN, "");
+    }
+
+    virtual ~UringAcceptor() noexcept(false)
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        close();
+        myRing->shutdown();     //the handlers must not outlive the acceptor
+    }
+
+    /**
+     * Set the configuration applied to every accepted client transport.
+     * The transports always write asynchronously, StreamTransportConfig::useStrand is ignored.
+     */
+    void set_transport_config(const StreamTransportConfig& config)
+    {
+        myTransportConfig = config;
+    }
+
+    bool is_open() const override
+    {
+        return myAcceptor.is_open();
+    }
+
+    void open(int maxPendingClientConnections = -1) override
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        if (myListener == nullptr) {
+            throw std::logic_error("cercall::asio::UringAcceptor: listener is NULL");
+        }
+        if (myAcceptor.is_open()) {
+            return;
+        }
+        ErrorCode ec;
+        log<debug>(O_LOG_TOKEN, "open acceptor");
+        myAcceptor.open(myEndpoint.protocol(), ec);
+        if ( !ec) {
+            myAcceptor.set_option(::asio::ip::tcp::acceptor::reuse_address(true), ec);
+        }
+        if ( !ec) {
+            log<debug>(O_LOG_TOKEN, "bind endpoint");
+            myAcceptor.bind(myEndpoint, ec);
+        }
+        if ( !ec) {
+            log<debug>(O_LOG_TOKEN, "listen");
+            myAcceptor.listen((maxPendingClientConnections > 0) ? maxPendingClientConnections
+                                                                : ::asio::ip::tcp::socket::max_connections, ec);
+        }
+        if (ec) {
+            log<error>(O_LOG_TOKEN, "open error - %s", ec.message().c_str());
+            myListener->on_accept_error(Error(ec));
+            return;
+        }
+        start_accept();
+    }
+
+    void close() override
+    {
+        if (is_open()) {
+            log<debug>(O_LOG_TOKEN, "close acceptor");
+            if (myAcceptOpId != 0) {
+                myRing->cancel(myAcceptOpId);
+                myRing->submit();
+                myAcceptOpId = 0;
+            }
+            ErrorCode ec;
+            myAcceptor.close(ec);
+        }
+    }
+
+private:
+
+    std::shared_ptr<Uring> myRing;
+    ::asio::ip::tcp::endpoint myEndpoint;
+    ::asio::ip::tcp::acceptor myAcceptor;
+    StreamTransportConfig myTransportConfig;
+    std::uint64_t myAcceptOpId = 0;
+    bool myMultishot = true;
+
+    /**
+     * Start the accept operation. The multishot operation completes once for every accepted
+     * client, it is restarted only when the kernel terminates it.
+     */
+    void start_accept()
+    {
+        io_uring_sqe* sqe = myRing->prepare([this](int res, unsigned flags) {
+            handle_accept(res, flags);
+        });
+        if (sqe == nullptr) {
+            myAcceptOpId = 0;
+            return;
+        }
+        myAcceptOpId = myRing->get_last_operation_id();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = myAcceptor.native_handle();
+        sqe->accept_flags = SOCK_CLOEXEC;
+        if (myMultishot) {
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        }
+    }
+
+    void handle_accept(int res, unsigned flags)
+    {
+        const bool more = (flags & IORING_CQE_F_MORE) != 0;
+        if ( !more) {
+            myAcceptOpId = 0;
+        }
+        if ( !is_open()) {
+            if (res >= 0) {
+                ::close(res);
+            }
+            return;
+        }
+        if (res >= 0) {
+            std::shared_ptr<UringTransport> clientTr { new UringTransport(myRing, res, myTransportConfig) };
+            myListener->on_client_accepted(clientTr);
+        } else if (res == -EINVAL && myMultishot) {
+            log<debug>(O_LOG_TOKEN, "multishot accept not supported");
+            myMultishot = false;
+        } else if (res != -ECANCELED && res != -EINTR && res != -ECONNABORTED) {
+            const ErrorCode ec(-res, system_category());
+            log<error>(O_LOG_TOKEN, "accept error - %s", ec.message().c_str());
+            myListener->on_accept_error(Error(ec));
+        }
+        if ( !more && is_open()) {
+            start_accept();
+        }
+    }
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_HAS_URING
+
+#endif // CERCALL_ASIO_URINGACCEPTOR_H
@@ -0,0 +1,396 @@
+/*!
+ * \file
+ * \brief     Cercall io_uring socket transport
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_ASIO_URINGTRANSPORT_H
+#define CERCALL_ASIO_URINGTRANSPORT_H
+
+#include "cercall/transport.h"
+#include "cercall/asio/basicstreamtransport.h"
+#include "cercall/asio/uring.h"
+#include "cercall/details/receivebuffer.h"
+#include "cercall/log.h"
+
+#ifdef CERCALL_ASIO_HAS_URING
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <climits>
+#include <deque>
+
+namespace cercall {
+namespace asio {
+
+/**
+ * @brief Transport of a connected stream socket, which performs its I/O with io_uring operations.
+ * The transport receives into a reusable receive buffer registered with the ring, so the kernel
+ * need not map the buffer pages for every receive, and passes all queued outgoing messages
+ * to a single sendmsg operation.
+ * Writes are always asynchronous, the watermarks of the StreamTransportConfig apply.
+ * The transport is used only by services, it is created by UringAcceptor.
+ */
+class UringTransport : public Transport
+{
+public:
+
+    /** The receive buffer size used when StreamTransportConfig::receiveBufferSize is 0. */
+    static constexpr std::size_t DEFAULT_RECEIVE_BUFFER_SIZE = 64u * 1024u;
+
+    /**
+     * @param ring the ring performing the I/O
+     * @param fd the connected socket, the transport takes its ownership
+     */
+    UringTransport(std::shared_ptr<Uring> ring, int fd, const StreamTransportConfig& config = StreamTransportConfig())
+        : myRing(std::move(ring)), myFd(fd), myConfig(config),
+          myRecvBuffer(config.receiveBufferSize > 0 ? config.receiveBufferSize : DEFAULT_RECEIVE_BUFFER_SIZE)
+    {
+        o_assert(myConfig.writeQueueLowWatermark <= myConfig.writeQueueHighWatermark);
+        log<trace>(O_LOG_TOKEN, "fd %d", fd);
+    }
+
+    UringTransport(const UringTransport&) = delete;
+    UringTransport& operator=(const UringTransport&) = delete;
+
+    virtual ~UringTransport() noexcept(false)
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        if (myState != State::CLOSED) {
+            close();
+        }
+        myRing->unregister_buffer(myBufferSlot);
+        ::close(myFd);
+    }
+
+    bool is_open() override
+    {
+        return myState == State::OPEN;
+    }
+
+    bool open() override
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        o_assert(myListener != nullptr);
+        o_assert(myState == State::NEW);
+        myState = State::OPEN;
+        int noDelay = 1;
+        ::setsockopt(myFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        myListener->on_connected(*this);
+        return true;
+    }
+
+    /** Not supported, the transport is created for accepted connections. */
+    void open(const cercall::Closure<bool>& cl) override
+    {
+        cl(Result<bool> { false, Error { EOPNOTSUPP, "cercall::asio::UringTransport: connect not supported" } });
+    }
+
+    /**
+     * @note Messages still waiting in the outgoing queue are discarded.
+     */
+    void close() override
+    {
+        log<trace>(O_LOG_TOKEN, "");
+        if (myState == State::OPEN) {
+            myState = State::CLOSED;
+            //Pending operations complete when the socket is shut down, the socket is closed in the destructor.
+            ::shutdown(myFd, SHUT_RDWR);
+            if (myListener) {
+                myListener->on_disconnected(*this);
+            }
+        }
+        myState = State::CLOSED;
+    }
+
+    void read(uint32_t len) override
+    {
+        myRequestedLen = len;
+        if ( !myReadInProgress && !myDeliveringData && myState == State::OPEN) {
+            start_recv();
+        }
+    }
+
+    bool reads_ahead() const override
+    {
+        return true;
+    }
+
+    DataView get_read_data() override
+    {
+        if (myRequestedLen > 0) {
+            //The consumed data stays in place until the next receive is started.
+            o_assert(myRecvBuffer.size() >= myRequestedLen);
+            myReadView = DataView(myRecvBuffer.data(), myRequestedLen);
+            myRecvBuffer.consume(myRequestedLen);
+            myRequestedLen = 0;
+        }
+        return myReadView;
+    }
+
+    Error write(const std::string& msg) override
+    {
+        const DataView buffer(msg);
+        return write(&buffer, 1u);
+    }
+
+    Error write(const DataView* buffers, std::size_t count) override
+    {
+        if ( !is_open()) {
+            return Error { ENOTCONN, "socket not connected" };
+        }
+        std::size_t len = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            len += buffers[i].size();
+        }
+        myWriteQueue.emplace_back();
+        std::string& msg = myWriteQueue.back();
+        msg.reserve(len);
+        for (std::size_t i = 0; i < count; ++i) {
+            msg.append(buffers[i].data(), buffers[i].size());
+        }
+        myWriteQueueSize += len;
+        if ( !myWriteQueueHigh && myWriteQueueSize >= myConfig.writeQueueHighWatermark) {
+            myWriteQueueHigh = true;
+            if (myListener != nullptr) {
+                myListener->on_write_queue_high(*this, myWriteQueueSize);
+            }
+        }
+        if ( !mySendInProgress && !myFlushPosted) {
+            //Let other messages written in this io_service turn join the send.
+            myFlushPosted = true;
+            auto sharedThis = std::static_pointer_cast<UringTransport>(shared_from_this());
+            myRing->get_io_service().post([sharedThis]() {
+                sharedThis->myFlushPosted = false;
+                if ( !sharedThis->mySendInProgress && sharedThis->myState == State::OPEN) {
+                    sharedThis->start_send();
+                }
+            });
+        }
+        return Error();
+    }
+
+    std::size_t get_write_queue_size() const override
+    {
+        return myWriteQueueSize;
+    }
+
+    bool can_post() const override
+    {
+        return true;
+    }
+
+    void post(std::function<void()> f) override
+    {
+        myRing->get_io_service().post(std::move(f));
+    }
+
+private:
+
+    enum class State
+    {
+        NEW, OPEN, CLOSED
+    };
+
+    std::shared_ptr<Uring> myRing;
+    int myFd;
+    State myState = State::NEW;
+    StreamTransportConfig myConfig;
+    details::ReceiveBuffer myRecvBuffer;
+    std::size_t myRequestedLen = 0;
+    DataView myReadView;
+    bool myReadInProgress = false;
+    bool myDeliveringData = false;
+    int myBufferSlot = -1;                  ///< registered buffer slot of the receive buffer, -1 if not registered
+    const char* myRegisteredBase = nullptr; ///< the receive buffer memory registered in myBufferSlot
+    std::size_t myRegisteredSize = 0;
+    bool myUseFixedRead = true;
+    std::deque<std::string> myWriteQueue;
+    std::size_t myWriteQueueSize = 0;
+    std::size_t mySentOffset = 0;           ///< number of bytes of the front message sent already
+    std::vector<iovec> mySendIov;
+    msghdr mySendMsg;
+    bool mySendInProgress = false;
+    bool myFlushPosted = false;
+    bool myWriteQueueHigh = false;
+
+    /** Keep the registered buffer in sync with the receive buffer memory, which moves when the buffer grows. */
+    void update_registered_buffer()
+    {
+        if ( !myUseFixedRead || !myRing->has_registered_buffers()) {
+            return;
+        }
+        if (myBufferSlot >= 0 && myRegisteredBase == myRecvBuffer.storage()
+            && myRegisteredSize == myRecvBuffer.capacity()) {
+            return;
+        }
+        myRing->unregister_buffer(myBufferSlot);
+        myRegisteredBase = myRecvBuffer.storage();
+        myRegisteredSize = myRecvBuffer.capacity();
+        myBufferSlot = myRing->register_buffer(myRecvBuffer.storage(), myRecvBuffer.capacity());
+    }
+
+    void start_recv()
+    {
+        //Receive at least a quarter of the buffer size at once, otherwise make room for it first.
+        const std::size_t bufferSize = myConfig.receiveBufferSize > 0 ? myConfig.receiveBufferSize
+                                                                      : DEFAULT_RECEIVE_BUFFER_SIZE;
+        myRecvBuffer.prepare(myRequestedLen, std::max<std::size_t>(bufferSize / 4u, 1u));
+        update_registered_buffer();
+        auto sharedThis = std::static_pointer_cast<UringTransport>(shared_from_this());
+        io_uring_sqe* sqe = myRing->prepare([sharedThis](int res, unsigned) {
+            sharedThis->handle_recv(res);
+        });
+        if (sqe == nullptr) {
+            handle_error(ENXIO, "io_uring shut down");
+            return;
+        }
+        myReadInProgress = true;
+        sqe->fd = myFd;
+        sqe->addr = reinterpret_cast<std::uintptr_t>(myRecvBuffer.write_ptr());
+        sqe->len = static_cast<unsigned>(std::min<std::size_t>(myRecvBuffer.write_space(), UINT_MAX));
+        if (myBufferSlot >= 0) {
+            sqe->opcode = IORING_OP_READ_FIXED;
+            sqe->buf_index = static_cast<unsigned short>(myBufferSlot);
+        } else {
+            sqe->opcode = IORING_OP_RECV;
+        }
+    }
+
+    void handle_recv(int res)
+    {
+        myReadInProgress = false;
+        if (myState != State::OPEN) {
+            return;
+        }
+        if (res < 0 && myBufferSlot >= 0 && (res == -EINVAL || res == -ESPIPE || res == -EFAULT)) {
+            //Fixed buffer reads not supported for sockets by the kernel, use plain receives.
+            log<debug>(O_LOG_TOKEN, "fixed read not supported - %s", std::strerror(-res));
+            myUseFixedRead = false;
+            myRing->unregister_buffer(myBufferSlot);
+            myBufferSlot = -1;
+            start_recv();
+            return;
+        }
+        if (res == -EINTR || res == -EAGAIN) {
+            start_recv();
+        } else if (res <= 0) {
+            const ErrorCode ec = (res == 0) ? ErrorCode(::asio::error::eof) : ErrorCode(-res, system_category());
+            log<debug>(O_LOG_TOKEN, "receive error - %s", ec.message().c_str());
+            if (myListener != nullptr) {
+                myListener->on_connection_error(*this, Error(ec));
+            }
+            close();
+        } else {
+            myRecvBuffer.commit(static_cast<std::size_t>(res));
+            o_assert(myListener != nullptr);
+            //The listener consumes all complete messages from the buffer with get_read_data().
+            myDeliveringData = true;
+            myListener->on_incoming_data(*this, myRecvBuffer.size());
+            myDeliveringData = false;
+            if (myState == State::OPEN) {
+                start_recv();
+            }
+        }
+    }
+
+    void start_send()
+    {
+        if (myWriteQueue.empty()) {
+            return;
+        }
+        mySendIov.clear();
+        for (const std::string& msg : myWriteQueue) {
+            if (mySendIov.size() == IOV_MAX) {
+                break;
+            }
+            const std::size_t offset = mySendIov.empty() ? mySentOffset : 0;
+            mySendIov.push_back(iovec { const_cast<char*>(msg.data()) + offset, msg.size() - offset });
+        }
+        std::memset(&mySendMsg, 0, sizeof(mySendMsg));
+        mySendMsg.msg_iov = mySendIov.data();
+        mySendMsg.msg_iovlen = mySendIov.size();
+        auto sharedThis = std::static_pointer_cast<UringTransport>(shared_from_this());
+        io_uring_sqe* sqe = myRing->prepare([sharedThis](int res, unsigned) {
+            sharedThis->handle_send(res);
+        });
+        if (sqe == nullptr) {
+            handle_error(ENXIO, "io_uring shut down");
+            return;
+        }
+        mySendInProgress = true;
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = myFd;
+        sqe->addr = reinterpret_cast<std::uintptr_t>(&mySendMsg);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+    }
+
+    void handle_send(int res)
+    {
+        mySendInProgress = false;
+        if (myState != State::OPEN) {
+            return;
+        }
+        if (res < 0 && res != -EINTR && res != -EAGAIN) {
+            handle_error(-res, "send error");
+            return;
+        }
+        std::size_t sent = res > 0 ? static_cast<std::size_t>(res) : 0u;
+        myWriteQueueSize -= sent;
+        while (sent > 0) {
+            const std::size_t remaining = myWriteQueue.front().size() - mySentOffset;
+            if (sent < remaining) {
+                mySentOffset += sent;
+                break;
+            }
+            sent -= remaining;
+            mySentOffset = 0;
+            myWriteQueue.pop_front();
+        }
+        if (myWriteQueueHigh && myWriteQueueSize <= myConfig.writeQueueLowWatermark) {
+            myWriteQueueHigh = false;
+            if (myListener != nullptr) {
+                myListener->on_write_queue_low(*this, myWriteQueueSize);
+            }
+        }
+        if (myState == State::OPEN) {
+            start_send();
+        }
+    }
+
+    void handle_error(int err, const char* what)
+    {
+        const ErrorCode ec(err, system_category());
+        log<error>(O_LOG_TOKEN, "%s - %s", what, ec.message().c_str());
+        myWriteQueue.clear();
+        myWriteQueueSize = 0;
+        mySentOffset = 0;
+        if (myListener != nullptr && myState == State::OPEN) {
+            myListener->on_connection_error(*this, Error(ec));
+        }
+        close();
+    }
+};
+
+}   //namespace asio
+}   //namespace cercall
+
+#endif // CERCALL_ASIO_HAS_URING
+
+#endif // CERCALL_ASIO_URINGTRANSPORT_H
@@ -21,6 +21,7 @@
 #ifndef CERCALL_MAIN_H
 #define CERCALL_MAIN_H
 
+#include <cstdint>
 #include <functional>
 #include <type_traits>
 #include "cercall/error.h"
@@ -37,6 +38,17 @@ namespace cercall {
  * A library for developing microservices with serialized function calls.
  */
 
+/**
+ * @brief Identifies a function call of a client connection, the service passes it back with the result.
+ * Events carry the call id 0.
+ */
+using CallId = std::uint32_t;
+
+/**
+ * @brief Identifies a service function in the messages, the FNV-1a hash of the name "Interface::function".
+ */
+using FunctionId = std::uint32_t;
+
 namespace details {
 
 template<typename T, typename Enable = void>
@@ -26,24 +26,30 @@
 #include <cercall/details/typeprops.h>
 #include "cercall/cereal/types.h"
 #include "cercall/details/messenger.h"
-#include <sstream>
+#include "cercall/details/functiontable.h"
+#include "cercall/details/viewstream.h"
+#include "cercall/details/stringostream.h"
+#include "cercall/details/streamarchive.h"
 
 namespace cercall {
 namespace cereal {
 
-static const std::string emptyString {};
-static thread_local std::ostringstream outStringStream;
-static thread_local std::istringstream inStringStream;
+static thread_local details::StringOStream outStringStream;
+static thread_local details::ViewIStream inViewStream;
 
 template<class InputArchive, class OutputArchive, bool Reusable>
 struct Serialization
 {
     static constexpr bool REUSABLE_ARCHIVE = Reusable;
 
+    /** Reusable archives own their streams, so the archives of a connection can be used by any thread. */
+    using ReusableInputArchive = details::StreamArchive<InputArchive, details::ViewIStream>;
+    using ReusableOutputArchive = details::StreamArchive<OutputArchive, details::StringOStream>;
+
     static std::unique_ptr<InputArchive> create_input_archive()
     {
         if (Reusable) {
-            return std::make_unique<InputArchive>(inStringStream);
+            return std::make_unique<ReusableInputArchive>();
         } else {
             return nullptr;
         }
@@ -52,7 +58,7 @@ struct Serialization
     static std::unique_ptr<OutputArchive> create_output_archive()
     {
         if (Reusable) {
-            return std::make_unique<OutputArchive>(outStringStream);
+            return std::make_unique<ReusableOutputArchive>();
         } else {
             return nullptr;
         }
@@ -69,71 +75,109 @@ struct Serialization
     }
 
     template<typename ...Args>
-    static std::string serialize_call(OutputArchive* ar, const std::string& functionName, Args... args)
+    static std::string serialize_call(OutputArchive* ar, FunctionId funcId, CallId callId, Args... args)
     {
-        outStringStream.str(emptyString);
-        outStringStream.clear();
-        details::Messenger::reserve_message_header(outStringStream);
+        details::StringOStream& os = output_stream(ar);
+        os.reset();
         if (ar == nullptr) {
-            OutputArchive arMsg(outStringStream);     //heavy
-            arMsg(::cereal::make_nvp("func", functionName));
+            OutputArchive arMsg(os);     //heavy
+            arMsg(::cereal::make_nvp("func", funcId));
+            arMsg(::cereal::make_nvp("id", callId));
             serialize_args(arMsg, std::forward<Args>(args)...);
         } else {
-            (*ar)(::cereal::make_nvp("func", functionName));
+            (*ar)(::cereal::make_nvp("func", funcId));
+            (*ar)(::cereal::make_nvp("id", callId));
             serialize_args(*ar, std::forward<Args>(args)...);
         }
-        return outStringStream.str();
+        return os.take();
     }
 
     template<typename ResultT>
-    static std::string serialize_call_result(OutputArchive* ar, const std::string& functionName,
+    static std::string serialize_call_result(OutputArchive* ar, FunctionId funcId, CallId callId,
                                              cercall::Result<ResultT>& res)
     {
-        outStringStream.str(emptyString);
-        outStringStream.clear();
-        details::Messenger::reserve_message_header(outStringStream);
+        details::StringOStream& os = output_stream(ar);
+        os.reset();
         if (ar == nullptr) {
-            OutputArchive resultArch(outStringStream);      //heavy
-            resultArch(::cereal::make_nvp("func", functionName));
+            OutputArchive resultArch(os);      //heavy
+            resultArch(::cereal::make_nvp("func", funcId));
+            resultArch(::cereal::make_nvp("id", callId));
             resultArch(::cereal::make_nvp("result", res));
         } else {
-            (*ar)(::cereal::make_nvp("func", functionName));
+            (*ar)(::cereal::make_nvp("func", funcId));
+            (*ar)(::cereal::make_nvp("id", callId));
             (*ar)(::cereal::make_nvp("result", res));
         }
-        return outStringStream.str();
+        return os.take();
     }
 
+    /**
+     * Serialize an event once for all clients. The event is serialized by a new archive, so the message
+     * doesn't depend on the state of a connection's reusable archive, @see deserialize_event().
+     */
     template<typename EventT>
-    static std::string serialize_event(OutputArchive* ar, const std::string& funcName, const EventT& ev)
+    static std::string serialize_event(FunctionId funcId, const EventT& ev)
     {
-        outStringStream.str(emptyString);
-        outStringStream.clear();
-        details::Messenger::reserve_message_header(outStringStream);
+        const CallId noCallId = 0;      //events are not calls
+        details::StringOStream& os = output_stream(nullptr);
+        os.reset();
+        {
+            OutputArchive eventArch(os);      //heavy
+            eventArch(::cereal::make_nvp("func", funcId));
+            eventArch(::cereal::make_nvp("id", noCallId));
+            eventArch(::cereal::make_nvp("result", ev));
+        }   //some archives complete the output in the destructor
+        return os.take();
+    }
+
+    template<typename ResultHandler>
+    static void deserialize_call(InputArchive* ar, const MessageView& msg, ResultHandler handler)
+    {
+        details::ViewIStream& is = input_stream(ar);
+        is.reset(msg);     //no copy of the message, clears ios flags
+        FunctionId funcId = 0;
+        CallId callId = 0;
         if (ar == nullptr) {
-            OutputArchive resultArch(outStringStream);      //heavy
-            resultArch(::cereal::make_nvp("func", funcName));
-            resultArch(::cereal::make_nvp("result", ev));
+            InputArchive arRes (is);     //heavy
+            arRes(::cereal::make_nvp("func", funcId));
+            arRes(::cereal::make_nvp("id", callId));
+            handler(funcId, callId, arRes);
         } else {
-            (*ar)(::cereal::make_nvp("func", funcName));
-            (*ar)(::cereal::make_nvp("result", ev));
+            (*ar)(::cereal::make_nvp("func", funcId));
+            (*ar)(::cereal::make_nvp("id", callId));
+            handler(funcId, callId, (*ar));
         }
-        return outStringStream.str();
     }
 
-    template<typename ResultHandler>
-    static void deserialize_call(InputArchive* ar, const std::string& msg, ResultHandler handler)
+    /** Serialize the function table, which the service sends to a new client. */
+    static std::string serialize_function_table(OutputArchive* ar, const details::FunctionTable& table)
     {
-        inStringStream.str(msg);
-        inStringStream.clear();     //clear ios flags
-        std::string funcName;     //full function name with interface prefix
+        details::StringOStream& os = output_stream(ar);
+        os.reset();
         if (ar == nullptr) {
-            InputArchive arRes (inStringStream);     //heavy
-            arRes(::cereal::make_nvp("func", funcName));
-            handler(funcName, arRes);
+            OutputArchive tableArch(os);      //heavy
+            save_function_table(tableArch, table);
         } else {
-            (*ar)(::cereal::make_nvp("func", funcName));
-            handler(funcName, (*ar));
+            save_function_table(*ar, table);
+        }
+        return os.take();
+    }
+
+    /** Deserialize the function table following the message header. */
+    static details::FunctionTable deserialize_function_table(InputArchive& ar)
+    {
+        details::FunctionTable table;
+        std::uint32_t count = 0;
+        ar(::cereal::make_nvp("interface", table.interfaceName));
+        ar(::cereal::make_nvp("count", count));
+        for (std::uint32_t i = 0; i < count; ++i) {
+            FunctionId funcId = 0;
+            std::uint32_t signature = 0;
+            ar(::cereal::make_nvp("func", funcId));
+            ar(::cereal::make_nvp("sig", signature));
+            table.add(funcId, signature);
         }
+        return table;
     }
 
     template<typename T>
@@ -166,7 +210,9 @@ struct Serialization
     deserialize_event(InputArchive& arEv, EventHandler handler)
     {
         std::unique_ptr<E> ev;
-        arEv(ev);
+        read_event(arEv, [&ev](InputArchive& ar) {
+            ar(ev);
+        });
         handler(std::move(ev));
     }
 
@@ -176,9 +222,53 @@ struct Serialization
     deserialize_event(InputArchive& arEv, EventHandler handler)
     {
         E ev;
-        arEv(ev);
+        read_event(arEv, [&ev](InputArchive& ar) {
+            ar(ev);
+        });
         handler(ev);
     }
+
+private:
+
+    /**
+     * Pass the archive reading the event to the reader. The event following the message header is read
+     * by a new archive on the stream of a reusable archive, as it was written by a new archive.
+     */
+    template<typename Reader>
+    static void read_event(InputArchive& ar, Reader reader)
+    {
+        if (Reusable) {
+            InputArchive eventArch(ReusableInputArchive::get_stream(ar));
+            reader(eventArch);
+        } else {
+            reader(ar);
+        }
+    }
+
+    static void save_function_table(OutputArchive& ar, const details::FunctionTable& table)
+    {
+        const FunctionId tableId = details::functionTableId;
+        const CallId noCallId = 0;
+        const std::uint32_t count = static_cast<std::uint32_t>(table.functions.size());
+        ar(::cereal::make_nvp("func", tableId));
+        ar(::cereal::make_nvp("id", noCallId));
+        ar(::cereal::make_nvp("interface", table.interfaceName));
+        ar(::cereal::make_nvp("count", count));
+        for (const details::FunctionTable::Entry& f : table.functions) {
+            ar(::cereal::make_nvp("func", f.first));
+            ar(::cereal::make_nvp("sig", f.second));
+        }
+    }
+
+    static details::StringOStream& output_stream(OutputArchive* ar)
+    {
+        return (ar == nullptr) ? outStringStream : ReusableOutputArchive::get_stream(*ar);
+    }
+
+    static details::ViewIStream& input_stream(InputArchive* ar)
+    {
+        return (ar == nullptr) ? inViewStream : ReusableInputArchive::get_stream(*ar);
+    }
 };
 
 }   //namespace cereal
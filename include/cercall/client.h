@@ -23,12 +23,15 @@
 #define CERCALL_CLIENT_H
 
 #include <list>
+#include <tuple>
 #include <unordered_map>
 #include <thread>
 #include "cercall/transport.h"
+#include "cercall/frameconfig.h"
+#include "cercall/localcalltarget.h"
 #include "cercall/details/typeprops.h"
 #include "cercall/details/messenger.h"
-#include "cercall/details/callqueue.h"
+#include "cercall/details/functiontable.h"
 #include "cercall/details/eventhelper.h"
 #include "cercall/log.h"
 
@@ -59,6 +62,11 @@ public:
 
 }   //namespace client
 
+/**
+ * The client side of a service connection.
+ * MaxCallsInProgress is the number of calls of one function which can await results at the same time,
+ * the calls are sent at once and their results are matched by call ids, in any order.
+ */
 template<class ServiceInterface, class Serialization = ServiceInterface, unsigned MaxCallsInProgress = 1>
 class Client : public ServiceInterface, protected Transport::Listener
 {
@@ -88,7 +96,8 @@ public:
       * \param t a pointer to the transport for the client connection,
       *        the client assumes ownership of the transport object
       */
-    Client(std::unique_ptr<Transport> t) : myTransport (std::move(t)), myMessenger (make_message_handler())
+    Client(std::unique_ptr<Transport> t) : myTransport (std::move(t)), myMessenger (make_message_handler()),
+                                           myEventMessenger (make_event_handler())
     {
     #ifdef O_ENSURE_SINGLE_THREAD
         myThreadId = std::this_thread::get_id();
@@ -102,6 +111,10 @@ public:
         o_assert(myTransport != nullptr);
         myTransport->close();
         myTransport->clear_listener();
+        if (myEventChannel != nullptr) {
+            myEventChannel->close();
+            myEventChannel->clear_listener();
+        }
     }
 
     /** Copy constructor is not permitted. */
@@ -151,6 +164,68 @@ public:
         return myTransport->is_open();
     }
 
+    /** \brief Bind the client to a service living in the same process.
+      * The calls of a bound client do not go through the transport: the service function is called directly
+      * with the moved call arguments, from a function passed to 'post', and the service calls the client's
+      * closure directly with the result. The calls are not serialized and need no open transport.
+      * Calls of functions, whose argument types do not match the service function exactly, are sent through
+      * the transport.
+      * \param service the service, which must outlive the binding
+      * \param post a function, which runs its argument later in the thread of the client,
+      *        e.g. posts it to the io_service of the client
+      */
+    void bind_local(LocalCallTarget& service, std::function<void(std::function<void()>)> post)
+    {
+        check_thread_id("cercall::Client::bind_local()");
+        o_assert(post);
+        myLocalService = &service;
+        myLocalPost = std::move(post);
+        myLocalFunctions.clear();
+    }
+
+    /** \brief Remove the binding to a local service, the calls go through the transport again. */
+    void unbind_local()
+    {
+        check_thread_id("cercall::Client::unbind_local()");
+        myLocalService = nullptr;
+        myLocalPost = nullptr;
+        myLocalFunctions.clear();
+    }
+
+    /** \brief Set the message framing of the connection, \see FrameConfig.
+      * The service must use the same frame format. The function must be called before open().
+      */
+    void set_frame_config(const FrameConfig& config)
+    {
+        check_thread_id("cercall::Client::set_frame_config()");
+        if (myTransport->is_open()) {
+            throw std::logic_error("cercall::Client::set_frame_config: the client is already open");
+        }
+        myFrameConfig = config;
+        myMessenger = details::Messenger(make_message_handler(), myFrameConfig);
+    }
+
+    /** \brief Receive the service events through a separate channel.
+      * Used with a service publishing its events through Service::set_event_channel(), e.g. with
+      * MulticastSubscriber. The channel passes only events to the listeners, the calls still go through
+      * the client transport. The function blocks until the channel is open.
+      * \param channel the transport of the event channel, the client assumes ownership of it
+      * \return true when the channel opened successfully, false otherwise.
+      */
+    bool open_event_channel(std::unique_ptr<Transport> channel)
+    {
+        check_thread_id("cercall::Client::open_event_channel()");
+        o_assert(channel != nullptr);
+        if (myEventChannel != nullptr) {
+            myEventChannel->close();
+            myEventChannel->clear_listener();
+        }
+        myEventChannel = std::move(channel);
+        myEventMessenger = details::Messenger(make_event_handler(), myFrameConfig);
+        myEventChannel->set_listener(*this);
+        return myEventChannel->open();
+    }
+
     /** \brief Check if a function call is in progress, awaiting response from the service.
      * \param functionName - the name of the function from the service interface
      * \return true if the function was called and a closure for it is pending.
@@ -158,9 +233,16 @@ public:
     bool is_call_in_progress(const char* functionName)
     {
         check_thread_id("cercall::Client::is_call_in_progress()");
-        std::string fullfunctionName = myFuncPrefix;
-        fullfunctionName += functionName;
-        return myClosures.find(fullfunctionName) != myClosures.end();
+        return myCallsInProgress.find(get_function_id(functionName)) != myCallsInProgress.end();
+    }
+
+    /** \brief Get the hash of the service interface, which the service sends when the client connects.
+     * \return the hash of the names and signatures of the service functions, 0 until it is received,
+     *         @see Service::get_interface_hash()
+     */
+    std::uint32_t get_interface_hash() const
+    {
+        return myFunctionTableReceived ? myServiceFunctions.hash() : 0u;
     }
 
 protected:
@@ -177,29 +259,34 @@ protected:
     template<typename ResT, typename... Args>
     void send_call(const char* funcName, const Closure<ResT>& c, Args... args)
     {
-        auto result = prepare_call_message(funcName, std::forward<Args>(args)...);
-        const std::string& fullFuncName = result.first;
-        std::string& msg = result.second;
-        if (myClosures.find(fullFuncName) == myClosures.end()) {
-            //detail::dumpMessage("send msg:", msg);
-            Error err = details::Messenger::write_message_with_header(*myTransport, msg);
-            if (err) {
-                log<error>(O_LOG_TOKEN, "error - %s", err.message().c_str());
-                Result<ResT> res(err);
-                c(res);
-            } else {
-                enqueue_closure(fullFuncName, c);      //new (function copy) for non-one-way methods
-            }
-        } else if (myCallQueue.can_enqueue(fullFuncName)) {
-            myCallQueue.enqueue_call(fullFuncName, [this, msg, c](const std::string& fullMetName,
-                                                                  cercall::Transport& t) mutable {
-                //detail::dumpMessage("send msg:", msg);
-                details::Messenger::write_message_with_header(t, msg);
-                enqueue_closure(fullMetName, c);      //new (function copy) for non-one-way methods
-            });
+        const FunctionId funcId = get_function_id(funcName);
+        if (myLocalService != nullptr && send_local_call(funcId, funcName, args..., c)) {
+            return;
+        }
+        if ( !myTransport->is_reliable()) {
+            throw std::logic_error("cercall::Client::send_call: a call with result needs a reliable transport");
+        }
+        Error err = check_function(funcId, funcName, sizeof...(Args), false);
+        if (err) {
+            Result<ResT> res(err);
+            c(res);
+            return;
+        }
+        auto inProgress = myCallsInProgress.find(funcId);
+        if (inProgress != myCallsInProgress.end() && inProgress->second >= MaxCallsInProgress) {
+            throw std::runtime_error("cercall::Client::send_call: the limit of function calls in progress "
+                                     "is exceeded");
+        }
+        CallId callId = next_call_id();
+        std::string msg = prepare_call_message(funcId, callId, std::forward<Args>(args)...);
+        //detail::dumpMessage("send msg:", msg);
+        err = myMessenger.send(*myTransport, std::move(msg));
+        if (err) {
+            log<error>(O_LOG_TOKEN, "error - %s", err.message().c_str());
+            Result<ResT> res(err);
+            c(res);
         } else {
-            throw std::runtime_error("cercall::Client::send_call: the limit of queueing function "
-                                        "calls is exceeded");
+            enqueue_closure(funcId, callId, c);      //new (function copy) for non-one-way methods
         }
    }
 
@@ -209,15 +296,29 @@ protected:
     template<typename... Args>
     void send_call(const char* funcName, Args... args)
     {
-        std::string msg = prepare_call_message(funcName, std::forward<Args>(args)...).second;
-        details::Messenger::write_message_with_header(*myTransport, msg);
+        const FunctionId funcId = get_function_id(funcName);
+        if (myLocalService != nullptr && send_local_call(funcId, funcName, args...)) {
+            return;
+        }
+        if (check_function(funcId, funcName, sizeof...(Args), true)) {
+            return;
+        }
+        const CallId noCallId = 0;      //no result is correlated with a one-way call
+        std::string msg = prepare_call_message(funcId, noCallId, std::forward<Args>(args)...);
+        myMessenger.send(*myTransport, std::move(msg));
     }
 
     template<typename S = Serialization>
     void create_archives(typename std::enable_if<S::REUSABLE_ARCHIVE>::type* = nullptr)
     {
-        myArchives.outArch = Serialization::create_output_archive();
-        myArchives.inArch = Serialization::create_input_archive();
+        if (myMessenger.keeps_message_order()) {
+            myArchives.outArch = Serialization::create_output_archive();
+            myArchives.inArch = Serialization::create_input_archive();
+        } else {
+            //A reused archive depends on the messages before, which may be overtaken in the other lane.
+            myArchives.outArch = nullptr;
+            myArchives.inArch = nullptr;
+        }
     }
 
     template<typename S = Serialization>
@@ -227,7 +328,15 @@ protected:
 
     void on_connected(Transport& tr) override
     {
+        if (&tr == myEventChannel.get()) {
+            if (myArchives.inArch == nullptr) {
+                create_archives();
+            }
+            myEventMessenger.init_transport(tr);
+            return;
+        }
         create_archives();
+        myFunctionTableReceived = false;       //the service sends it again
         myMessenger.init_transport(tr);
     }
 
@@ -236,25 +345,56 @@ protected:
         check_thread_id("cercall::Client::on_disconnected");
     }
 
+    void on_write_queue_high(Transport& tr, std::size_t) override
+    {
+        if (&tr == myTransport.get()) {
+            myMessenger.on_write_queue_high();
+        }
+    }
+
+    void on_write_queue_low(Transport& tr, std::size_t) override
+    {
+        if (&tr == myTransport.get()) {
+            myMessenger.on_write_queue_low(tr);
+        }
+    }
+
+    void on_write_ready(Transport& tr) override
+    {
+        if (&tr == myTransport.get()) {
+            myMessenger.on_write_ready(tr);
+        }
+    }
+
     /**
       * Overrides the Transport::Listener member function to call all outstanding call closures
       * with the error that has occurred in the transport layer.
       */
-    void on_connection_error(Transport&, const Error& e) override
+    void on_connection_error(Transport& tr, const Error& e) override
     {
         check_thread_id("cercall::Client::on_connection_error");
         log<error>(O_LOG_TOKEN, "error - %s", e.message().c_str());
+        if (&tr == myEventChannel.get()) {
+            return;     //no calls go through the event channel
+        }
         dispatch_connection_error(e);
     }
 
 private:
-    const std::string myBroadcastFuncName = std::string(details::TypeProperties<InterfaceType>::name) + "::broadcast_event";
+    const FunctionId myBroadcastFuncId = get_function_id("broadcast_event");
     const std::string myFuncPrefix = std::string(details::TypeProperties<InterfaceType>::name) + "::";
 
     typedef std::list<ServiceListener*> ListenerList;
 
     ListenerList myEventListeners;
     std::shared_ptr<Transport> myTransport;
+    std::shared_ptr<Transport> myEventChannel;
+    FrameConfig myFrameConfig;
+    details::FunctionTable myServiceFunctions;
+    bool myFunctionTableReceived = false;
+    LocalCallTarget* myLocalService = nullptr;
+    std::function<void(std::function<void()>)> myLocalPost;
+    std::unordered_map<FunctionId, LocalCallTarget::LocalFunction> myLocalFunctions;   ///< empty for functions called remotely
 
     struct Archives
     {
@@ -263,11 +403,20 @@ private:
     } myArchives;
 
     details::Messenger myMessenger;
-    details::CallQueue<MaxCallsInProgress - 1> myCallQueue;
+    details::Messenger myEventMessenger;
 
     typedef std::function<void(ResultArchive& arRes)> ClosureFunction;
-    typedef std::unordered_map<std::string, ClosureFunction> ClosureMap;
+
+    struct PendingCall
+    {
+        FunctionId funcId;
+        ClosureFunction closure;
+    };
+
+    typedef std::unordered_map<CallId, PendingCall> ClosureMap;
     ClosureMap myClosures { 4 };
+    std::unordered_map<FunctionId, unsigned> myCallsInProgress;    ///< number of pending calls per function
+    CallId myLastCallId = 0;
 #ifdef O_ENSURE_SINGLE_THREAD
     std::thread::id myThreadId;
 #endif
@@ -285,7 +434,8 @@ private:
 
     void dispatch_error_to_closure(const std::string& errorMsg, ClosureFunction& cl)
     {
-        Serialization::deserialize_call(myArchives.inArch.get(), errorMsg, [cl](const std::string&, ResultArchive& arRes){
+        Serialization::deserialize_call(myArchives.inArch.get(), errorMsg,
+                                        [cl](FunctionId, CallId, ResultArchive& arRes){
             cl(arRes);
         });
     }
@@ -293,64 +443,164 @@ private:
     void dispatch_connection_error(const cercall::Error& e)
     {
         Result<void> res(e);
+        //The function and call ids are not used by the closures.
         std::string errCallResMsg = Serialization::template serialize_call_result<void>(myArchives.outArch.get(),
-                                                                                        "placeholder", res);
-        details::Messenger::strip_header(errCallResMsg);
-
-        for (auto& cl : myClosures) {
-            if ( !cl.first.empty()) {
-                dispatch_error_to_closure(errCallResMsg, cl.second);
-            }
+                                                                                        0, 0, res);
+        ClosureMap closures;
+        closures.swap(myClosures);
+        myCallsInProgress.clear();
+        for (auto& cl : closures) {
+            dispatch_error_to_closure(errCallResMsg, cl.second.closure);
         }
-        myClosures.clear();
     }
 
     std::size_t on_incoming_data(Transport& tr, std::size_t dataLenInBuffer) override
     {
         check_thread_id("cercall::Client::on_incoming_data");
+        if (&tr == myEventChannel.get()) {
+            return myEventMessenger.read(tr, dataLenInBuffer);
+        }
         return myMessenger.read(tr, dataLenInBuffer);
     }
 
+    static constexpr FunctionId get_function_id(const char* funcName)
+    {
+        return details::function_id(details::TypeProperties<InterfaceType>::name, funcName);
+    }
+
+    /**
+     * @return an error if the function table of the service has no function of the id, with the number
+     *         of arguments and the closure, no error before the table is received
+     */
+    Error check_function(FunctionId funcId, const char* funcName, std::size_t numArgs, bool oneWay) const
+    {
+        if ( !myFunctionTableReceived) {
+            return Error();
+        }
+        const std::uint32_t* signature = myServiceFunctions.find(funcId);
+        if (signature == nullptr || *signature != details::function_signature(funcId, numArgs, oneWay)) {
+            log<error>(O_LOG_TOKEN, "error - the service has no function %s%s with %u arguments%s",
+                       myFuncPrefix.c_str(), funcName, static_cast<unsigned>(numArgs), oneWay ? " and no result" : "");
+            return Error::function_not_supported();
+        }
+        return Error();
+    }
+
+    void on_function_table(details::FunctionTable&& table)
+    {
+        if (table.interfaceName != details::TypeProperties<InterfaceType>::name) {
+            //The function ids depend on the interface name, so all calls will fail.
+            log<error>(O_LOG_TOKEN, "error - connected to service %s instead of %s", table.interfaceName.c_str(),
+                       details::TypeProperties<InterfaceType>::name);
+        }
+        myServiceFunctions = std::move(table);
+        myFunctionTableReceived = true;
+    }
+
+    /** @return a call id which is not 0 and not used by any pending call */
+    CallId next_call_id()
+    {
+        do {
+            ++myLastCallId;
+        } while (myLastCallId == 0 || myClosures.find(myLastCallId) != myClosures.end());
+        return myLastCallId;
+    }
+
     template<typename... Args>
-    std::pair<std::string, std::string> prepare_call_message(const char* funcName, Args... args)
+    std::string prepare_call_message(FunctionId funcId, CallId callId, Args... args)
     {
         //Also check the preconditions for send_call.
         o_assert(myTransport != nullptr);
         if (myTransport->is_open()) {
             check_thread_id("cercall::Client::prepare_call_message()");
-            std::string fullFuncName = myFuncPrefix;
-            fullFuncName += funcName;       //new
-            return std::make_pair(fullFuncName, Serialization::serialize_call(myArchives.outArch.get(), fullFuncName, std::forward<Args>(args)...));
+            return Serialization::serialize_call(myArchives.outArch.get(), funcId, callId,
+                                                 std::forward<Args>(args)...);
         } else {
             throw std::runtime_error("cercall::Client::prepare_call_message: transport to service not opened");
         }
     }
 
+    /**
+     * Call the function of the bound local service.
+     * The service function is looked up once per function id, the result of the lookup is kept until the
+     * binding changes. The argument types of a function id are fixed by the client function making the call.
+     * @param args the function arguments followed by the closure, moved when the call is made
+     * @return false if the service has no function of the id and argument types, the arguments are intact then
+     */
+    template<typename... Args>
+    bool send_local_call(FunctionId funcId, const char* funcName, Args&... args)
+    {
+        check_thread_id("cercall::Client::send_local_call()");
+        using ArgsTuple = std::tuple<typename std::decay<Args>::type...>;
+        auto cached = myLocalFunctions.find(funcId);
+        if (cached == myLocalFunctions.end()) {
+            LocalCallTarget::LocalFunction found = myLocalService->find_local_function(funcId, typeid(ArgsTuple));
+            if ( !found) {
+                log<debug>(O_LOG_TOKEN, "no local function %s%s, sending calls", myFuncPrefix.c_str(), funcName);
+            }
+            cached = myLocalFunctions.emplace(funcId, found).first;
+        }
+        const LocalCallTarget::LocalFunction func = cached->second;
+        if ( !func) {
+            return false;
+        }
+        std::shared_ptr<void> argsTuple = std::make_shared<ArgsTuple>(std::move(args)...);
+        myLocalPost([func, argsTuple]() {
+            func(argsTuple);
+        });
+        return true;
+    }
+
     template<typename ResT>
-    void enqueue_closure(const std::string& funcName, const Closure<ResT>& cl)
+    void enqueue_closure(FunctionId funcId, CallId callId, const Closure<ResT>& cl)
     {
-        myClosures[funcName] = [cl](ResultArchive& arRes){        //new
+        myClosures[callId] = PendingCall { funcId, [cl](ResultArchive& arRes){        //new
             Result<ResT> result = Serialization::template deserialize_result<ResT>(arRes);
             cl(result);
-        };
+        }};
+        ++myCallsInProgress[funcId];
     }
 
     details::Messenger::HandlerType make_message_handler()
     {
-        auto messageHandler = [this] (Transport& t, const std::string& msg) {
+        auto messageHandler = [this] (Transport& t, const MessageView& msg) {
             (void)t;
             o_assert(myTransport.get() == &t);
-            Serialization::deserialize_call(myArchives.inArch.get(), msg, [this](const std::string& funcName, ResultArchive& arRes){
-                if (funcName == myBroadcastFuncName) {
+            CallId unsupportedCallId = 0;
+            Serialization::deserialize_call(myArchives.inArch.get(), msg, [this, &unsupportedCallId](FunctionId funcId,
+                                                                             CallId callId, ResultArchive& arRes){
+                if (funcId == myBroadcastFuncId) {
                     dispatch_event(arRes);
+                } else if (funcId == details::functionTableId) {
+                    on_function_table(Serialization::deserialize_function_table(arRes));
+                } else if (funcId == details::noFunctionId) {
+                    unsupportedCallId = callId;
                 } else {
-                    dispatch_result(funcName, arRes);
+                    dispatch_result(callId, arRes);
                 }
             });
+            if (unsupportedCallId != 0) {
+                dispatch_call_error(unsupportedCallId, Error::function_not_supported());
+            }
         };
         return messageHandler;
     }
 
+    details::Messenger::HandlerType make_event_handler()
+    {
+        auto eventHandler = [this] (Transport&, const MessageView& msg) {
+            Serialization::deserialize_call(myArchives.inArch.get(), msg, [this](FunctionId funcId, CallId,
+                                                                             ResultArchive& arEv){
+                if (funcId == myBroadcastFuncId) {
+                    dispatch_event(arEv);
+                } else {
+                    log<error>(O_LOG_TOKEN, "unexpected message of function id %u in event channel", funcId);
+                }
+            });
+        };
+        return eventHandler;
+    }
+
     /** Dispatch an event. */
     template<typename E = EventType>
     typename std::enable_if<!std::is_void<E>::value>::type
@@ -370,17 +620,30 @@ private:
     {
     }
 
-    void dispatch_result(const std::string& funcName, ResultArchive& res)
+    /**
+     * Pass the error to the closure of the call. The error is serialized by a new archive, not by the reusable
+     * archives of the connection, which track the types of the results received from the service.
+     */
+    void dispatch_call_error(CallId callId, const cercall::Error& e)
+    {
+        Result<void> res(e);
+        std::string errCallResMsg = Serialization::template serialize_call_result<void>(nullptr, 0, callId, res);
+        Serialization::deserialize_call(nullptr, errCallResMsg, [this](FunctionId, CallId id, ResultArchive& arRes){
+            dispatch_result(id, arRes);
+        });
+    }
+
+    void dispatch_result(CallId callId, ResultArchive& res)
     {
-        auto closureIt = myClosures.find(funcName);
+        auto closureIt = myClosures.find(callId);
         if (closureIt != myClosures.end()) {
-            //std::cout << "call result closure for " << funcName << std::endl;
-            auto closure = closureIt->second;
-            myClosures.erase(closureIt);    //allow a new method call in this closure
-            if (myCallQueue.is_enqueued(funcName)) {
-                //this sends the next queued message and enqueues the closure
-                myCallQueue.dequeue_call(funcName, *myTransport);
+            auto closure = std::move(closureIt->second.closure);
+            auto inProgress = myCallsInProgress.find(closureIt->second.funcId);
+            o_assert(inProgress != myCallsInProgress.end());
+            if (--inProgress->second == 0) {
+                myCallsInProgress.erase(inProgress);
             }
+            myClosures.erase(closureIt);    //allow a new method call in this closure
             closure(res);
         } else {
             throw std::runtime_error("cercall::Client: closure not found for function result");
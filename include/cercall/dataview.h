@@ -0,0 +1,98 @@
+/*!
+ * \file
+ * \brief     Cercall non-owning view of received data
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_DATAVIEW_H
+#define CERCALL_DATAVIEW_H
+
+#include <cstddef>
+#include <string>
+
+namespace cercall {
+
+/**
+ * @brief A non-owning view of a contiguous sequence of bytes.
+ * The viewed data is owned by the object which created the view (e.g. the input buffer of a transport),
+ * the view is valid only as long as the owner keeps the data unchanged.
+ */
+class DataView
+{
+public:
+    DataView() {}
+
+    DataView(const char* data, std::size_t size) : myData(data), mySize(size) {}
+
+    DataView(const std::string& s) : myData(s.data()), mySize(s.size()) {}
+
+    const char* data() const    {   return myData;  }
+
+    std::size_t size() const    {   return mySize;  }
+
+    std::size_t length() const    {   return mySize;  }
+
+    bool empty() const  {   return mySize == 0; }
+
+    const char* begin() const   {   return myData;  }
+
+    const char* end() const     {   return myData + mySize; }
+
+    /** @return a copy of the viewed data */
+    std::string to_string() const   {   return std::string(myData, mySize);  }
+
+private:
+    const char* myData = nullptr;
+    std::size_t mySize = 0;
+};
+
+/**
+ * @brief A non-owning view of a message, which was received in one or more chunks.
+ * The chunks are not contiguous in memory, the archives read them through details::ViewIStream.
+ */
+class MessageView
+{
+public:
+    MessageView(DataView view) : myFirst(view), myTotalSize(view.size()) {}
+
+    MessageView(const std::string& s) : MessageView(DataView(s)) {}
+
+    /** @param chunks the array of chunks, which must outlive the message view */
+    MessageView(const DataView* chunks, std::size_t count) : myChunks(chunks), myCount(count)
+    {
+        for (std::size_t i = 0; i < count; ++i) {
+            myTotalSize += chunks[i].size();
+        }
+    }
+
+    const DataView* chunks() const  {   return (myChunks != nullptr) ? myChunks : &myFirst; }
+
+    std::size_t chunk_count() const {   return myCount; }
+
+    /** @return the total size of the chunks */
+    std::size_t size() const    {   return myTotalSize; }
+
+private:
+    DataView myFirst;
+    const DataView* myChunks = nullptr;
+    std::size_t myCount = 1u;
+    std::size_t myTotalSize = 0;
+};
+
+}   //namespace cercall
+
+#endif // CERCALL_DATAVIEW_H
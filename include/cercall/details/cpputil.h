@@ -45,8 +45,8 @@
 #define CERCALL_APPLY_7(m, arg, x1, x2, x3, x4, x5, x6, x7) m(arg, x1), m(arg, x2), m(arg, x3), m(arg, x4), m(arg, x5), m(arg, x6), m(arg, x7)
 #define CERCALL_APPLY_8(m, arg, x1, x2, x3, x4, x5, x6, x7, x8) m(arg, x1), m(arg, x2), m(arg, x3), m(arg, x4), m(arg, x5), m(arg, x6), m(arg, x7), m(arg, x8)
 
-/* A macro applied to make a pointer to member function. */
-#define CERCALL_MAKE_MEMFUN(i, f)  (&i::f)
+/* A macro applied to make a service function with the member function pointer as a template argument. */
+#define CERCALL_MAKE_MEMFUN(i, f)  (cercall::details::MemberFunction<decltype(&i::f), &i::f>{#f})
 
 namespace cercall {
 
@@ -0,0 +1,57 @@
+/*!
+ * \file
+ * \brief     Cercall FNV-1a hash functions
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_DETAILS_FNV1A_H
+#define CERCALL_DETAILS_FNV1A_H
+
+#include <cstdint>
+
+namespace cercall {
+namespace details {
+
+constexpr std::uint32_t fnv1aOffsetBasis = 2166136261u;
+constexpr std::uint32_t fnv1aPrime = 16777619u;
+
+/**
+ * @return the 32-bit FNV-1a hash of the string
+ * @param hash the hash of the preceding string, to hash a concatenation without building it
+ */
+constexpr std::uint32_t fnv1a(const char* str, std::uint32_t hash = fnv1aOffsetBasis)
+{
+    while (*str != '\0') {
+        hash = (hash ^ static_cast<unsigned char>(*str++)) * fnv1aPrime;
+    }
+    return hash;
+}
+
+/** @return the hash continued with the four bytes of the value, the least significant byte first */
+constexpr std::uint32_t fnv1a_value(std::uint32_t value, std::uint32_t hash = fnv1aOffsetBasis)
+{
+    for (int i = 0; i < 4; ++i) {
+        hash = (hash ^ (value & 0xffu)) * fnv1aPrime;
+        value >>= 8;
+    }
+    return hash;
+}
+
+}   //namespace details
+}   //namespace cercall
+
+#endif // CERCALL_DETAILS_FNV1A_H
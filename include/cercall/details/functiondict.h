@@ -18,23 +18,41 @@
  * limitations under the License.
  */
 
-
 #ifndef CERCALL_FUNCTIONDICT_H
 #define CERCALL_FUNCTIONDICT_H
 
-#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+#include <typeinfo>
+#include <utility>
+#include <vector>
 #include "cercall/cercall.h"
+#include "cercall/localcalltarget.h"
+#include "cercall/workerpool.h"
+#include "cercall/details/functiontable.h"
 #include "cercall/details/typeutil.h"
 
 namespace cercall {
 namespace details {
 
+/**
+ * A service function passed to a function dictionary. The member function pointer is a template
+ * argument, so the dictionary stores plain function pointers calling it, @see CERCALL_MAKE_MEMFUN.
+ */
+template<typename MemF, MemF memF>
+struct MemberFunction
+{
+    const char* name;   ///< the unqualified function name
+};
+
 /**
  * An instance of this template is created for every Cercall function that is added to a function
  * dictionary of a Cercall service.
- * The class deserializes the function arguments and calls the service function.
+ * The class deserializes the function arguments and calls the service function, or passes the call
+ * to a worker pool.
  */
-template<typename F, class SrvIfc, typename Serialization, bool OneWay, typename R, typename ArgsTuple>
+template<typename MemF, MemF memF, class SrvIfc, typename Serialization, bool OneWay, typename R, typename ArgsTuple>
 class FunctionCaller
 {
     template<bool OW, typename Enable = void>
@@ -70,48 +88,100 @@ class FunctionCaller
 public:
     using ResultHandler = typename std::function<void(std::string& resultMsg)>;
 
-    FunctionCaller(F f) : myFunc { f } {}
-
-    void operator()(SrvIfc& obj, std::shared_ptr<Transport>& clTr, ArgArch& args, ResArch* resAr,
-                    const std::string& funcName, ResultHandler& rh)
+    /**
+     * @param pool the worker pool running the service function, nullptr to call it in this thread.
+     *        The client transport must support Transport::post() then.
+     * @return false if the worker pool rejected the call
+     */
+    static bool call(SrvIfc& obj, std::shared_ptr<Transport>& clTr, ArgArch& args,
+                     const std::shared_ptr<ResArch>& resAr, FunctionId funcId, CallId callId, const ResultHandler& rh,
+                     WorkerPool* pool)
     {
         //The Closure object which is the last parameter of a service function.
-        Closure<R> closure {[resAr, funcName, rh] (const Result<R>& r) {
-            cercall::Result<R> res(r);
-            std::string resMsg = Serialization::template serialize_call_result<R>(resAr, funcName, res);
-            rh(resMsg);
+        //It shares the result archive, which must outlive the client state if the client disconnects first.
+        //The lambda keeps the client transport even when the closure is passed on as a plain std::function.
+        std::shared_ptr<Transport> tr = clTr;
+        Closure<R> closure {[resAr, funcId, callId, rh, tr] (const Result<R>& r) {
+            if (tr && WorkerPool::running_in_worker()) {
+                //Worker threads never run the event loop of the transport.
+                tr->post([resAr, funcId, callId, rh, r]() {
+                    send_result(resAr, funcId, callId, rh, r);
+                });
+            } else if ( !tr || tr->running_in_this_thread()) {
+                send_result(resAr, funcId, callId, rh, r);
+            } else {
+                //The result archive belongs to the client transport context.
+                tr->dispatch([resAr, funcId, callId, rh, r]() {
+                    send_result(resAr, funcId, callId, rh, r);
+                });
+            }
         }, clTr};
-        deserialize_args(obj, args, closure, ArgsTuple{});
+        return deserialize_args(obj, args, closure, pool, ArgsTuple{});
+    }
+
+    /**
+     * Serialize an error result of the function, without calling it. The result type must match the function,
+     * the reusable archives of the connection track the serialized types.
+     */
+    static std::string serialize_error(ResArch* resAr, FunctionId funcId, CallId callId, const Error& err)
+    {
+        cercall::Result<R> res(err);
+        return Serialization::template serialize_call_result<R>(resAr, funcId, callId, res);
     }
 
 private:
 
-    F myFunc;
+    static void send_result(const std::shared_ptr<ResArch>& resAr, FunctionId funcId, CallId callId,
+                            const ResultHandler& rh, const Result<R>& r)
+    {
+        cercall::Result<R> res(r);
+        std::string resMsg = Serialization::template serialize_call_result<R>(resAr.get(), funcId, callId, res);
+        rh(resMsg);
+    }
 
     template<class Head, class... Tail, class... Collected>
-    void deserialize_args(SrvIfc& obj, ArgArch& args, Closure<R>& cl, type_tuple<Head, Tail...>, Collected... c)
+    static bool deserialize_args(SrvIfc& obj, ArgArch& args, Closure<R>& cl, WorkerPool* pool,
+                                 type_tuple<Head, Tail...>, Collected... c)
     {
-        deserialize_args<Tail...>(obj, args, cl, type_tuple<Tail...>{}, std::forward<Collected>(c)..., get<Head>(args));
+        return deserialize_args<Tail...>(obj, args, cl, pool, type_tuple<Tail...>{},
+                                         std::forward<Collected>(c)..., get<Head>(args));
     }
 
     template<class... Collected>
-    void deserialize_args(SrvIfc& obj, ArgArch&, Closure<R>& cl, type_tuple<>, Collected... c)
+    static bool deserialize_args(SrvIfc& obj, ArgArch&, Closure<R>& cl, WorkerPool* pool, type_tuple<>,
+                                 Collected... c)
+    {
+        if (pool == nullptr) {
+            call_func(obj, cl, std::integral_constant<bool, OneWay>(), std::forward<Collected>(c)...);
+            return true;
+        }
+        //The arguments are deserialized here, the archive belongs to the transport context.
+        SrvIfc* objPtr = &obj;
+        auto argsPtr = std::make_shared<std::tuple<Collected...>>(std::forward<Collected>(c)...);
+        Closure<R> closure = cl;
+        return pool->submit([objPtr, argsPtr, closure]() mutable {
+            call_with_args(*objPtr, closure, *argsPtr, std::index_sequence_for<Collected...>{});
+        });
+    }
+
+    template<class... Collected, std::size_t... I>
+    static void call_with_args(SrvIfc& obj, Closure<R>& cl, std::tuple<Collected...>& args, std::index_sequence<I...>)
     {
-        call_func(obj, cl, std::integral_constant<bool, OneWay>(), std::forward<Collected>(c)...);
+        call_func(obj, cl, std::integral_constant<bool, OneWay>(), std::move(std::get<I>(args))...);
     }
 
     template<class... Collected>
-    void call_func(SrvIfc& obj, Closure<R>& cl, std::false_type, Collected... c)
+    static void call_func(SrvIfc& obj, Closure<R>& cl, std::false_type, Collected... c)
     {
-        myFunc(obj, std::forward<Collected>(c)..., cl);
+        (obj.*memF)(std::forward<Collected>(c)..., cl);
     }
 
     //Overload for the one-way service functions.
     template<class... Collected>
-    void call_func(SrvIfc& obj, Closure<R>&, std::true_type, Collected... c)
+    static void call_func(SrvIfc& obj, Closure<R>&, std::true_type, Collected... c)
     {
         //One-way functions don't have the Closure parameter.
-        myFunc(obj, std::forward<Collected>(c)...);
+        (obj.*memF)(std::forward<Collected>(c)...);
     }
 
     //T must have a default constructor.
@@ -124,36 +194,49 @@ private:
     }
 };
 
-template<class SrvIfc, typename Serialization, bool OneWay, typename ...Ts, typename F>
-FunctionCaller<F, SrvIfc, Serialization, OneWay, Ts...> make_function_caller(F f)  {
-    return {f};
-}
-
-template<typename SI>
-struct CompareMemFn
+/**
+ * An instance of this template is created for every Cercall function that is added to a function
+ * dictionary of a Cercall service.
+ * The class calls the service function directly with the arguments of a client living in the same process,
+ * without serialization.
+ */
+template<typename MemF, MemF memF, class SrvIfc, typename ArgsTuple>
+class DirectCaller
 {
-    bool operator () (void (SI::*f1)(), void (SI::*f2)())
+public:
+    /** @param obj the service object as SrvIfc*, @see LocalCallTarget::LocalFunction */
+    static void call(void* obj, const std::shared_ptr<void>& args)
+    {
+        ArgsTuple& argsTuple = *std::static_pointer_cast<ArgsTuple>(args);
+        call_func(*static_cast<SrvIfc*>(obj), argsTuple, std::make_index_sequence<std::tuple_size<ArgsTuple>::value>{});
+    }
+
+private:
+    template<std::size_t... I>
+    static void call_func(SrvIfc& obj, ArgsTuple& argsTuple, std::index_sequence<I...>)
     {
-        return &f1 < &f2;
+        (obj.*memF)(std::move(std::get<I>(argsTuple))...);
     }
 };
 
+/**
+ * The dispatch table of the functions of a service type.
+ * The function ids are hashes of the function names, so the table is a perfect hash table: the slot
+ * of an id is a bit field of the id, chosen when a function is added so that no two functions share a slot.
+ * A lookup is a single indexed load and id comparison, returning the flags and the plain function
+ * pointers of the function.
+ *
+ * One dictionary is shared by all instances of a service class, @see Service::shared_function_dictionary().
+ * Adding a function which is already in the dictionary doesn't modify it, so the instances may add their
+ * functions concurrently, also while the functions are called by other instances. Adding a new function
+ * while the functions are called is not allowed - all instances of a service class must add the same
+ * functions, and a sealed dictionary refuses new functions.
+ */
 template<typename SI, typename Serialization>
 class FunctionDict
 {
     using ArgsArchive = typename Serialization::InputArchive;
     using ResultArchive = typename Serialization::OutputArchive;
-    using ResultHandler = typename std::function<void(std::string&)>;
-    typedef std::function<void(SI& obj, std::shared_ptr<Transport>& clTr, ArgsArchive& args, ResultArchive* resAr,
-                               const std::string& functionName, ResultHandler& h)> DictFunction;
-
-    struct DictEntry
-    {
-        DictFunction func;
-        bool oneWay = false;
-    };
-
-    typedef std::map<std::string, DictEntry> FuncDictType;
 
     template <class, bool, class = void>
     struct result_type_traits
@@ -171,64 +254,224 @@ class FunctionDict
         using ArgsTuple = typename remove_last_type_of<Args...>::type;
     };
 
+    static constexpr std::size_t maxSlots = 1u << 16;
+
 public:
+    using ResultHandler = typename std::function<void(std::string&)>;
 
-    template<bool OneWay, typename ...Args>
-    void add_function(const std::string& functionName, void (SI::*function)(Args...))
+    using CallFunction = bool (*)(SI& obj, std::shared_ptr<Transport>& clTr, ArgsArchive& args,
+                                  const std::shared_ptr<ResultArchive>& resAr, FunctionId funcId, CallId callId,
+                                  const ResultHandler& h, WorkerPool* pool);
+
+    using ErrorFunction = std::string (*)(ResultArchive* resAr, FunctionId funcId, CallId callId, const Error& err);
+
+    using DirectFunction = void (*)(void* obj, const std::shared_ptr<void>& args);
+
+    struct Entry
     {
-        using LastArgType = typename last_type_of<Args...>::type;
-        using ResT = typename result_type_traits<LastArgType, OneWay>::type;
-        using ArgsTuple = typename result_type_traits<LastArgType, OneWay>::template ArgsTuple<Args...>;
+        FunctionId id = 0;
+        bool oneWay = false;
+        bool offloaded = false;     ///< the function is called by a worker pool, @see Service::set_worker_pool()
+        CallFunction call = nullptr;
+        ErrorFunction serializeError = nullptr;
+        DirectFunction direct = nullptr;
+        const std::type_info* directArgsType = nullptr;     ///< the argument tuple type of the direct function
+        std::uint32_t signature = 0;
+        std::string name;       ///< the name "Interface::function"
+    };
 
-        myFunctionDict[functionName].func = make_function_caller<SI, Serialization, OneWay, ResT, ArgsTuple>(std::mem_fn(function));
-        myFunctionDict[functionName].oneWay = OneWay;
+    FunctionDict() : mySlots(1, 0) {}
+
+    FunctionDict(const FunctionDict&) = delete;
+    FunctionDict& operator=(const FunctionDict&) = delete;
+
+    template<bool OneWay, typename MemF, MemF memF, bool Offloaded = false>
+    void add_function(const std::string& functionName)
+    {
+        add_function<OneWay, MemF, memF>(functionName, memF, Offloaded);
     }
 
-    template<bool OneWay>
-    void add_function(const std::string &functionName, void (SI::*function)())
+    /** Add the functions of another dictionary, which are not in this one yet. */
+    void add_entries(const FunctionDict& other)
     {
-        static_assert(OneWay == true, "parameterless service function must be a one-way function");
+        std::vector<Entry> entries;
+        {
+            std::lock_guard<std::mutex> lock(other.myMutex);
+            entries = other.myEntries;
+        }
+        for (Entry& entry : entries) {
+            insert_entry(std::move(entry));
+        }
+    }
 
-        using ArgsTuple = details::type_tuple<>;
+    /**
+     * Refuse new functions from now on. The lookups are not synchronized with adding a function, so the table
+     * must not change once a service using it has started.
+     */
+    void seal()
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+        mySealed = true;
+    }
+
+    /** @return the entry of the function, nullptr if there is no function of the id */
+    const Entry* find(FunctionId funcId) const
+    {
+        std::uint16_t slot = mySlots[(funcId >> myShift) & myMask];
+        if (slot == 0 || myEntries[slot - 1].id != funcId) {
+            return nullptr;
+        }
+        return &myEntries[slot - 1];
+    }
 
-        myFunctionDict[functionName].func = make_function_caller<SI, Serialization, OneWay, void, ArgsTuple>(std::mem_fn(function));
-        myFunctionDict[functionName].oneWay = OneWay;
+    /** @return the name of the function, nullptr if there is no function of the id */
+    const std::string* get_name(FunctionId funcId) const
+    {
+        const Entry* entry = find(funcId);
+        return (entry != nullptr) ? &entry->name : nullptr;
     }
 
-    template<bool OneWay, typename BaseInterface, typename ...Args>
-    void add_function(const std::string& functionName, void (BaseInterface::*function)(Args...))
+    /** @return the table of the functions passed to the clients */
+    FunctionTable get_function_table(const std::string& interfaceName) const
     {
+        FunctionTable table;
+        table.interfaceName = interfaceName;
+        for (const Entry& e : myEntries) {
+            table.add(e.id, e.signature);
+        }
+        return table;
+    }
+
+    /**
+     * @return a function calling the service function directly, empty if there is no function
+     *         of the id and argument tuple type, @see LocalCallTarget::find_local_function()
+     */
+    LocalCallTarget::LocalFunction find_direct_function(FunctionId funcId, SI& obj,
+                                                        const std::type_info& argsType) const
+    {
+        LocalCallTarget::LocalFunction func;
+        const Entry* entry = find(funcId);
+        if (entry != nullptr && entry->directArgsType != nullptr && *entry->directArgsType == argsType) {
+            func.call = entry->direct;
+            func.service = &obj;
+        }
+        return func;
+    }
+
+private:
+    std::vector<Entry> myEntries;
+    std::vector<std::uint16_t> mySlots;     ///< index + 1 of the entry in the slot, 0 for an empty slot
+    std::uint32_t myMask = 0;
+    unsigned myShift = 0;
+    mutable std::mutex myMutex;     ///< serializes adding the functions
+    bool mySealed = false;
+
+    template<bool OneWay, typename MemF, MemF memF, class C, typename ...Args>
+    void add_function(const std::string& functionName, void (C::*)(Args...), bool offloaded)
+    {
+        static_assert(std::is_base_of<C, SI>::value, "the function is not a member of the service interface");
+
         using LastArgType = typename last_type_of<Args...>::type;
         using ResT = typename result_type_traits<LastArgType, OneWay>::type;
         using ArgsTuple = typename result_type_traits<LastArgType, OneWay>::template ArgsTuple<Args...>;
-
-        myFunctionDict[functionName].func
-                = make_function_caller<SI, Serialization, OneWay, ResT, ArgsTuple>(std::mem_fn(function));
-        myFunctionDict[functionName].oneWay = OneWay;
+        using DirectArgsTuple = std::tuple<typename std::decay<Args>::type...>;
+        using Caller = FunctionCaller<MemF, memF, SI, Serialization, OneWay, ResT, ArgsTuple>;
+
+        Entry entry;
+        entry.oneWay = OneWay;
+        entry.offloaded = offloaded;
+        entry.call = &Caller::call;
+        entry.serializeError = &Caller::serialize_error;
+        entry.direct = &DirectCaller<MemF, memF, SI, DirectArgsTuple>::call;
+        entry.directArgsType = &typeid(DirectArgsTuple);
+        add_entry(functionName, sizeof...(Args) - (OneWay ? 0 : 1), std::move(entry));
     }
 
-    void call_function(std::shared_ptr<Transport>& clTr, const std::string& functionName, SI& obj,
-                       ResultArchive* resAr, ArgsArchive& args, ResultHandler rh)
+    template<bool OneWay, typename MemF, MemF memF, class C>
+    void add_function(const std::string& functionName, void (C::*)(), bool offloaded)
     {
-        find(functionName)->second.func(obj, clTr, args, resAr, functionName, rh);
+        static_assert(OneWay == true, "parameterless service function must be a one-way function");
+        static_assert(std::is_base_of<C, SI>::value, "the function is not a member of the service interface");
+        using Caller = FunctionCaller<MemF, memF, SI, Serialization, OneWay, void, type_tuple<>>;
+
+        Entry entry;
+        entry.oneWay = OneWay;
+        entry.offloaded = offloaded;
+        entry.call = &Caller::call;
+        entry.serializeError = &Caller::serialize_error;
+        entry.direct = &DirectCaller<MemF, memF, SI, std::tuple<>>::call;
+        entry.directArgsType = &typeid(std::tuple<>);
+        add_entry(functionName, 0, std::move(entry));
     }
 
-    bool is_one_way(const std::string& functionName)
+    void add_entry(const std::string& functionName, std::size_t numArgs, Entry entry)
     {
-        return find(functionName)->second.oneWay;
+        entry.id = function_id(functionName.c_str());
+        entry.signature = function_signature(entry.id, numArgs, entry.oneWay);
+        entry.name = functionName;
+        insert_entry(std::move(entry));
     }
 
-private:
-    FuncDictType myFunctionDict;
-
-    typename FuncDictType::iterator find(const std::string& functionName)
+    void insert_entry(Entry entry)
     {
-        auto found = myFunctionDict.find(functionName);
-        if (found == myFunctionDict.end()) {
-            std::string err = functionName + " not found in function dictionary";
+        std::lock_guard<std::mutex> lock(myMutex);
+        const Entry* found = nullptr;
+        for (const Entry& e : myEntries) {
+            if (e.id == entry.id) {
+                found = &e;
+            }
+        }
+        if (found != nullptr && found->name == entry.name && found->signature == entry.signature) {
+            if (found->offloaded != entry.offloaded) {
+                throw std::logic_error("function " + entry.name + " is added both as offloaded and not offloaded");
+            }
+            return;     //added by another instance of the service
+        }
+        if (entry.id == functionTableId || entry.id == noFunctionId || found != nullptr) {
+            std::string err = "the id of function " + entry.name + " collides with "
+                              + (found != nullptr ? found->name : std::string("a reserved id"));
             throw std::logic_error(err);
         }
-        return found;
+        if (mySealed) {
+            throw std::logic_error("function " + entry.name + " is added after a service of the class has started, "
+                                   "all instances of a service class must add the same functions");
+        }
+        std::vector<Entry> entries = myEntries;
+        entries.push_back(std::move(entry));
+        std::vector<std::uint16_t> slots;
+        std::uint32_t mask = 0;
+        unsigned shift = 0;
+        build_slots(entries, slots, mask, shift);
+        myEntries.swap(entries);
+        mySlots.swap(slots);
+        myMask = mask;
+        myShift = shift;
+    }
+
+    /** Find the smallest slot table where each function has its own slot. */
+    static void build_slots(const std::vector<Entry>& entries, std::vector<std::uint16_t>& slots,
+                            std::uint32_t& mask, unsigned& shift)
+    {
+        unsigned bits = 1;
+        while ((std::size_t(1) << bits) < 2 * entries.size()) {
+            ++bits;
+        }
+        for (; (std::size_t(1) << bits) <= maxSlots; ++bits) {
+            mask = (std::uint32_t(1) << bits) - 1;
+            for (shift = 0; shift + bits <= 32; ++shift) {
+                slots.assign(std::size_t(1) << bits, 0);
+                bool perfect = true;
+                for (std::size_t i = 0; i < entries.size() && perfect; ++i) {
+                    std::uint16_t& slot = slots[(entries[i].id >> shift) & mask];
+                    perfect = (slot == 0);
+                    slot = static_cast<std::uint16_t>(i + 1);
+                }
+                if (perfect) {
+                    return;
+                }
+            }
+        }
+        throw std::logic_error("cannot build the dispatch table of " + entries.back().name);
     }
 };
 
@@ -236,4 +479,3 @@ private:
 }   //namespace cercall
 
 #endif // CERCALL_FUNCTIONDICT_H
-
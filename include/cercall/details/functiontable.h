@@ -0,0 +1,99 @@
+/*!
+ * \file
+ * \brief     Cercall table of service functions passed to the clients
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_DETAILS_FUNCTIONTABLE_H
+#define CERCALL_DETAILS_FUNCTIONTABLE_H
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include "cercall/cercall.h"
+#include "cercall/details/fnv1a.h"
+
+namespace cercall {
+namespace details {
+
+/** The function id of the message passing the function table, no service function has this id. */
+constexpr FunctionId functionTableId = 0;
+
+/** The function id of the reply to a call of a function the service doesn't have, the reply has no result. */
+constexpr FunctionId noFunctionId = 1;
+
+/** @return the id of a service function, @param qualifiedName "Interface::function" */
+constexpr FunctionId function_id(const char* qualifiedName)
+{
+    return fnv1a(qualifiedName);
+}
+
+/** @return the id of a service function without building its qualified name */
+constexpr FunctionId function_id(const char* interfaceName, const char* funcName)
+{
+    return fnv1a(funcName, fnv1a("::", fnv1a(interfaceName)));
+}
+
+/**
+ * @return the signature hash of a service function, known to the service and to the client,
+ *         which tells if they agree on the number of function arguments and on the closure
+ */
+constexpr std::uint32_t function_signature(FunctionId id, std::size_t numArgs, bool oneWay)
+{
+    return fnv1a_value(oneWay ? 1u : 0u, fnv1a_value(static_cast<std::uint32_t>(numArgs), fnv1a_value(id)));
+}
+
+/**
+ * The functions of a service. The service sends the table to every client when it connects,
+ * the client checks each call against it.
+ */
+struct FunctionTable
+{
+    using Entry = std::pair<FunctionId, std::uint32_t>;     ///< function id and signature hash
+
+    std::string interfaceName;
+    std::vector<Entry> functions;       ///< sorted by function id
+
+    void add(FunctionId id, std::uint32_t signature)
+    {
+        auto pos = std::lower_bound(functions.begin(), functions.end(), Entry(id, 0));
+        functions.insert(pos, Entry(id, signature));
+    }
+
+    /** @return the signature hash of the function, nullptr if the service has no such function */
+    const std::uint32_t* find(FunctionId id) const
+    {
+        auto found = std::lower_bound(functions.begin(), functions.end(), Entry(id, 0));
+        return (found != functions.end() && found->first == id) ? &found->second : nullptr;
+    }
+
+    /** @return the hash of the interface name and of all function signatures */
+    std::uint32_t hash() const
+    {
+        std::uint32_t h = fnv1a(interfaceName.c_str());
+        for (const Entry& f : functions) {
+            h = fnv1a_value(f.second, h);
+        }
+        return h;
+    }
+};
+
+}   //namespace details
+}   //namespace cercall
+
+#endif // CERCALL_DETAILS_FUNCTIONTABLE_H
@@ -0,0 +1,154 @@
+/*!
+ * \file
+ * \brief     Cercall library details - event loop lag based load shedding
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_DETAILS_LAGSHEDDER_H
+#define CERCALL_DETAILS_LAGSHEDDER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+
+namespace cercall {
+namespace details {
+
+/**
+ * Decides which calls a service sheds when its event loop lags behind, following the CoDel queue management:
+ * the lag of each call is the event loop lag when it is dispatched, @see LagProbe. A lag above the target is tolerated for
+ * one interval, then the shedding starts with one call and continues while the lag stays above the target,
+ * each next call shed after interval / sqrt(number of calls shed), so the shedding rate grows until the lag
+ * drops below the target. The calls between the shed ones are accepted, so the service keeps working.
+ */
+class LagShedder
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /** A zero target disables the shedding. */
+    explicit LagShedder(Clock::duration target = Clock::duration::zero(),
+                        Clock::duration interval = std::chrono::milliseconds(100))
+        : myTarget(target), myInterval(interval) {}
+
+    bool is_enabled() const     {   return myTarget > Clock::duration::zero();  }
+
+    /**
+     * @param received the time the call was received, the lag is now - received
+     * @return true if the call must be shed
+     */
+    bool shed(Clock::time_point received, Clock::time_point now = Clock::now())
+    {
+        if ( !is_enabled() || now - received < myTarget) {
+            myAboveTargetUntil = Clock::time_point();
+            myShedding = false;
+            return false;
+        }
+        if (myAboveTargetUntil == Clock::time_point()) {
+            myAboveTargetUntil = now + myInterval;
+            return false;
+        }
+        if (now < myAboveTargetUntil) {
+            return false;
+        }
+        if ( !myShedding) {
+            myShedding = true;
+            myShedCount = 1;
+            myNextShedTime = now + next_interval();
+            return true;
+        }
+        if (now < myNextShedTime) {
+            return false;
+        }
+        ++myShedCount;
+        myNextShedTime += next_interval();
+        return true;
+    }
+
+    /** @return true while the lag stays above the target for longer than the interval */
+    bool is_shedding() const    {   return myShedding;  }
+
+private:
+    Clock::duration myTarget;
+    Clock::duration myInterval;
+    Clock::time_point myAboveTargetUntil;   ///< the end of the tolerated interval, zero when below the target
+    Clock::time_point myNextShedTime;
+    unsigned myShedCount = 0;
+    bool myShedding = false;
+
+    Clock::duration next_interval() const
+    {
+        return std::chrono::duration_cast<Clock::duration>(myInterval / std::sqrt(static_cast<double>(myShedCount)));
+    }
+};
+
+/**
+ * Measures the lag of an event loop: a probe function posted to the loop waits behind the handlers queued
+ * before it, its delay is the lag. A new probe is started when the previous one completed, the lag is at least
+ * the age of the pending probe. The lag measured before the loop went idle for longer than maxAge is forgotten.
+ * The probe is completed by the thread running the loop and read by the threads dispatching calls.
+ */
+class LagProbe
+{
+public:
+    using Clock = LagShedder::Clock;
+
+    explicit LagProbe(Clock::duration maxAge) : myMaxAge(maxAge) {}
+
+    /** @return true if a new probe must be posted, which calls complete() when it runs */
+    bool start(Clock::time_point now = Clock::now())
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+        if (myPending) {
+            return false;
+        }
+        if (now - myCompleteTime > myMaxAge) {
+            myLag = Clock::duration::zero();    //no data received since, the loop was idle
+        }
+        myPending = true;
+        myPostTime = now;
+        return true;
+    }
+
+    void complete(Clock::time_point now = Clock::now())
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+        myLag = now - myPostTime;
+        myCompleteTime = now;
+        myPending = false;
+    }
+
+    Clock::duration lag(Clock::time_point now = Clock::now()) const
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+        return myPending ? std::max(myLag, now - myPostTime) : myLag;
+    }
+
+private:
+    Clock::duration myMaxAge;
+    Clock::duration myLag = Clock::duration::zero();
+    Clock::time_point myPostTime;
+    Clock::time_point myCompleteTime;
+    bool myPending = false;
+    mutable std::mutex myMutex;
+};
+
+}   //namespace details
+}   //namespace cercall
+
+#endif // CERCALL_DETAILS_LAGSHEDDER_H
@@ -22,11 +22,13 @@
 #define CERCALL_DETAILS_MESSENGER_H
 
 #include <cstring>
-#include <ostream>
 #include <functional>
 #include <limits>
 #include <algorithm>
+#include <list>
+#include <vector>
 #include "cercall/transport.h"
+#include "cercall/frameconfig.h"
 #include "cercall/log.h"
 
 namespace cercall {
@@ -35,28 +37,40 @@ namespace details {
 class Messenger
 {
 public:
-    using HandlerType = std::function<void(Transport& t, const std::string&)>;
+    using HandlerType = std::function<void(Transport& t, const MessageView&)>;
 
-    Messenger(HandlerType messageHandler)
-        : myMsgHandler(messageHandler) {}
+    Messenger(HandlerType messageHandler, const FrameConfig& config = FrameConfig())
+        : myMsgHandler(messageHandler), myConfig(config) {}
 
     Messenger(const Messenger& other)
     {
-        myMsgHandler = other.myMsgHandler;
-        myReceiveState = MsgRecvState::HEADER;
+        operator=(other);
     }
 
     Messenger& operator=(const Messenger& other)
     {
         myMsgHandler = other.myMsgHandler;
+        myConfig = other.myConfig;
         myReceiveState = MsgRecvState::HEADER;
+        myVarintShift = 0;
+        for (auto& chunks : myChunks) {
+            chunks.clear();
+        }
+        myChunksSize = 0;
+        myBulkQueue.clear();
+        myWriteQueueHigh = false;
+        myWaitingWriteReady = false;
         return *this;
     }
 
     void init_transport(Transport& tr)
     {
         o_assert(myReceiveState == MsgRecvState::HEADER);
-        tr.read(HEADER_SIZE);
+        check_transport(tr, myConfig);
+        myBulkQueue.clear();
+        myWriteQueueHigh = false;
+        myWaitingWriteReady = false;
+        tr.read(header_read_size(myConfig.format));
     }
 
     std::size_t read(Transport& tr, std::size_t dataLenInBuffer)
@@ -66,31 +80,58 @@ public:
 
         while(hasMoreData) {
             switch (myReceiveState) {
-            case MsgRecvState::HEADER:
-                if (dataLenInBuffer >= HEADER_SIZE) {
-                    const std::string& readData = tr.get_read_data();
-                    o_assert(readData.length() >= HEADER_SIZE);
-                    std::copy_n(readData.begin(), HEADER_SIZE, reinterpret_cast<std::string::value_type*>(&myIncomingMsgSize));
-                    bytesRead += HEADER_SIZE;
+            case MsgRecvState::HEADER: {
+                const std::size_t readSize = header_read_size(myConfig.format);
+                if (dataLenInBuffer >= readSize) {
+                    const DataView readData = tr.get_read_data();
+                    o_assert(readData.length() >= readSize);
+                    bytesRead += readSize;
+                    dataLenInBuffer -= readSize;
+                    if ( !decode_header(readData)) {
+                        tr.read(readSize);      //the next byte of a varint
+                        break;
+                    }
+                    if (myConfig.chunkSize != 0) {
+                        myHasMoreChunks = (myIncomingMsgSize & MORE_FLAG) != 0;
+                        myIncomingLane = (myIncomingMsgSize & BULK_FLAG) ? Lane::BULK : Lane::URGENT;
+                        myIncomingMsgSize >>= FLAG_BITS;
+                    }
                     if (myIncomingMsgSize == 0) {
-                        throw std::runtime_error("invalid message length received");
+                        log<error>(O_LOG_TOKEN, "error - invalid message length 0, closing connection");
+                        tr.close();
+                        return bytesRead;
+                    }
+                    if (myIncomingMsgSize > max_message_size() - std::min(myChunksSize, max_message_size())) {
+                        log<error>(O_LOG_TOKEN, "error - message length %llu exceeds the limit, closing connection",
+                                   static_cast<unsigned long long>(myChunksSize + myIncomingMsgSize));
+                        //Closing may destroy this messenger, so it must not be accessed anymore.
+                        tr.close();
+                        return bytesRead;
                     }
                     myReceiveState = MsgRecvState::MESSAGE;
-                    tr.read(myIncomingMsgSize);
-                    dataLenInBuffer -= HEADER_SIZE;
+                    tr.read(static_cast<uint32_t>(myIncomingMsgSize));
                 } else {
                     hasMoreData = false;
                 }
                 break;
+            }
             case MsgRecvState::MESSAGE:
                 if (dataLenInBuffer >= myIncomingMsgSize) {
-                    const std::string& msgData = tr.get_read_data();
+                    const DataView msgData = tr.get_read_data();
                     o_assert(msgData.length() >= myIncomingMsgSize);
-                    //log<debug>(O_LOG_TOKEN, "read msg (size=%d): %s", msgData.size(), msgData.c_str());
-                    myMsgHandler(tr, msgData);
+                    //log<debug>(O_LOG_TOKEN, "read msg (size=%d): %s", msgData.size(), msgData.data());
+                    std::vector<std::string>& chunks = myChunks[static_cast<int>(myIncomingLane)];
+                    if (myHasMoreChunks) {
+                        append_chunk(chunks, DataView(msgData.data(), myIncomingMsgSize));
+                        myChunksSize += myIncomingMsgSize;
+                    } else if (chunks.empty()) {
+                        myMsgHandler(tr, DataView(msgData.data(), myIncomingMsgSize));
+                    } else {
+                        deliver_chunks(tr, DataView(msgData.data(), myIncomingMsgSize));
+                    }
                     bytesRead += myIncomingMsgSize;
                     myReceiveState = MsgRecvState::HEADER;
-                    tr.read(HEADER_SIZE);
+                    tr.read(header_read_size(myConfig.format));
                     dataLenInBuffer -= myIncomingMsgSize;
                 } else {
                     hasMoreData = false;
@@ -101,39 +142,371 @@ public:
                 break;
             }
         }
+        if ( !tr.is_reliable() && (myReceiveState != MsgRecvState::HEADER || myVarintShift != 0)) {
+            //A datagram holds complete messages, the rest of a truncated one never arrives.
+            log<error>(O_LOG_TOKEN, "error - truncated message in a datagram dropped");
+            myReceiveState = MsgRecvState::HEADER;
+            myVarintShift = 0;
+            tr.read(header_read_size(myConfig.format));
+        }
         return bytesRead;
     }
 
-    static void reserve_message_header(std::ostream& os)
+    /**
+     * Check that the transport can carry the frame format. Varint headers are read byte by byte,
+     * which takes a system call per byte unless the transport reads ahead.
+     * @throw std::logic_error if the transport does not read ahead for the varint format
+     */
+    static void check_transport(const Transport& tr, const FrameConfig& config)
     {
-        char hdrPlace[HEADER_SIZE] = { 0 };
-        os.write(hdrPlace, sizeof(hdrPlace));
+        if (config.format == FrameFormat::VARINT && !tr.reads_ahead()) {
+            throw std::logic_error("cercall::Messenger: the varint frame format requires a transport which "
+                                   "reads ahead, e.g. with StreamTransportConfig::receiveBufferSize");
+        }
     }
 
-    static Error write_message_with_header(Transport& tr, std::string& msg)
+    /**
+     * Send a message through the transport of this messenger.
+     * With chunking enabled, messages longer than a chunk are sent on the bulk lane. Their chunks are
+     * passed to the transport a few at a time, @see FrameConfig::bulkChunksInFlight, and never while
+     * the transport reports the high watermark of its write queue. Shorter messages are written at once
+     * on the urgent lane, so they don't wait for the bulk messages queued before them.
+     */
+    Error send(Transport& tr, std::string msg)
     {
-        if (msg.length() > std::numeric_limits<MessageSizeType>::max() - HEADER_SIZE) {
+        if (myConfig.chunkSize == 0 || msg.size() <= chunk_size(myConfig)) {
+            return write_message(tr, msg, myConfig);
+        }
+        return send(tr, std::make_shared<const std::string>(std::move(msg)));
+    }
+
+    /**
+     * Send a message shared with other messengers, e.g. an event broadcast to all clients.
+     * The message is not copied, a bulk message keeps a reference to it until its last chunk is written.
+     */
+    Error send(Transport& tr, const std::shared_ptr<const std::string>& msg)
+    {
+        if (myConfig.chunkSize == 0 || msg->size() <= chunk_size(myConfig)) {
+            return write_message(tr, *msg, myConfig);
+        }
+        if (msg->length() > myConfig.maxMessageSize) {
             throw std::length_error("message too long");
         }
-        MessageSizeType msgSize = static_cast<MessageSizeType>(msg.size()) - HEADER_SIZE;
-        memcpy(&msg[0], &msgSize, HEADER_SIZE);
-        //log<debug>(O_LOG_TOKEN, "write msg (size=%d): %s", msgSize, &msg[HEADER_SIZE]);
-        return tr.write(msg);
+        myBulkQueue.emplace_back(msg);
+        return write_bulk_chunks(tr);
+    }
+
+    /**
+     * @return false if a message may overtake the messages sent before it, i.e. with chunking enabled,
+     *         when a short message in the urgent lane overtakes a long one in the bulk lane
+     */
+    bool keeps_message_order() const
+    {
+        return myConfig.chunkSize == 0;
+    }
+
+    /**
+     * @return the memory held for the chunks of the incomplete messages. Their length is limited
+     *         by FrameConfig::maxMessageSize for both lanes together.
+     */
+    std::size_t get_chunk_memory() const
+    {
+        std::size_t size = 0;
+        for (const std::vector<std::string>& blocks : myChunks) {
+            size += blocks.capacity() * sizeof(std::string);
+            for (const std::string& block : blocks) {
+                size += block.capacity();
+            }
+        }
+        return size;
+    }
+
+    /** To be called by the transport listener, bulk messages are not passed to the transport anymore. */
+    void on_write_queue_high()
+    {
+        myWriteQueueHigh = true;
+    }
+
+    /** To be called by the transport listener, bulk messages are passed to the transport again. */
+    void on_write_queue_low(Transport& tr)
+    {
+        myWriteQueueHigh = false;
+        Error err = write_bulk_chunks(tr);
+        if (err) {
+            log<error>(O_LOG_TOKEN, "error - %s", err.message().c_str());
+        }
     }
 
-    static void strip_header(std::string& msg)
+    /** To be called by the transport listener, the next chunks of bulk messages are passed to the transport. */
+    void on_write_ready(Transport& tr)
     {
-        msg.erase(0, HEADER_SIZE);
+        myWaitingWriteReady = false;
+        Error err = write_bulk_chunks(tr);
+        if (err) {
+            log<error>(O_LOG_TOKEN, "error - %s", err.message().c_str());
+        }
+    }
+
+    /**
+     * Write the message preceded by the message header.
+     * The header is passed to the transport as a separate buffer, so the message needs no room for it.
+     * A message longer than a chunk is written at once, so the function may be used only for transports
+     * which never get messages from send().
+     */
+    static Error write_message(Transport& tr, const std::string& msg, const FrameConfig& config = FrameConfig())
+    {
+        //The header limits the length of a chunk, not of a chunked message.
+        const std::uint64_t maxLength = (config.chunkSize == 0) ? max_length(config.format)
+                                                                : std::numeric_limits<std::uint64_t>::max();
+        if (msg.length() > std::min(config.maxMessageSize, maxLength)) {
+            throw std::length_error("message too long");
+        }
+        if (config.chunkSize == 0) {
+            char header[MAX_HEADER_SIZE];
+            const std::size_t headerSize = encode_header(header, msg.size(), config.format);
+            const DataView buffers[] = { DataView(header, headerSize), DataView(msg) };
+            //log<debug>(O_LOG_TOKEN, "write msg (size=%d): %s", msgSize, msg.c_str());
+            return tr.write(buffers, 2u);
+        }
+        const std::size_t chunkSize = chunk_size(config);
+        const Lane lane = (msg.size() > chunkSize) ? Lane::BULK : Lane::URGENT;
+        std::size_t offset = 0;
+        do {
+            const std::size_t len = std::min(chunkSize, msg.size() - offset);
+            Error err = write_chunk(tr, DataView(msg.data() + offset, len), lane, offset + len < msg.size(), config);
+            if (err) {
+                return err;
+            }
+            offset += len;
+        } while (offset < msg.size());
+        return Error();
     }
 
 private:
-    using MessageSizeType = std::uint32_t;      //< This could be a class template parameter.
-    static constexpr std::size_t HEADER_SIZE = sizeof(MessageSizeType);
+    static constexpr std::size_t MAX_HEADER_SIZE = 10u;     //a 64-bit varint
+    static constexpr std::size_t CHUNK_BLOCK_SIZE = 64u * 1024u;
     enum class MsgRecvState    {   HEADER, MESSAGE };
 
+    /** The lanes of chunked messages, the chunks of different lanes may be interleaved. */
+    enum class Lane    {   URGENT = 0, BULK = 1    };
+    //The lowest bits of a chunk length are the flags of a following chunk and of the bulk lane.
+    static constexpr std::uint64_t MORE_FLAG = 1u;
+    static constexpr std::uint64_t BULK_FLAG = 2u;
+    static constexpr unsigned FLAG_BITS = 2u;
+
+    struct BulkMessage
+    {
+        explicit BulkMessage(const std::shared_ptr<const std::string>& m) : msg(m) {}
+        std::shared_ptr<const std::string> msg;
+        std::size_t offset = 0;     ///< the length of the chunks already written
+    };
+
     MsgRecvState myReceiveState = MsgRecvState::HEADER;
-    MessageSizeType myIncomingMsgSize = 0;
+    std::uint64_t myIncomingMsgSize = 0;
+    unsigned myVarintShift = 0;
     HandlerType myMsgHandler;
+    FrameConfig myConfig;
+    bool myHasMoreChunks = false;
+    Lane myIncomingLane = Lane::URGENT;
+    std::vector<std::string> myChunks[2];   ///< the received chunks of a message per lane but the last one, in blocks
+    std::uint64_t myChunksSize = 0;         ///< the length of the received chunks of all lanes
+    std::list<BulkMessage> myBulkQueue;     ///< unlike a deque, an empty list holds no memory
+    bool myWriteQueueHigh = false;
+    bool myWritingBulk = false;
+    bool myWaitingWriteReady = false;       ///< the chunks in flight are not written yet
+
+    /**
+     * Append a received chunk to the blocks of its lane. The small chunks share a block, so the memory
+     * held for an incomplete message is about its length, not one allocation per chunk.
+     */
+    static void append_chunk(std::vector<std::string>& blocks, DataView chunk)
+    {
+        const char* data = chunk.data();
+        std::size_t len = chunk.size();
+        while (len > 0) {
+            if (blocks.empty() || blocks.back().size() == blocks.back().capacity()) {
+                blocks.emplace_back();
+                blocks.back().reserve(CHUNK_BLOCK_SIZE);
+            }
+            std::string& block = blocks.back();
+            const std::size_t n = std::min(len, block.capacity() - block.size());
+            block.append(data, n);
+            data += n;
+            len -= n;
+        }
+    }
+
+    /** Pass the chunks of a message to the handler, the last chunk stays in the transport buffer. */
+    void deliver_chunks(Transport& tr, DataView lastChunk)
+    {
+        std::vector<std::string> chunks = std::move(myChunks[static_cast<int>(myIncomingLane)]);
+        myChunks[static_cast<int>(myIncomingLane)].clear();
+        for (const std::string& chunk : chunks) {
+            myChunksSize -= chunk.size();
+        }
+        std::vector<DataView> views(chunks.begin(), chunks.end());
+        views.push_back(lastChunk);
+        myMsgHandler(tr, MessageView(views.data(), views.size()));
+    }
+
+    /**
+     * Write the queued bulk messages chunk by chunk, until FrameConfig::bulkChunksInFlight chunks are written
+     * or the write queue of the transport is high.
+     */
+    Error write_bulk_chunks(Transport& tr)
+    {
+        if (myWritingBulk || myWaitingWriteReady) {
+            return Error();     //a notification from the transport write below, or chunks still in flight
+        }
+        myWritingBulk = true;
+        const std::size_t chunkSize = chunk_size(myConfig);
+        const bool paced = myConfig.bulkChunksInFlight > 0 && tr.can_post();
+        std::size_t chunkCount = 0;
+        Error err;
+        while ( !myWriteQueueHigh && !myBulkQueue.empty()) {
+            if (paced && chunkCount == myConfig.bulkChunksInFlight) {
+                myWaitingWriteReady = true;
+                tr.request_write_ready();
+                break;
+            }
+            BulkMessage& bulk = myBulkQueue.front();
+            const std::size_t len = std::min(chunkSize, bulk.msg->size() - bulk.offset);
+            const bool more = bulk.offset + len < bulk.msg->size();
+            err = write_chunk(tr, DataView(bulk.msg->data() + bulk.offset, len), Lane::BULK, more, myConfig);
+            if (err) {
+                myBulkQueue.clear();
+                break;
+            }
+            bulk.offset += len;
+            ++chunkCount;
+            if ( !more) {
+                myBulkQueue.pop_front();
+            }
+        }
+        myWritingBulk = false;
+        return err;
+    }
+
+    static Error write_chunk(Transport& tr, DataView chunk, Lane lane, bool more, const FrameConfig& config)
+    {
+        std::uint64_t value = static_cast<std::uint64_t>(chunk.size()) << FLAG_BITS;
+        if (more) {
+            value |= MORE_FLAG;
+        }
+        if (lane == Lane::BULK) {
+            value |= BULK_FLAG;
+        }
+        char header[MAX_HEADER_SIZE];
+        const std::size_t headerSize = encode_header(header, value, config.format);
+        const DataView buffers[] = { DataView(header, headerSize), chunk };
+        return tr.write(buffers, 2u);
+    }
+
+    /** @return the maximum length of a chunk, the fixed width headers have less room for it than for a message */
+    static std::size_t chunk_size(const FrameConfig& config)
+    {
+        return static_cast<std::size_t>(std::min<std::uint64_t>(config.chunkSize,
+                                                                max_length(config.format) >> FLAG_BITS));
+    }
+
+    /** @return the number of bytes requested from the transport for the header, or a part of it */
+    static std::size_t header_read_size(FrameFormat format)
+    {
+        switch (format) {
+        case FrameFormat::FIXED_16: return sizeof(std::uint16_t);
+        case FrameFormat::FIXED_64: return sizeof(std::uint64_t);
+        case FrameFormat::VARINT:   return 1u;      //varints are read byte by byte
+        default:                    return sizeof(std::uint32_t);
+        }
+    }
+
+    static std::uint64_t max_length(FrameFormat format)
+    {
+        switch (format) {
+        case FrameFormat::FIXED_16: return std::numeric_limits<std::uint16_t>::max();
+        case FrameFormat::FIXED_32: return std::numeric_limits<std::uint32_t>::max();
+        default:                    return std::numeric_limits<std::uint64_t>::max();
+        }
+    }
+
+    /** Transports read at most 4 GB at once. */
+    std::uint64_t max_message_size() const
+    {
+        return std::min<std::uint64_t>(myConfig.maxMessageSize, std::numeric_limits<std::uint32_t>::max());
+    }
+
+    template<typename T>
+    static std::size_t encode_fixed(char* header, std::uint64_t len)
+    {
+        const T value = static_cast<T>(len);
+        std::memcpy(header, &value, sizeof(T));
+        return sizeof(T);
+    }
+
+    static std::size_t encode_header(char* header, std::uint64_t len, FrameFormat format)
+    {
+        switch (format) {
+        case FrameFormat::FIXED_16: return encode_fixed<std::uint16_t>(header, len);
+        case FrameFormat::FIXED_64: return encode_fixed<std::uint64_t>(header, len);
+        case FrameFormat::VARINT: {
+            std::size_t i = 0;
+            std::uint64_t value = len;
+            while (value >= 0x80u) {
+                header[i++] = static_cast<char>((value & 0x7fu) | 0x80u);
+                value >>= 7;
+            }
+            header[i++] = static_cast<char>(value);
+            return i;
+        }
+        default:                    return encode_fixed<std::uint32_t>(header, len);
+        }
+    }
+
+    template<typename T>
+    static std::uint64_t decode_fixed(const DataView& data)
+    {
+        T value;
+        std::memcpy(&value, data.data(), sizeof(T));
+        return value;
+    }
+
+    /**
+     * Decode the header, or a byte of a varint header, into myIncomingMsgSize.
+     * @return true if the header is complete
+     */
+    bool decode_header(const DataView& data)
+    {
+        switch (myConfig.format) {
+        case FrameFormat::FIXED_16:
+            myIncomingMsgSize = decode_fixed<std::uint16_t>(data);
+            return true;
+        case FrameFormat::FIXED_64:
+            myIncomingMsgSize = decode_fixed<std::uint64_t>(data);
+            return true;
+        case FrameFormat::VARINT: {
+            const std::uint8_t byte = static_cast<std::uint8_t>(data.data()[0]);
+            if (myVarintShift == 0) {
+                myIncomingMsgSize = 0;
+            }
+            if (myVarintShift >= 64) {
+                //Too long, the size exceeds any limit.
+                myIncomingMsgSize = std::numeric_limits<std::uint64_t>::max();
+                myVarintShift = 0;
+                return true;
+            }
+            myIncomingMsgSize |= static_cast<std::uint64_t>(byte & 0x7fu) << myVarintShift;
+            if (byte & 0x80u) {
+                myVarintShift += 7;
+                return false;
+            }
+            myVarintShift = 0;
+            return true;
+        }
+        default:
+            myIncomingMsgSize = decode_fixed<std::uint32_t>(data);
+            return true;
+        }
+    }
 };
 
 }   //namespace details
@@ -0,0 +1,119 @@
+/*!
+ * \file
+ * \brief     Cercall receive buffer for read-ahead transports
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_DETAILS_RECEIVEBUFFER_H
+#define CERCALL_DETAILS_RECEIVEBUFFER_H
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "cercall/log.h"
+
+namespace cercall {
+namespace details {
+
+/**
+ * A reusable input buffer for transports which read ahead of the requested message length.
+ * Received data is appended at the back, consumed data is released from the front.
+ * The unconsumed data is moved to the front of the buffer only when there is not enough room
+ * for the next read, so received frames always stay contiguous in memory and the buffer is
+ * allocated once per connection, unless a frame larger than the buffer is requested.
+ */
+class ReceiveBuffer
+{
+public:
+    explicit ReceiveBuffer(std::size_t capacity = 0) : myBuffer(capacity) {}
+
+    /** @return pointer to the unconsumed data */
+    const char* data() const    {   return myBuffer.data() + myReadPos;    }
+
+    /** @return length of the unconsumed data */
+    std::size_t size() const    {   return myWritePos - myReadPos;  }
+
+    bool empty() const  {   return myReadPos == myWritePos; }
+
+    /** @return pointer to the free space at the back of the buffer */
+    char* write_ptr()   {   return myBuffer.data() + myWritePos;    }
+
+    /** @return length of the free space at the back of the buffer */
+    std::size_t write_space() const    {   return myBuffer.size() - myWritePos;    }
+
+    /** Append len bytes written to write_ptr() to the unconsumed data. */
+    void commit(std::size_t len)
+    {
+        o_assert(len <= write_space());
+        myWritePos += len;
+    }
+
+    /** Release len bytes from the front of the unconsumed data. */
+    void consume(std::size_t len)
+    {
+        o_assert(len <= size());
+        myReadPos += len;
+        if (myReadPos == myWritePos) {
+            myReadPos = myWritePos = 0;
+        }
+    }
+
+    /** Append a copy of the data to the buffer. */
+    void append(const char* data, std::size_t len)
+    {
+        prepare(len, len);
+        std::memcpy(write_ptr(), data, len);
+        commit(len);
+    }
+
+    /**
+     * Make room for the next read.
+     * @param frameLen the length of the frame which must fit in the buffer contiguously
+     * @param minSpace the minimum free space required at the back of the buffer
+     */
+    void prepare(std::size_t frameLen, std::size_t minSpace)
+    {
+        if (write_space() >= minSpace && myReadPos + frameLen <= myBuffer.size()) {
+            return;
+        }
+        const std::size_t unconsumed = size();
+        if (myReadPos > 0) {
+            std::memmove(myBuffer.data(), data(), unconsumed);
+            myReadPos = 0;
+            myWritePos = unconsumed;
+        }
+        const std::size_t required = std::max(frameLen, unconsumed + minSpace);
+        if (myBuffer.size() < required) {
+            myBuffer.resize(required);
+        }
+    }
+
+    std::size_t capacity() const    {   return myBuffer.size(); }
+
+    /** @return pointer to the whole buffer memory, which changes when prepare() grows the buffer */
+    char* storage()     {   return myBuffer.data(); }
+
+private:
+    std::vector<char> myBuffer;
+    std::size_t myReadPos = 0;
+    std::size_t myWritePos = 0;
+};
+
+}   //namespace details
+}   //namespace cercall
+
+#endif // CERCALL_DETAILS_RECEIVEBUFFER_H
@@ -0,0 +1,198 @@
+/*!
+ * \file
+ * \brief     Cercall lock-free single-producer single-consumer byte ring
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_DETAILS_SPSCRING_H
+#define CERCALL_DETAILS_SPSCRING_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include "cercall/log.h"
+
+namespace cercall {
+namespace details {
+
+/**
+ * A lock-free single-producer single-consumer ring of bytes, placed in memory which may be
+ * shared between processes.
+ * The producer and the consumer positions grow monotonically, the ring index is the position
+ * modulo the capacity, which must be a power of 2.
+ * The ring does not wake up the peers itself, it tells the caller when a wake-up is needed:
+ * the producer learns that the ring was empty before its write, the consumer learns that
+ * the producer waits for free space.
+ * The positions are written by the peer process, which is not trusted: when they are
+ * inconsistent, the ring is marked as corrupted and no data is moved anymore.
+ */
+class SpscRing
+{
+    struct Header
+    {
+        alignas(64) std::atomic<std::uint64_t> head;            ///< consumer position
+        alignas(64) std::atomic<std::uint64_t> tail;            ///< producer position
+        alignas(64) std::atomic<std::uint32_t> writerWaiting;   ///< producer waits for free space
+    };
+
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+                  "lock-free atomics are required in shared memory");
+
+public:
+    /** @return size of memory occupied by a ring of the given capacity */
+    static constexpr std::size_t memory_size(std::size_t capacity)
+    {
+        return sizeof(Header) + capacity;
+    }
+
+    /** Initialize an empty ring in the memory, done once by the creator of the shared memory. */
+    static void init(void* mem)
+    {
+        Header* hdr = new (mem) Header;
+        hdr->head.store(0);
+        hdr->tail.store(0);
+        hdr->writerWaiting.store(0);
+    }
+
+    SpscRing() {}
+
+    SpscRing(void* mem, std::size_t capacity)
+        : myHeader(static_cast<Header*>(mem)), myData(static_cast<char*>(mem) + sizeof(Header)),
+          myCapacity(capacity)
+    {
+        o_assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    }
+
+    /**
+     * Producer: write as many bytes as fit in the free space of the ring.
+     * @param wasEmpty set to true when the consumer had consumed all data before this write
+     *        and must be woken up
+     * @return number of bytes written
+     */
+    std::size_t write(const char* data, std::size_t len, bool& wasEmpty)
+    {
+        const std::uint64_t tail = myHeader->tail.load(std::memory_order_relaxed);
+        const std::uint64_t head = myHeader->head.load(std::memory_order_acquire);
+        wasEmpty = false;
+        if ( !check_positions(head, tail)) {
+            return 0;
+        }
+        const std::size_t n = std::min(len, myCapacity - static_cast<std::size_t>(tail - head));
+        if (n > 0) {
+            const std::size_t idx = static_cast<std::size_t>(tail) & (myCapacity - 1);
+            const std::size_t firstPart = std::min(n, myCapacity - idx);
+            std::memcpy(myData + idx, data, firstPart);
+            std::memcpy(myData, data + firstPart, n - firstPart);
+            //Sequentially consistent store and load pair with the ones in read().
+            myHeader->tail.store(tail + n, std::memory_order_seq_cst);
+            wasEmpty = myHeader->head.load(std::memory_order_seq_cst) == tail;
+        }
+        return n;
+    }
+
+    /**
+     * Producer: announce waiting for free space.
+     * @return true if there is free space already, so the producer need not wait.
+     */
+    bool wait_for_space()
+    {
+        myHeader->writerWaiting.store(1, std::memory_order_seq_cst);
+        const std::uint64_t tail = myHeader->tail.load(std::memory_order_relaxed);
+        const std::uint64_t head = myHeader->head.load(std::memory_order_seq_cst);
+        return check_positions(head, tail) && tail - head < myCapacity;
+    }
+
+    /**
+     * Consumer: read up to maxLen bytes.
+     * @param wakeWriter set to true when the producer waits for free space and must be woken up
+     * @return number of bytes read
+     */
+    std::size_t read(char* dest, std::size_t maxLen, bool& wakeWriter)
+    {
+        const std::uint64_t head = myHeader->head.load(std::memory_order_relaxed);
+        const std::uint64_t tail = myHeader->tail.load(std::memory_order_seq_cst);
+        wakeWriter = false;
+        if ( !check_positions(head, tail)) {
+            return 0;
+        }
+        const std::size_t n = std::min(maxLen, static_cast<std::size_t>(tail - head));
+        if (n > 0) {
+            const std::size_t idx = static_cast<std::size_t>(head) & (myCapacity - 1);
+            const std::size_t firstPart = std::min(n, myCapacity - idx);
+            std::memcpy(dest, myData + idx, firstPart);
+            std::memcpy(dest + firstPart, myData, n - firstPart);
+            myHeader->head.store(head + n, std::memory_order_seq_cst);
+            wakeWriter = myHeader->writerWaiting.exchange(0, std::memory_order_seq_cst) != 0;
+        }
+        return n;
+    }
+
+    /**
+     * Consumer: get the readable data which lies contiguously in the ring memory, up to its end.
+     * The producer does not touch the data until it is released with consume().
+     * @param len set to the number of bytes available at the returned address
+     */
+    const char* peek(std::size_t& len)
+    {
+        const std::uint64_t head = myHeader->head.load(std::memory_order_relaxed);
+        const std::uint64_t tail = myHeader->tail.load(std::memory_order_seq_cst);
+        const std::size_t idx = static_cast<std::size_t>(head) & (myCapacity - 1);
+        len = check_positions(head, tail) ? std::min(static_cast<std::size_t>(tail - head), myCapacity - idx) : 0;
+        return myData + idx;
+    }
+
+    /**
+     * Consumer: release len bytes obtained with peek().
+     * @return true when the producer waits for free space and must be woken up
+     */
+    bool consume(std::size_t len)
+    {
+        if (len == 0) {
+            return false;
+        }
+        const std::uint64_t head = myHeader->head.load(std::memory_order_relaxed);
+        myHeader->head.store(head + len, std::memory_order_seq_cst);
+        return myHeader->writerWaiting.exchange(0, std::memory_order_seq_cst) != 0;
+    }
+
+    std::size_t capacity() const    {   return myCapacity;  }
+
+    /** @return true when the peer has written inconsistent positions */
+    bool is_corrupted() const   {   return myCorrupted; }
+
+private:
+    Header* myHeader = nullptr;
+    char* myData = nullptr;
+    std::size_t myCapacity = 0;
+    bool myCorrupted = false;
+
+    /** The ring never holds more than its capacity, otherwise the copies would run past its memory. */
+    bool check_positions(std::uint64_t head, std::uint64_t tail)
+    {
+        if (tail - head > myCapacity) {
+            myCorrupted = true;
+        }
+        return !myCorrupted;
+    }
+};
+
+}   //namespace details
+}   //namespace cercall
+
+#endif // CERCALL_DETAILS_SPSCRING_H
@@ -0,0 +1,61 @@
+/*!
+ * \file
+ * \brief     Cercall reusable archive owning its stream
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_DETAILS_STREAMARCHIVE_H
+#define CERCALL_DETAILS_STREAMARCHIVE_H
+
+namespace cercall {
+namespace details {
+
+template<class Stream>
+struct StreamMember
+{
+    Stream myStream;
+};
+
+/**
+ * A reusable archive which owns the stream it is bound to.
+ * Reusable archives keep state between messages, so each connection has its own archives. Owning
+ * the stream lets the archives of a connection be used by any thread, as thread_local streams
+ * would be shared by all archives created by the same thread.
+ * The stream is a base class, so that it's constructed before the archive.
+ */
+template<class Archive, class Stream>
+class StreamArchive : private StreamMember<Stream>, public Archive
+{
+public:
+    template<typename... Options>
+    explicit StreamArchive(Options... options) : Archive(this->myStream, options...) {}
+
+    Stream& get_stream()    {   return this->myStream;  }
+
+    /**
+     * @return the stream of an archive created as a StreamArchive
+     */
+    static Stream& get_stream(Archive& ar)
+    {
+        return static_cast<StreamArchive&>(ar).get_stream();
+    }
+};
+
+}   //namespace details
+}   //namespace cercall
+
+#endif // CERCALL_DETAILS_STREAMARCHIVE_H
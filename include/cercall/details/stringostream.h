@@ -0,0 +1,111 @@
+/*!
+ * \file
+ * \brief     Cercall output stream writing to a string which can be moved out
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_DETAILS_STRINGOSTREAM_H
+#define CERCALL_DETAILS_STRINGOSTREAM_H
+
+#include <algorithm>
+#include <climits>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+namespace cercall {
+namespace details {
+
+/**
+ * A stream buffer writing directly into a string, which is moved out when the message is complete.
+ */
+class StringStreamBuf : public std::streambuf
+{
+public:
+    /** Drop the written data and start with an empty string. */
+    void reset()
+    {
+        myString = std::string();
+        setp(nullptr, nullptr);
+    }
+
+    /** @return the written data, the stream buffer starts with an empty string */
+    std::string take()
+    {
+        myString.resize(static_cast<std::size_t>(pptr() - pbase()));
+        std::string s = std::move(myString);
+        reset();
+        return s;
+    }
+
+protected:
+    /** Grow the string, which is the put area, geometrically. */
+    int_type overflow(int_type ch) override
+    {
+        if (traits_type::eq_int_type(ch, traits_type::eof())) {
+            return traits_type::not_eof(ch);
+        }
+        const std::size_t minSize = 256;
+        std::ptrdiff_t used = pptr() - pbase();
+        myString.resize(std::max(myString.size() * 2, minSize));
+        setp(&myString[0], &myString[0] + myString.size());
+        for (; used > INT_MAX; used -= INT_MAX) {
+            pbump(INT_MAX);     //pbump() takes an int
+        }
+        pbump(static_cast<int>(used));
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+        return ch;
+    }
+
+private:
+    std::string myString;
+};
+
+/**
+ * An output stream writing to a string, a replacement for std::ostringstream which avoids copying
+ * the message out of the stream.
+ */
+class StringOStream : public std::ostream
+{
+public:
+    StringOStream() : std::ostream(nullptr)
+    {
+        rdbuf(&myBuf);
+    }
+
+    /** Start writing a new message, clear the stream state flags. */
+    void reset()
+    {
+        myBuf.reset();
+        clear();
+    }
+
+    /** @return the message written since reset() */
+    std::string take()
+    {
+        return myBuf.take();
+    }
+
+private:
+    StringStreamBuf myBuf;
+};
+
+}   //namespace details
+}   //namespace cercall
+
+#endif // CERCALL_DETAILS_STRINGOSTREAM_H
@@ -0,0 +1,68 @@
+/*!
+ * \file
+ * \brief     Cercall library details - token bucket rate limiter
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_DETAILS_TOKENBUCKET_H
+#define CERCALL_DETAILS_TOKENBUCKET_H
+
+#include <algorithm>
+#include <chrono>
+
+namespace cercall {
+namespace details {
+
+/**
+ * A token bucket limiting the rate of the calls of one client. The rate and the capacity are passed
+ * to each take(), so the bucket holds only its own state and the service keeps one configuration for all clients.
+ * The bucket is refilled lazily, when a token is taken.
+ */
+class TokenBucket
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit TokenBucket(double capacity = 1.0) : myTokens(std::max(capacity, 1.0)), myRefillTime(Clock::now()) {}
+
+    /**
+     * Take a token for a call.
+     * @param rate the tokens added per second
+     * @param capacity the maximum number of tokens, at least 1 token is kept
+     * @return false if the bucket is empty
+     */
+    bool take(double rate, double capacity, Clock::time_point now = Clock::now())
+    {
+        std::chrono::duration<double> elapsed = now - myRefillTime;
+        myRefillTime = now;
+        myTokens = std::min(std::max(capacity, 1.0), myTokens + elapsed.count() * rate);
+        if (myTokens < 1.0) {
+            return false;
+        }
+        myTokens -= 1.0;
+        return true;
+    }
+
+private:
+    double myTokens;
+    Clock::time_point myRefillTime;
+};
+
+}   //namespace details
+}   //namespace cercall
+
+#endif // CERCALL_DETAILS_TOKENBUCKET_H
@@ -0,0 +1,143 @@
+/*!
+ * \file
+ * \brief     Cercall input stream reading from a DataView
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_DETAILS_VIEWSTREAM_H
+#define CERCALL_DETAILS_VIEWSTREAM_H
+
+#include <istream>
+#include <streambuf>
+#include "cercall/dataview.h"
+
+namespace cercall {
+namespace details {
+
+/**
+ * A read-only stream buffer over a DataView, or over the chunks of a MessageView.
+ * Archives read directly from the viewed memory, the data is not copied.
+ */
+class ViewStreamBuf : public std::streambuf
+{
+public:
+    void reset(DataView view)
+    {
+        reset(MessageView(view));
+    }
+
+    void reset(const MessageView& msg)
+    {
+        myMessage = msg;
+        myChunkStart = 0;
+        set_chunk(0);
+    }
+
+protected:
+    /** Continue with the next chunk. */
+    int_type underflow() override
+    {
+        while (gptr() == egptr()) {
+            if (myChunkIndex + 1 >= myMessage.chunk_count()) {
+                return traits_type::eof();
+            }
+            myChunkStart += egptr() - eback();
+            set_chunk(myChunkIndex + 1);
+        }
+        return traits_type::to_int_type(*gptr());
+    }
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+    {
+        if ( !(which & std::ios_base::in)) {
+            return pos_type(off_type(-1));
+        }
+        off_type base = 0;
+        if (dir == std::ios_base::cur) {
+            base = myChunkStart + (gptr() - eback());
+        } else if (dir == std::ios_base::end) {
+            base = static_cast<off_type>(myMessage.size());
+        }
+        const off_type pos = base + off;
+        if (pos < 0 || pos > static_cast<off_type>(myMessage.size())) {
+            return pos_type(off_type(-1));
+        }
+        //Find the chunk holding the position.
+        myChunkStart = 0;
+        set_chunk(0);
+        while (pos > myChunkStart + (egptr() - eback()) && myChunkIndex + 1 < myMessage.chunk_count()) {
+            myChunkStart += egptr() - eback();
+            set_chunk(myChunkIndex + 1);
+        }
+        setg(eback(), eback() + (pos - myChunkStart), egptr());
+        return pos_type(pos);
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+    {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+
+private:
+    MessageView myMessage { DataView() };
+    std::size_t myChunkIndex = 0;
+    off_type myChunkStart = 0;      ///< the position of the current chunk in the message
+
+    void set_chunk(std::size_t index)
+    {
+        myChunkIndex = index;
+        const DataView& chunk = myMessage.chunks()[index];
+        //The get area is never written to, std::streambuf just lacks a const variant of setg().
+        char* begin = const_cast<char*>(chunk.data());
+        setg(begin, begin, begin + chunk.size());
+    }
+};
+
+/**
+ * An input stream reading from a DataView, a replacement for std::istringstream which
+ * avoids copying the message to the string stream.
+ */
+class ViewIStream : public std::istream
+{
+public:
+    ViewIStream() : std::istream(nullptr)
+    {
+        rdbuf(&myBuf);
+    }
+
+    /** Start reading the view from the beginning, clear the stream state flags. */
+    void reset(DataView view)
+    {
+        myBuf.reset(view);
+        clear();
+    }
+
+    /** Start reading the message chunks from the beginning, clear the stream state flags. */
+    void reset(const MessageView& msg)
+    {
+        myBuf.reset(msg);
+        clear();
+    }
+
+private:
+    ViewStreamBuf myBuf;
+};
+
+}   //namespace details
+}   //namespace cercall
+
+#endif // CERCALL_DETAILS_VIEWSTREAM_H
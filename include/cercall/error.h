@@ -73,6 +73,21 @@ public:
      */
     static const Error& operation_in_progress();
 
+    /**
+     * Create the "function not implemented" error, the service has no function called by the client.
+     */
+    static const Error& function_not_supported();
+
+    /**
+     * Create the "resource temporarily unavailable" error, the service is too busy to run the function now.
+     */
+    static const Error& service_overloaded();
+
+    /**
+     * Create the "quota exceeded" error, the client exceeded its call rate or its calls in progress.
+     */
+    static const Error& quota_exceeded();
+
 private:
     int myNetLibCode;  ///< 0 means no error
     const void *myCategory = nullptr;
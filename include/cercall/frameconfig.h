@@ -0,0 +1,75 @@
+/*!
+ * \file
+ * \brief     Cercall message frame configuration
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_FRAMECONFIG_H
+#define CERCALL_FRAMECONFIG_H
+
+#include <cstdint>
+
+namespace cercall {
+
+/**
+ * @brief The encoding of the message length in the message header.
+ * The fixed width lengths are in the host byte order.
+ */
+enum class FrameFormat
+{
+    FIXED_16,   ///< 2 bytes, for messages shorter than 64 kB
+    FIXED_32,   ///< 4 bytes, the default
+    FIXED_64,   ///< 8 bytes
+    VARINT      ///< 1 byte for messages shorter than 128 bytes, 1 more byte for every 7 bits of the length
+};
+
+/**
+ * @brief The message framing of a connection, both peers must use the same format.
+ */
+struct FrameConfig
+{
+    FrameFormat format = FrameFormat::FIXED_32;
+    /**
+     * The maximum length of a message. A peer announcing a longer message is disconnected before
+     * any memory is allocated for the message, sending a longer message throws std::length_error.
+     */
+    std::uint64_t maxMessageSize = 64u * 1024u * 1024u;
+    /**
+     * The maximum length of a chunk on the wire, 0 disables chunking.
+     * Longer messages are sent in chunks, which the receiver keeps until the last one arrives,
+     * so the input buffer of the transport does not grow to the message length. The receiver copies
+     * the chunks into blocks of 64 kB, the chunks of the incomplete messages of both lanes together
+     * are limited by maxMessageSize. The message itself is still held whole by both ends: the sender
+     * serializes it before splitting it, the receiver deserializes it after the last chunk.
+     * The chunks of longer messages travel in the bulk lane, shorter messages in the urgent lane,
+     * the lanes are interleaved, so a message of one lane may overtake a message of the other one.
+     * The message header then carries the flags of a following chunk and of the lane, which leaves
+     * a quarter of the range of the fixed width formats for the chunk length.
+     */
+    std::uint32_t chunkSize = 0;
+    /**
+     * The number of chunks of bulk messages passed to the transport at once. The next chunks follow
+     * when the transport notifies that they have been written, so an urgent message waits behind at most
+     * this many chunks, whatever the watermarks of the transport. 0 passes the bulk chunks until
+     * the write queue of the transport is high. Applies to transports supporting Transport::post().
+     */
+    std::uint32_t bulkChunksInFlight = 4;
+};
+
+}   //namespace cercall
+
+#endif // CERCALL_FRAMECONFIG_H
@@ -0,0 +1,70 @@
+/*!
+ * \file
+ * \brief     Cercall local call target interface
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_LOCALCALLTARGET_H
+#define CERCALL_LOCALCALLTARGET_H
+
+#include <memory>
+#include <typeinfo>
+#include "cercall/cercall.h"
+
+namespace cercall {
+
+/**
+ * @brief Interface of a service, whose functions can be called directly by clients living in the same process.
+ * @see Client::bind_local()
+ * @ingroup cercall
+ */
+class LocalCallTarget
+{
+public:
+    virtual ~LocalCallTarget() {}
+
+    /**
+     * A service function, which is called with the arguments in the passed argument tuple.
+     * It is a plain function pointer with the service object, so it can be cached and copied freely.
+     */
+    struct LocalFunction
+    {
+        void (*call)(void* service, const std::shared_ptr<void>& args) = nullptr;
+        void* service = nullptr;    ///< the service object, passed to call
+
+        explicit operator bool() const  {   return call != nullptr; }
+
+        void operator()(const std::shared_ptr<void>& args) const
+        {
+            call(service, args);
+        }
+    };
+
+    /**
+     * @brief Find a service function for a direct call.
+     * @param funcId the id of the function, the hash of its full name
+     * @param argsType the type of the argument tuple - std::tuple of the decayed function parameter types,
+     *        including the Closure parameter of functions which are not one-way
+     * @return the function, which moves the arguments from the tuple to the service function,
+     *         empty if the service has no function of the name and argument types
+     */
+    virtual LocalFunction find_local_function(FunctionId funcId, const std::type_info& argsType) = 0;
+};
+
+}   //namespace cercall
+
+#endif // CERCALL_LOCALCALLTARGET_H
@@ -22,15 +22,21 @@
 #define CERCALL_SERVICE_H
 
 #include <unordered_map>
-#include <deque>
 #include <vector>
 #include <thread>
+#include <mutex>
 #include "cercall/transport.h"
 #include "cercall/acceptor.h"
+#include "cercall/admissionconfig.h"
+#include "cercall/frameconfig.h"
+#include "cercall/localcalltarget.h"
+#include "cercall/workerpool.h"
 #include "cercall/details/functiondict.h"
 #include "cercall/details/messenger.h"
 #include "cercall/details/cpputil.h"
 #include "cercall/details/eventhelper.h"
+#include "cercall/details/lagshedder.h"
+#include "cercall/details/tokenbucket.h"
 #include "cercall/log.h"
 
 /**
@@ -45,10 +51,24 @@
  *
  * @note Overloading of interface member functions is currently not supported, so the added
  * member functions must have unique names - each member function must be added once.
+ * @note The functions are added to a dispatch table shared by all instances of the class whose
+ * constructor adds them, so every instance of the class must add the same functions.
  */
 #define O_ADD_SERVICE_FUNCTIONS_OF(Interface, oneway, ...)  {                                 \
-    std::deque<const char*> funcNames = { CERCALL_APPLY(CERCALL_STRINGIZE, 0, __VA_ARGS__) };       \
-    this->template add_functions<oneway>(funcNames, CERCALL_APPLY(CERCALL_MAKE_MEMFUN, Interface, __VA_ARGS__));   \
+    this->template add_functions<oneway, false, typename std::remove_pointer<decltype(this)>::type>(\
+        CERCALL_APPLY(CERCALL_MAKE_MEMFUN, Interface, __VA_ARGS__));                            \
+    }
+
+/**
+ * @ingroup Cercall
+ * @brief A macro for adding service functions which run on the worker pool of the service,
+ * @see cercall::Service::set_worker_pool(). The parameters are the same as of O_ADD_SERVICE_FUNCTIONS_OF.
+ * The arguments are deserialized in the transport thread, the function is called by a worker thread,
+ * and the result passed to the closure is sent back through the transport event loop.
+ */
+#define O_ADD_OFFLOADED_SERVICE_FUNCTIONS_OF(Interface, oneway, ...)  {                       \
+    this->template add_functions<oneway, true, typename std::remove_pointer<decltype(this)>::type>( \
+        CERCALL_APPLY(CERCALL_MAKE_MEMFUN, Interface, __VA_ARGS__));                            \
     }
 
 namespace cercall {
@@ -58,7 +78,7 @@ namespace cercall {
  * @brief A template class for implementing Cercall services.
  */
 template<class ServiceInterface, class Serialization = ServiceInterface>
-class Service : public ServiceInterface, protected Transport::Listener,
+class Service : public ServiceInterface, public LocalCallTarget, protected Transport::Listener,
                 protected Acceptor::Listener
 {
 public:
@@ -70,18 +90,30 @@ public:
     /**
      * @brief Service constructor
      * @param ac - pointer to an acceptor object, the service takes ownership of this acceptor object
+     * @param multiThreaded - when true, the service may be driven by an event loop run by multiple threads;
+     *        the calls of each client are serialized, the calls of different clients run concurrently.
+     *        Service function closures may be called from any thread, the results are passed to
+     *        the client's execution context. stop() must not run concurrently with the event loop threads.
      */
-    Service(std::unique_ptr<Acceptor> ac) : myAcceptor(std::move(ac))
+    Service(std::unique_ptr<Acceptor> ac, bool multiThreaded = false)
+        : myAcceptor(std::move(ac)), myMultiThreaded(multiThreaded)
     {
         o_assert (myAcceptor.get() != nullptr);
 #ifdef O_ENSURE_SINGLE_THREAD
         myThreadId = std::this_thread::get_id();
 #endif
+        if (myMultiThreaded && !myAcceptor->enable_multi_threading()) {
+            throw std::logic_error("cercall::Service: the acceptor does not support multi-threading");
+        }
         myAcceptor->set_listener(*this);
     }
     virtual ~Service()
     {
         stop();
+        //A transport kept by a pending call closure must not refer to the destroyed client state.
+        for (auto& cl : myClients) {
+            cl->myTransport->clear_listener();
+        }
     }
 
     /**
@@ -92,6 +124,8 @@ public:
     {
         check_thread_id("cercall::Service::start");
         if ( !myAcceptor->is_open()) {
+            myFuncDict->seal();
+            myFunctionTableMsg = Serialization::serialize_function_table(nullptr, get_function_table());
             myAcceptor->open(maxPendingClientConnections);
         }
     }
@@ -105,12 +139,105 @@ public:
         check_thread_id("cercall::Service::stop");
         if (myAcceptor != nullptr && myAcceptor->is_open()) {
             myAcceptor->close();
-            while (myClients.size() > 0) {
-                myClients.begin()->second.myTransport->close();
+            for (const std::shared_ptr<Transport>& client : get_clients()) {
+                client->close();
+            }
+            if (myEventChannel != nullptr) {
+                myEventChannel->close();
             }
         }
     }
 
+    /**
+     * @brief Set the message framing of the client connections, @see FrameConfig.
+     * The clients must use the same frame format. The function must be called before start().
+     */
+    void set_frame_config(const FrameConfig& config)
+    {
+        check_thread_id("cercall::Service::set_frame_config");
+        if (myAcceptor->is_open()) {
+            throw std::logic_error("cercall::Service::set_frame_config: the service is already started");
+        }
+        myFrameConfig = config;
+    }
+
+    /**
+     * @brief Set the limits of the calls of the clients, @see AdmissionConfig.
+     * The function must be called before start().
+     */
+    void set_admission_config(const AdmissionConfig& config)
+    {
+        check_thread_id("cercall::Service::set_admission_config");
+        if (myAcceptor->is_open()) {
+            throw std::logic_error("cercall::Service::set_admission_config: the service is already started");
+        }
+        myAdmissionConfig = config;
+        myLagShedder = details::LagShedder(config.lagTarget, config.lagInterval);
+        myLagProbe = myLagShedder.is_enabled() ? std::make_shared<details::LagProbe>(config.lagInterval) : nullptr;
+    }
+
+    /**
+     * @brief Publish the events through a channel instead of writing them to each client.
+     * Each event is serialized and written once, e.g. to a multicast group with MulticastPublisher,
+     * the clients receive it through their own event channel, see Client::open_event_channel().
+     * The service opens the channel if needed and closes it when it stops.
+     * @param channel the event channel, nullptr to write the events to each client again
+     */
+    void set_event_channel(std::shared_ptr<Transport> channel)
+    {
+        check_thread_id("cercall::Service::set_event_channel");
+        if (myMultiThreaded && channel != nullptr) {
+            throw std::logic_error("cercall::Service::set_event_channel: not supported by a multi-threaded service");
+        }
+        if (channel != nullptr && !channel->is_open() && !channel->open()) {
+            throw std::runtime_error("cercall::Service::set_event_channel: can't open the event channel");
+        }
+        myEventChannel = std::move(channel);
+    }
+
+    /**
+     * @brief Set the worker pool running the functions added with O_ADD_OFFLOADED_SERVICE_FUNCTIONS_OF.
+     * Without a pool these functions run in the transport thread like the other ones, so do the calls
+     * of the clients whose transport doesn't support Transport::post().
+     * When the pool has too many queued calls, the client receives Error::service_overloaded().
+     * The offloaded functions may run concurrently with each other and with the other service functions.
+     * @param pool the worker pool, nullptr to run the functions in the transport thread again.
+     * The pool is not owned by the service: stop the service and destroy the pool before the service.
+     */
+    void set_worker_pool(WorkerPool* pool)
+    {
+        check_thread_id("cercall::Service::set_worker_pool");
+        myWorkerPool = pool;
+    }
+
+    /**
+     * @brief Get the hash of the service interface, which the clients receive when they connect,
+     * @see Client::get_interface_hash(). The hash covers the names and the signatures of the service functions.
+     */
+    std::uint32_t get_interface_hash() const
+    {
+        return get_function_table().hash();
+    }
+
+    /**
+     * @brief Get the memory the service keeps for each client connection, besides the transport and
+     * the serialization archives, which are created by the first message of the client.
+     */
+    static constexpr std::size_t get_client_state_size()
+    {
+        return sizeof(ClientState) + sizeof(std::unique_ptr<ClientState>);
+    }
+
+    /**
+     * @brief Find a service function for a direct call of a client bound with Client::bind_local().
+     * The call bypasses the per-client bookkeeping of pending calls, the closure passed to the function
+     * has no client transport.
+     */
+    LocalFunction find_local_function(FunctionId funcId, const std::type_info& argsType) override
+    {
+        return myFuncDict->find_direct_function(funcId, *this, argsType);
+    }
+
     /**
      * @brief Broadcast a polymorphic event to each connected client.
      * Event types must be serializable.
@@ -155,27 +282,33 @@ public:
 
 protected:
 
-    template<bool OneWay, typename HeadFunc, typename ...Funcs>
-    void add_functions(std::deque<const char*>& funcNames, HeadFunc hFunc, Funcs... tailFuncs)
+    /**
+     * Add the functions to the dispatch table of the implementation class Impl.
+     * @see O_ADD_SERVICE_FUNCTIONS_OF, which passes the class whose constructor adds the functions.
+     */
+    template<bool OneWay, bool Offloaded = false, class Impl = Service, typename HeadFunc, typename ...Funcs>
+    void add_functions(HeadFunc hFunc, Funcs... tailFuncs)
     {
         check_thread_id("cercall::Service::add_functions");
-        add_function<OneWay>(std::string(funcNames.front()), hFunc);
-        funcNames.pop_front();
-        add_functions<OneWay>(funcNames, tailFuncs...);
+        use_function_dictionary<Impl>();
+        add_function<OneWay, Offloaded>(hFunc);
+        add_functions<OneWay, Offloaded, Impl>(tailFuncs...);
     }
 
-    template<bool OneWay, typename MemF>
-    void add_functions(std::deque<const char *> &funcNames, MemF func)
+    template<bool OneWay, bool Offloaded = false, class Impl = Service, typename MemF>
+    void add_functions(MemF func)
     {
         check_thread_id("cercall::Service::add_functions");
-        add_function<OneWay>(std::string(funcNames.front()), func);
+        use_function_dictionary<Impl>();
+        add_function<OneWay, Offloaded>(func);
     }
 
     std::vector<std::shared_ptr<Transport>> get_clients()
     {
+        auto lock = lock_clients();
         decltype(get_clients()) result;
         for (auto& cl: myClients) {
-            result.push_back(cl.second.myTransport);
+            result.push_back(cl->myTransport);
         }
         return result;
     }
@@ -187,56 +320,208 @@ private:
     /// @brief The function dictionary.
     using FunctionDictionary = details::FunctionDict<InterfaceType, Serialization>;
 
-    const std::string bcastFuncName = std::string(details::TypeProperties<InterfaceType>::name) + "::broadcast_event";
+    const FunctionId bcastFuncId = details::function_id(details::TypeProperties<InterfaceType>::name, "broadcast_event");
 
     struct Archives
     {
         using S = Serialization;
-        std::unique_ptr<typename S::OutputArchive> outArch;
+        std::shared_ptr<typename S::OutputArchive> outArch;     ///< shared with the closures of the pending calls
         std::unique_ptr<typename S::InputArchive> inArch;
 
+        /** @param reuse false if the messages may be reordered, as a reused archive depends on the messages before */
         template<typename S = Serialization, typename std::enable_if<S::REUSABLE_ARCHIVE>::type* = nullptr>
-        Archives() : outArch { Serialization::create_output_archive() },
-                     inArch  { Serialization::create_input_archive() } {}
+        explicit Archives(bool reuse) : outArch { reuse ? Serialization::create_output_archive() : nullptr },
+                                        inArch  { reuse ? Serialization::create_input_archive() : nullptr } {}
 
         template<typename S = Serialization, typename std::enable_if< !S::REUSABLE_ARCHIVE>::type* = nullptr>
-        Archives() {}
+        explicit Archives(bool) {}
     };
 
+    /**
+     * The state of a client connection, attached to its transport with Transport::set_listener_data().
+     * Memory budget of an idle connection on a 64-bit platform: this structure and a pointer in myClients,
+     * at most 320 bytes, most of it the messenger, @see get_client_state_size(); none of the empty containers
+     * allocates, the transport itself is not included. The archives (about 1 KB with their streams) are created
+     * by the first message.
+     */
     struct ClientState
     {
-        ClientState(const std::shared_ptr<Transport>& t, const details::Messenger& r)
-            : myTransport(t), myMessenger(r) {}
+        ClientState(const std::shared_ptr<Transport>& t, const details::Messenger& r, double callBurst)
+            : myTransport(t), myMessenger(r), myCallTokens(callBurst) {}
         std::shared_ptr<Transport> myTransport { nullptr };
         details::Messenger myMessenger;
-        Archives myArchives;
+        std::unique_ptr<Archives> myArchives;
+        std::unordered_map<CallId, FunctionId> myPendingCalls;     ///< functions of the calls in progress
+        details::TokenBucket myCallTokens;      ///< limits the call rate, @see AdmissionConfig
+        std::size_t myIndex = 0;    ///< the position in myClients
+        unsigned myUseCount = 0;    ///< @see ClientStateUse
+        bool myRemoved = false;     ///< removed from myClients while in use, deleted by the last ClientStateUse
+
+        Archives& get_archives()
+        {
+            if ( !myArchives) {
+                myArchives.reset(new Archives(myMessenger.keeps_message_order()));
+            }
+            return *myArchives;
+        }
 
         typename Serialization::OutputArchive* get_output_archive()
         {
-            return myArchives.outArch.get();
+            return get_archives().outArch.get();
         }
 
         typename Serialization::InputArchive* get_input_archive()
         {
-            return myArchives.inArch.get();
+            return get_archives().inArch.get();
         }
     };
 
-    FunctionDictionary myFuncDict;
-
-    using PendingCallsMap = std::unordered_multimap<std::string, Transport*>;
+    FunctionDictionary* myFuncDict = &shared_function_dictionary<Service>();
 
     std::unique_ptr<Acceptor> myAcceptor;
-    std::map<Transport*, ClientState> myClients;
-    PendingCallsMap myPendingCalls;
+    std::vector<std::unique_ptr<ClientState>> myClients;
+    std::string myFunctionTableMsg;     ///< the first message to every client connection
+    std::shared_ptr<Transport> myEventChannel;
+    WorkerPool* myWorkerPool = nullptr;
+    FrameConfig myFrameConfig;
+    AdmissionConfig myAdmissionConfig;
+    details::LagShedder myLagShedder;       ///< guarded by myClientsMutex in multi-threaded mode
+    std::shared_ptr<details::LagProbe> myLagProbe;      ///< shared with the pending probe, if the lag is measured
+    /// the calls in progress of each function, counted when AdmissionConfig::maxPendingCallsPerFunction is set
+    std::unordered_map<FunctionId, std::size_t> myPendingCallsOfFunction;
+    const bool myMultiThreaded;
+    std::mutex myClientsMutex;      ///< guards myClients and their pending calls in multi-threaded mode
 #ifdef O_ENSURE_SINGLE_THREAD
     std::thread::id myThreadId;
 #endif
 
+    /** @return a lock of myClients and their pending calls, which is not locked in single-threaded mode */
+    std::unique_lock<std::mutex> lock_clients()
+    {
+        return myMultiThreaded ? std::unique_lock<std::mutex>(myClientsMutex) : std::unique_lock<std::mutex>();
+    }
+
+    ClientState& find_client_state(Transport& client)
+    {
+        ClientState* cs = get_client_state(client);
+        o_assert(cs != nullptr);
+        return *cs;
+    }
+
+    /** @return the state of the client, or nullptr if the client is disconnected */
+    ClientState* get_client_state(Transport& client)
+    {
+        auto lock = lock_clients();
+        return static_cast<ClientState*>(client.get_listener_data());
+    }
+
+    /** Remove the client from myClients, the last client takes its position. Called with the clients locked. */
+    void remove_client(ClientState& cs)
+    {
+        const std::size_t index = cs.myIndex;
+        o_assert(index < myClients.size() && myClients[index].get() == &cs);
+        std::unique_ptr<ClientState> removed = std::move(myClients[index]);
+        if (index + 1 < myClients.size()) {
+            myClients[index] = std::move(myClients.back());
+            myClients[index]->myIndex = index;
+        }
+        myClients.pop_back();
+        if (removed->myUseCount > 0) {
+            removed->myRemoved = true;
+            removed.release();      //deleted by the last ClientStateUse
+        }
+    }
+
+    /**
+     * Keeps the state of a client alive while its messenger is used: a write error closes the transport,
+     * which removes the client before the messenger returns. The state of a client is used only
+     * in the execution context of its transport.
+     */
+    class ClientStateUse
+    {
+    public:
+        explicit ClientStateUse(ClientState& cs) : myState(cs)
+        {
+            ++myState.myUseCount;
+        }
+
+        ~ClientStateUse()
+        {
+            if (--myState.myUseCount == 0 && myState.myRemoved) {
+                delete &myState;
+            }
+        }
+
+        ClientStateUse(const ClientStateUse&) = delete;
+        ClientStateUse& operator=(const ClientStateUse&) = delete;
+
+    private:
+        ClientState& myState;
+    };
+
+    /** @return true if the call must be shed */
+    bool is_lagging()
+    {
+        details::LagShedder::Clock::time_point now = details::LagShedder::Clock::now();
+        details::LagShedder::Clock::duration lag = myLagProbe->lag(now);
+        auto lock = lock_clients();
+        return myLagShedder.shed(now - lag, now);
+    }
+
+    /** @return false if the client exceeded its call rate */
+    bool take_call_token(ClientState& cs)
+    {
+        const AdmissionConfig& cfg = myAdmissionConfig;
+        return cfg.callsPerSecond <= 0.0 || cs.myCallTokens.take(cfg.callsPerSecond, cfg.callBurst);
+    }
+
+    /**
+     * Add a call in progress of the client. Called with the clients locked.
+     * @return false if the call exceeds the limits of the pending calls
+     */
+    bool add_pending_call(ClientState& cs, CallId callId, FunctionId funcId)
+    {
+        const AdmissionConfig& cfg = myAdmissionConfig;
+        if (cfg.maxPendingCallsPerClient != 0 && cs.myPendingCalls.size() >= cfg.maxPendingCallsPerClient) {
+            return false;
+        }
+        if (cfg.maxPendingCallsPerFunction != 0) {
+            std::size_t& count = myPendingCallsOfFunction[funcId];
+            if (count >= cfg.maxPendingCallsPerFunction) {
+                return false;
+            }
+            ++count;
+        }
+        cs.myPendingCalls.emplace(callId, funcId);
+        return true;
+    }
+
+    /**
+     * Remove a call in progress of the client. Called with the clients locked.
+     * @return false if the client has no such call in progress
+     */
+    bool erase_pending_call(ClientState& cs, CallId callId)
+    {
+        auto it = cs.myPendingCalls.find(callId);
+        if (it == cs.myPendingCalls.end()) {
+            return false;
+        }
+        release_function_quota(it->second);
+        cs.myPendingCalls.erase(it);
+        return true;
+    }
+
+    void release_function_quota(FunctionId funcId)
+    {
+        if (myAdmissionConfig.maxPendingCallsPerFunction != 0) {
+            --myPendingCallsOfFunction[funcId];
+        }
+    }
+
     void check_thread_id(const std::string& errorMsg)
     {
 #ifdef O_ENSURE_SINGLE_THREAD
-        if (std::this_thread::get_id() != myThreadId) {
+        if ( !myMultiThreaded && std::this_thread::get_id() != myThreadId) {
             throw std::logic_error(errorMsg + ": call from a foreign thread not supported");
         }
 #else
@@ -249,34 +534,92 @@ private:
         return std::string(details::TypeProperties<InterfaceType>::name) + "::" + shortFuncName;
     }
 
-    template<bool OneWay, typename SI, typename ...Args>
-    void add_function(const std::string& functionName, void (SI::*function)(Args...))
+    template<bool OneWay, bool Offloaded, typename SI, typename ...Args, void (SI::*function)(Args...)>
+    void add_function(details::MemberFunction<void (SI::*)(Args...), function> func)
     {
         static_assert(std::is_base_of<SI, Service<ServiceInterface, Serialization>>::value,
                       "Invalid 1st argument to O_ADD_SERVICE_FUNCTIONS_OF");
-        myFuncDict.template add_function<OneWay>(make_fully_qualified_name(functionName), function);
+        std::string qualifiedName = make_fully_qualified_name(func.name);
+        if (details::function_id(qualifiedName.c_str()) == bcastFuncId) {
+            throw std::logic_error("cercall::Service::add_function: the id of " + qualifiedName
+                                   + " collides with the events");
+        }
+        myFuncDict->template add_function<OneWay, void (SI::*)(Args...), function, Offloaded>(qualifiedName);
+    }
+
+    /**
+     * @return the dispatch table shared by all instances of the implementation class Impl. Each class
+     * has its own table, so classes implementing the same interface may add different functions.
+     */
+    template<class Impl>
+    static FunctionDictionary& shared_function_dictionary()
+    {
+        static FunctionDictionary dict;
+        return dict;
+    }
+
+    /**
+     * Switch to the dispatch table of the class Impl. The table keeps the functions added by the constructors
+     * of the base classes of Impl, which used the table of their own class.
+     */
+    template<class Impl>
+    void use_function_dictionary()
+    {
+        static_assert(std::is_base_of<Service, Impl>::value, "the functions must be added by a service class");
+        FunctionDictionary* dict = &shared_function_dictionary<Impl>();
+        if (myFuncDict != dict) {
+            dict->add_entries(*myFuncDict);
+            myFuncDict = dict;
+        }
+    }
+
+    details::FunctionTable get_function_table() const
+    {
+        return myFuncDict->get_function_table(details::TypeProperties<InterfaceType>::name);
+    }
+
+    /** @return the name of the function for the log messages */
+    const char* get_function_name(FunctionId funcId) const
+    {
+        const std::string* name = myFuncDict->get_name(funcId);
+        return (name != nullptr) ? name->c_str() : "unknown function";
     }
 
     void on_client_accepted(std::shared_ptr<Transport> clientTrans) override
     {
-        auto messageHandler = [this] (Transport& cl, const std::string& msg) {
-            auto found = myClients.find(&cl);
-            o_assert(found != myClients.end());
-            ClientState& cs = found->second;
+        auto messageHandler = [this] (Transport& cl, const MessageView& msg) {
+            ClientState& cs = find_client_state(cl);
             Serialization::deserialize_call(cs.get_input_archive(),  msg,
-                                            [this, &cs](const std::string& funcName, ArgsArchive& arArgs) {
-                dispatch_func(cs, funcName, arArgs);
+                                            [this, &cs](FunctionId funcId, CallId callId,
+                                                                        ArgsArchive& arArgs) {
+                dispatch_func(cs, funcId, callId, arArgs);
             });
         };
+        if (clientTrans->get_listener_data() != nullptr) {
+            throw std::runtime_error("cercall::Service::on_client_accepted: client already added");
+        }
+        details::Messenger::check_transport(*clientTrans, myFrameConfig);
         clientTrans->set_listener(*this);
-        ClientState cs { clientTrans, details::Messenger(messageHandler) };
-        auto retval = myClients.emplace(std::make_pair(clientTrans.get(), std::move(cs)));
-        if (retval.second) {
-            clientTrans->open();        //start receiving messages
-            retval.first->second.myMessenger.init_transport(*clientTrans);
-        } else {
-            throw std::runtime_error("cercall::Service::on_client_accepted: failed to add client to map");
+        std::unique_ptr<ClientState> cs { new ClientState { clientTrans,
+                                                            details::Messenger(messageHandler, myFrameConfig),
+                                                            myAdmissionConfig.callBurst } };
+        ClientState& state = *cs;
+        ClientStateUse use(state);      //a failed write of the function table removes the client
+        {
+            auto lock = lock_clients();
+            cs->myIndex = myClients.size();
+            clientTrans->set_listener_data(cs.get());
+            myClients.push_back(std::move(cs));
+        }
+        clientTrans->open();
+        if (clientTrans->is_reliable()) {
+            //The function table is written before any message is received, so it precedes all results.
+            Error err = details::Messenger::write_message(*clientTrans, myFunctionTableMsg, myFrameConfig);
+            if (err) {
+                log<error>(O_LOG_TOKEN, "can't send the function table - %s", err.message().c_str());
+            }
         }
+        state.myMessenger.init_transport(*clientTrans);     //start receiving messages
     }
 
     void on_accept_error(const Error& e) override
@@ -288,9 +631,51 @@ private:
     std::size_t on_incoming_data(Transport& client, std::size_t dataLenInBuffer) override
     {
         check_thread_id("cercall::Service::on_incoming_data");
-        auto clStateIt = myClients.find(&client);
-        o_assert(clStateIt != myClients.end());
-        return clStateIt->second.myMessenger.read(client, dataLenInBuffer);
+        ClientState& cs = find_client_state(client);
+        ClientStateUse use(cs);
+        if (myLagProbe != nullptr && client.can_post() && myLagProbe->start()) {
+            //The probe waits behind the handlers already queued in the event loop.
+            std::shared_ptr<details::LagProbe> probe = myLagProbe;
+            client.post([probe]() {
+                probe->complete();
+            });
+        }
+        return cs.myMessenger.read(client, dataLenInBuffer);
+    }
+
+    /**
+     * Stop passing the bulk messages to the client transport.
+     * Service implementation classes overriding it for backpressure must call this function.
+     */
+    void on_write_queue_high(Transport& client, std::size_t) override
+    {
+        ClientState* cs = get_client_state(client);
+        if (cs != nullptr) {
+            cs->myMessenger.on_write_queue_high();
+        }
+    }
+
+    /**
+     * Continue passing the bulk messages to the client transport.
+     * Service implementation classes overriding it for backpressure must call this function.
+     */
+    void on_write_queue_low(Transport& client, std::size_t) override
+    {
+        ClientState* cs = get_client_state(client);
+        if (cs != nullptr) {
+            ClientStateUse use(*cs);
+            cs->myMessenger.on_write_queue_low(client);
+        }
+    }
+
+    /** Pass the next chunks of the bulk messages to the client transport. */
+    void on_write_ready(Transport& client) override
+    {
+        ClientState* cs = get_client_state(client);
+        if (cs != nullptr) {
+            ClientStateUse use(*cs);
+            cs->myMessenger.on_write_ready(client);
+        }
     }
 
     /* The default implementation does nothing. Service implementation classes can override it if they need it.  */
@@ -301,105 +686,189 @@ private:
     void on_disconnected(Transport& client) override
     {
         check_thread_id("cercall::Service::on_disconnected");
+        auto lock = lock_clients();
+        ClientState* cs = static_cast<ClientState*>(client.get_listener_data());
         client.clear_listener();
-        myClients.erase(&client);
-        for (const auto& call : myPendingCalls) {
-            if (call.second == &client && call.first.length() != 0) {
-                log<error>(O_LOG_TOKEN, "warning - cercall::Service::on_disconnected: client disconnected"
-                                        "while call %s is pending", call.first.c_str());
-            }
+        if (cs == nullptr) {
+            return;
+        }
+        for (const auto& pendingCall : cs->myPendingCalls) {
+            log<error>(O_LOG_TOKEN, "warning - cercall::Service::on_disconnected: client disconnected "
+                                    "while call %s is pending", get_function_name(pendingCall.second));
+            release_function_quota(pendingCall.second);
         }
+        remove_client(*cs);
     }
 
+    /**
+     * The event is serialized once, the message is shared by the clients.
+     */
     template<typename T>
-    void broadcast(T&& ev)
+    void broadcast(const T& ev)
     {
         check_thread_id("cercall::Service::broadcast");
-        if ( !myClients.empty()) {
-            for (auto& client : myClients) {
-                ClientState& cs = client.second;
-                std::string msg { Serialization::template serialize_event<T>(cs.get_output_archive(), bcastFuncName,
-                                                                             std::forward<T>(ev)) };
-                details::Messenger::write_message_with_header(*client.second.myTransport, msg);
+        if (myEventChannel == nullptr && !myMultiThreaded && myClients.empty()) {
+            return;
+        }
+        std::shared_ptr<const std::string> msg =
+                std::make_shared<const std::string>(Serialization::template serialize_event<T>(bcastFuncId, ev));
+        if (myEventChannel != nullptr) {
+            Error err = details::Messenger::write_message(*myEventChannel, *msg, myFrameConfig);
+            if (err) {
+                log<error>(O_LOG_TOKEN, "can't publish event - %s", err.message().c_str());
+            }
+        } else if (myMultiThreaded) {
+            broadcast_concurrently(msg);
+        } else {
+            //A write error removes the client, the last client takes its position then. The clients are
+            //visited from the last one, so the moved client has already received the message.
+            for (std::size_t i = myClients.size(); i-- > 0; ) {
+                if (i < myClients.size()) {
+                    ClientState& cs = *myClients[i];
+                    ClientStateUse use(cs);
+                    cs.myMessenger.send(*cs.myTransport, msg);
+                }
             }
         }
     }
 
-    PendingCallsMap::const_iterator find_pending_call(const std::string& funcName, const Transport* client)
+    /**
+     * Send the event message to each client in its transport context.
+     */
+    void broadcast_concurrently(const std::shared_ptr<const std::string>& msg)
     {
-        auto range = myPendingCalls.equal_range(funcName);
-        for (auto it = range.first; it != range.second; ++it) {
-            if (it->second == client) {
-                return it;
-            }
+        for (const std::shared_ptr<Transport>& clientTr : get_clients()) {
+            clientTr->dispatch([this, clientTr, msg]() {
+                ClientState* cs = get_client_state(*clientTr);
+                if (cs == nullptr) {
+                    return;     //disconnected in the meantime
+                }
+                ClientStateUse use(*cs);
+                cs->myMessenger.send(*cs->myTransport, msg);
+            });
         }
-        return myPendingCalls.end();
     }
 
-    void dispatch_func(ClientState& cs, const std::string& funcName, ArgsArchive& args)
+    void dispatch_func(ClientState& cs, FunctionId funcId, CallId callId, ArgsArchive& args)
     {
-        bool isOneWay = myFuncDict.is_one_way(funcName);
         Transport& client = *cs.myTransport;
-        bool isPreviousCallPending;
+        const typename FunctionDictionary::Entry* func = myFuncDict->find(funcId);
+        if (func == nullptr) {
+            log<error>(O_LOG_TOKEN, "warning - cercall::Service::dispatch_func: no function of id %u", funcId);
+            if (callId != 0) {      //one-way calls have no call id and no result
+                //The result type is unknown, a result of another type would desynchronize the reusable archives.
+                std::string resMsg = Serialization::serialize_call(cs.get_output_archive(), details::noFunctionId,
+                                                                   callId);
+                cs.myMessenger.send(client, std::move(resMsg));
+            }
+            return;
+        }
+        bool isOneWay = func->oneWay;
+        if ( !isOneWay && myLagProbe != nullptr && is_lagging()) {
+            log<error>(O_LOG_TOKEN, "warning - cercall::Service::dispatch_func: overloaded, call of %s is shed",
+                       get_function_name(funcId));
+            std::string resMsg = func->serializeError(cs.get_output_archive(), funcId, callId,
+                                                      Error::service_overloaded());
+            cs.myMessenger.send(client, std::move(resMsg));
+            return;
+        }
+        bool isPreviousCallPending = false;
 
         if ( !isOneWay) {
-            //The same call is pending for this client - not allowed.
-            isPreviousCallPending = find_pending_call(funcName, &client) != myPendingCalls.end();
-        } else {
-            isPreviousCallPending = false;
+            //A pending call with the same id from this client - not allowed.
+            auto lock = lock_clients();
+            isPreviousCallPending = cs.myPendingCalls.count(callId) != 0;
         }
         if (isPreviousCallPending) {
-            const Error& err = Error::operation_in_progress();
-            //Return error to the client, previous call is not finished yet.
-            Result<void> res(err);
-            std::string resMsg = Serialization::template serialize_call_result<void>(cs.get_output_archive(), funcName, res);
-            details::Messenger::write_message_with_header(client, resMsg);
+            //Return error to the client, previous call is not finished yet. The call doesn't take a token.
+            std::string resMsg = func->serializeError(cs.get_output_archive(), funcId, callId,
+                                                      Error::operation_in_progress());
+            cs.myMessenger.send(client, std::move(resMsg));
             return;
         }
-        if ( !isOneWay) {
-            myPendingCalls.emplace(funcName, &client);
+        //The admission is checked before the arguments are deserialized.
+        bool isOverQuota = !take_call_token(cs);
+        if ( !isOneWay && !isOverQuota) {
+            auto lock = lock_clients();
+            isOverQuota = !add_pending_call(cs, callId, funcId);
         }
+        if (isOverQuota) {
+            log<error>(O_LOG_TOKEN, "warning - cercall::Service::dispatch_func: call of %s exceeds the quota",
+                       get_function_name(funcId));
+            if ( !isOneWay) {
+                std::string resMsg = func->serializeError(cs.get_output_archive(), funcId, callId,
+                                                          Error::quota_exceeded());
+                cs.myMessenger.send(client, std::move(resMsg));
+            }
+            return;
+        }
+        bool accepted = true;
         try {
             auto clientTr = cs.myTransport;
+            //A worker can hand the result back only to a transport supporting post().
+            WorkerPool* pool = (func->offloaded && client.can_post()) ? myWorkerPool : nullptr;
             if ( !isOneWay) {
-                auto resultHandler = [this, funcName, clientTr] (std::string& resultMsg) {
-                    send_result(clientTr, funcName, resultMsg);
+                typename FunctionDictionary::ResultHandler resultHandler =
+                        [this, funcId, callId, clientTr] (std::string& resultMsg) {
+                    send_result(clientTr, funcId, callId, resultMsg);
                 };
-                myFuncDict.call_function(clientTr, funcName, *this, cs.get_output_archive(), args, resultHandler);
+                accepted = func->call(*this, clientTr, args, cs.get_archives().outArch, funcId, callId, resultHandler,
+                                      pool);
             } else {
-                static auto oneWayResultHandler = [](std::string&) {
+                static const typename FunctionDictionary::ResultHandler oneWayResultHandler = [](std::string&) {
                     o_assert("cercall::Service::dispatch_func: one way result handler was called" == nullptr);
                 };
-                myFuncDict.call_function(clientTr, funcName, *this, cs.get_output_archive(), args, oneWayResultHandler);
+                accepted = func->call(*this, clientTr, args, cs.get_archives().outArch, funcId, callId,
+                                      oneWayResultHandler, pool);
             }
         } catch (const std::exception& e) {
-            std::string msg = "failed to call cercall function " + funcName + ": " + e.what();
+            std::string msg = std::string("failed to call cercall function ") + get_function_name(funcId) + ": "
+                              + e.what();
             throw std::runtime_error(std::string("cercall::Service::dispatch_func: ") + msg.c_str());
         }
+        if ( !accepted) {
+            log<error>(O_LOG_TOKEN, "warning - cercall::Service::dispatch_func: worker pool rejected a call of %s",
+                       get_function_name(funcId));
+            if ( !isOneWay) {
+                {
+                    auto lock = lock_clients();
+                    erase_pending_call(cs, callId);
+                }
+                std::string resMsg = func->serializeError(cs.get_output_archive(), funcId, callId,
+                                                          Error::service_overloaded());
+                cs.myMessenger.send(client, std::move(resMsg));
+            }
+        }
     }
 
-    void send_result(const std::shared_ptr<Transport>& cl, const std::string& funcName, std::string& resultMsg)
+    void send_result(const std::shared_ptr<Transport>& cl, FunctionId funcId, CallId callId,
+                     std::string& resultMsg)
     {
 #ifdef O_ENSURE_SINGLE_THREAD
-        o_assert(std::this_thread::get_id() == myThreadId);
+        o_assert(myMultiThreaded || std::this_thread::get_id() == myThreadId);
 #endif
         o_assert(cl.get() != nullptr);
-        PendingCallsMap::const_iterator foundPendingCall;
-
-        foundPendingCall = find_pending_call(funcName, cl.get());
-        if (foundPendingCall == myPendingCalls.end()) {
-            std::string err = std::string("method results already delivered for ") + funcName;
-            throw std::runtime_error(std::string("cercall::Service::send_result: ") + err.c_str());
+        ClientState* cs = nullptr;
+        {
+            //The pending calls of a disconnected client are gone with its state.
+            auto lock = lock_clients();
+            cs = static_cast<ClientState*>(cl->get_listener_data());
+            if (cs != nullptr) {
+                if ( !erase_pending_call(*cs, callId)) {
+                    std::string err = std::string("method results already delivered for ")
+                                      + get_function_name(funcId);
+                    throw std::runtime_error(std::string("cercall::Service::send_result: ") + err.c_str());
+                }
+            }
         }
-
-        if (myClients.find(foundPendingCall->second) != myClients.end()) {
-            details::Messenger::write_message_with_header(*foundPendingCall->second, resultMsg);
+        if (cs != nullptr) {
+            ClientStateUse use(*cs);
+            cs->myMessenger.send(*cl, std::move(resultMsg));
         } else {
             //warning - client disconnected
             log<error>(O_LOG_TOKEN, "warning - cercall::Service::send_result: can't send result of %s "
-                                    "to disconnected client", funcName.c_str());
+                                    "to disconnected client", get_function_name(funcId));
         }
-        myPendingCalls.erase(foundPendingCall);
     }
 
 };
@@ -22,8 +22,12 @@
 #define CERCALL_TRANSPORT_H
 
 #include <stdint.h>
+#include <functional>
 #include <memory>
+#include <stdexcept>
+#include <string>
 #include "cercall/cercall.h"
+#include "cercall/dataview.h"
 
 namespace cercall {
 
@@ -62,6 +66,26 @@ public:
          * @return number of bytes read from the transport input buffer
          */
         virtual std::size_t on_incoming_data(Transport& tr, std::size_t dataLenInBuffer) = 0;
+        /**
+         * @brief Notification that the outgoing data queued in the transport reached the high watermark.
+         * Optional. Called only by transports which implement asynchronous writes.
+         * The listener can apply backpressure, i.e. refrain from writing more data to the transport
+         * until on_write_queue_low() is called.
+         * @param queuedBytes number of bytes waiting in the outgoing queue
+         */
+        virtual void on_write_queue_high(Transport&, std::size_t /*queuedBytes*/)  {}
+        /**
+         * @brief Notification that the outgoing queue drained to the low watermark after it reached
+         * the high watermark.
+         * Optional.
+         * @param queuedBytes number of bytes waiting in the outgoing queue
+         */
+        virtual void on_write_queue_low(Transport&, std::size_t /*queuedBytes*/)  {}
+        /**
+         * @brief Notification requested with Transport::request_write_ready().
+         * Optional.
+         */
+        virtual void on_write_ready(Transport&)  {}
     };
 
     virtual ~Transport() noexcept(false) {}
@@ -77,7 +101,20 @@ public:
      * Clear the listener.
      * The listener has to call it in its destructor to decouple itself from the Transport.
      */
-    void clear_listener() {  myListener = nullptr; }
+    void clear_listener()
+    {
+        myListener = nullptr;
+        myListenerData = nullptr;
+    }
+
+    /**
+     * Attach the listener's state of the connection to the Transport object, so the listener
+     * doesn't have to look it up on every notification. Cleared by clear_listener().
+     */
+    void set_listener_data(void* data)  {  myListenerData = data;  }
+
+    /** @return the data set by set_listener_data(), nullptr if none */
+    void* get_listener_data() const  {  return myListenerData;  }
 
     /**
      * @return true if the Transport is in open state, otherwise false.
@@ -122,11 +159,11 @@ public:
      * It may be greater than the length requested in the read() parameter.
      * Calling this function shall move the read position of the input buffer by the number of bytes
      * requested previously in the read() function.
-     * If called multiple times, the function shall return a reference to the same read data,
+     * If called multiple times, the function shall return a view of the same read data,
      * until a new read operation is requested by calling read().
-     * @return reference to the buffer holding the read data.
+     * @return view of the read data in the transport input buffer, valid until read() is called.
      */
-    virtual const std::string& get_read_data() = 0;
+    virtual DataView get_read_data() = 0;
 
     /**
      * @brief Write data to the transport channel.
@@ -137,8 +174,102 @@ public:
      */
     virtual Error write(const std::string& msg) = 0;
 
+    /**
+     * @brief Write data gathered from several buffers to the transport channel.
+     * The buffers are written in order, as one contiguous piece of data. The buffers need not
+     * outlive the call. Transports which support vectored I/O pass the buffers to a single
+     * system call, the default implementation concatenates them and calls write(const std::string&).
+     * @param buffers array of buffers to write
+     * @param count number of buffers in the array
+     * @return an Error value, which may indicate that the operation failed.
+     */
+    virtual Error write(const DataView* buffers, std::size_t count)
+    {
+        std::string msg;
+        std::size_t len = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            len += buffers[i].size();
+        }
+        msg.reserve(len);
+        for (std::size_t i = 0; i < count; ++i) {
+            msg.append(buffers[i].data(), buffers[i].size());
+        }
+        return write(msg);
+    }
+
+    /**
+     * @return number of bytes accepted by write() but not yet passed to the transport channel.
+     * Always 0 for transports with synchronous write.
+     */
+    virtual std::size_t get_write_queue_size() const  {   return 0;   }
+
+    /**
+     * @return false if the transport may lose or reorder messages, like a datagram transport.
+     * Such a transport carries only one-way calls and events.
+     */
+    virtual bool is_reliable() const  {   return true;    }
+
+    /**
+     * @return true if the transport reads ahead of the length requested with read(), so reading a few bytes
+     * at a time costs no system call each. Such transports are required for varint message headers.
+     */
+    virtual bool reads_ahead() const  {   return false;   }
+
+    /**
+     * @brief Run the function in the execution context of the transport.
+     * Transports used by an event loop run by multiple threads serialize their notifications,
+     * other threads must access such transports through this function.
+     * The function may be run before dispatch() returns, or later, from another thread.
+     * The default implementation runs the function immediately.
+     */
+    virtual void dispatch(std::function<void()> f)  {   f();    }
+
+    /**
+     * @return true if the calling thread runs in the execution context of the transport, so the transport
+     * may be used directly. Always true for transports which are not used by multiple threads.
+     */
+    virtual bool running_in_this_thread() const  {   return true;    }
+
+    /**
+     * @return true if the transport implements post(). The Service runs the offloaded functions of the clients
+     * of other transports in the transport thread.
+     */
+    virtual bool can_post() const  {   return false;    }
+
+    /**
+     * @brief Queue the function for the event loop of the transport, to be run in its execution context.
+     * Threads which don't run the event loop, like the threads of a WorkerPool, hand results back this way.
+     * The function is never run before post() returns. Only supported if can_post() returns true.
+     */
+    virtual void post(std::function<void()> /*f*/)
+    {
+        throw std::logic_error("cercall::Transport::post is not supported by this transport");
+    }
+
+    /**
+     * @brief Request Listener::on_write_ready() when the data written so far has left the transport,
+     * so the listener can pace its writes instead of filling the outgoing queue.
+     * Transports with an outgoing queue notify when the pending write completes, the default implementation
+     * notifies in a later turn of the event loop. Only supported if can_post() returns true.
+     */
+    virtual void request_write_ready()
+    {
+        std::shared_ptr<Transport> self = shared_from_this();
+        post([self]() {
+            self->notify_write_ready();
+        });
+    }
+
 protected:
     Listener* myListener = nullptr;
+    void* myListenerData = nullptr;
+
+    void notify_write_ready()
+    {
+        if (myListener != nullptr) {
+            myListener->on_write_ready(*this);
+        }
+    }
 };
 
 }   //namespace cercall
@@ -0,0 +1,143 @@
+/*!
+ * \file
+ * \brief     Cercall worker pool for offloaded service functions
+ *
+ *  Copyright (c) 2018, Arthur Wisz
+ *  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CERCALL_WORKERPOOL_H
+#define CERCALL_WORKERPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "cercall/log.h"
+
+namespace cercall {
+
+/**
+ * @brief A bounded pool of threads running the service functions added with O_ADD_OFFLOADED_SERVICE_FUNCTIONS_OF,
+ * so that expensive calls don't stall the transport event loop, @see Service::set_worker_pool().
+ * The pool may be shared by several services.
+ */
+class WorkerPool
+{
+public:
+    using Job = std::function<void()>;
+
+    /**
+     * @param threadCount the number of worker threads
+     * @param maxQueuedJobs the number of jobs waiting for a worker, further jobs are rejected
+     */
+    WorkerPool(unsigned threadCount, std::size_t maxQueuedJobs) : myMaxQueuedJobs(maxQueuedJobs)
+    {
+        o_assert(threadCount > 0);
+        for (unsigned i = 0; i < threadCount; ++i) {
+            myThreads.emplace_back(&WorkerPool::run, this);
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * The queued jobs are run before the worker threads are joined.
+     */
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(myMutex);
+            myStopping = true;
+        }
+        myCondition.notify_all();
+        for (std::thread& t : myThreads) {
+            t.join();
+        }
+    }
+
+    /**
+     * @brief Queue a job for a worker thread.
+     * @return false if the job is rejected, because maxQueuedJobs jobs are waiting for a worker
+     */
+    bool submit(Job job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(myMutex);
+            if (myStopping || myJobs.size() >= myMaxQueuedJobs) {
+                return false;
+            }
+            myJobs.push_back(std::move(job));
+        }
+        myCondition.notify_one();
+        return true;
+    }
+
+    /** @return the number of jobs waiting for a worker */
+    std::size_t get_queue_size() const
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+        return myJobs.size();
+    }
+
+    /** @return true if the calling thread is a worker thread of any pool */
+    static bool running_in_worker()
+    {
+        return is_worker();
+    }
+
+private:
+    std::vector<std::thread> myThreads;
+    std::deque<Job> myJobs;
+    const std::size_t myMaxQueuedJobs;
+    bool myStopping = false;
+    mutable std::mutex myMutex;
+    std::condition_variable myCondition;
+
+    static bool& is_worker()
+    {
+        static thread_local bool worker = false;
+        return worker;
+    }
+
+    void run()
+    {
+        is_worker() = true;
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(myMutex);
+                myCondition.wait(lock, [this]() {   return myStopping || !myJobs.empty(); });
+                if (myJobs.empty()) {
+                    return;
+                }
+                job = std::move(myJobs.front());
+                myJobs.pop_front();
+            }
+            try {
+                job();
+            } catch (const std::exception& e) {
+                log<error>(O_LOG_TOKEN, "error - offloaded service function failed: %s", e.what());
+            }
+        }
+    }
+};
+
+}   //namespace cercall
+
+#endif // CERCALL_WORKERPOOL_H
@@ -28,11 +28,12 @@ class CalculatorService : public cercall::Service<CalculatorInterface, Serializa
 {
 public:
     CalculatorService(asio::io_service& ios, std::unique_ptr<cercall::Acceptor> ac,
-                      std::function<void()> serviceCloseAction)
-        : cercall::Service<CalculatorInterface, SerializationType>(std::move(ac)), myResultTimer(ios),
+                      std::function<void()> serviceCloseAction, bool multiThreaded = false)
+        : cercall::Service<CalculatorInterface, SerializationType>(std::move(ac), multiThreaded), myResultTimer(ios),
         myServiceCloseAction(serviceCloseAction)
     {
-        O_ADD_SERVICE_FUNCTIONS_OF(CalculatorInterface, false, add, add_vector, add_and_delay_result);
+        O_ADD_SERVICE_FUNCTIONS_OF(CalculatorInterface, false, add, add_and_delay_result);
+        O_ADD_OFFLOADED_SERVICE_FUNCTIONS_OF(CalculatorInterface, false, add_vector);
         O_ADD_SERVICE_FUNCTIONS_OF(CalculatorInterface, false, get_connected_clients_count);
 #if defined(TEST_CEREAL_BINARY) || defined(TEST_CEREAL_JSON)
         O_ADD_SERVICE_FUNCTIONS_OF(CalculatorInterface, false, add_by_pointers);
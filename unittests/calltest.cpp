@@ -23,7 +23,17 @@
 #include "calculatorinterface.h"
 #include "cercall/client.h"
 #include "cercall/asio/clienttcptransport.h"
+#include "cercall/asio/tcpacceptor.h"
+#include "cercall/asio/clientlocaltransport.h"
+#include "cercall/asio/clientshmtransport.h"
+#include "cercall/asio/shmacceptor.h"
+#include "cercall/asio/uring.h"
+#include "cercall/asio/clientloopbacktransport.h"
+#include "cercall/asio/loopbackacceptor.h"
+#include "cercall/asio/clientudptransport.h"
+#include "cercall/asio/udpacceptor.h"
 #include "calculatorclient.h"
+#include "calculatorservice.h"
 #include "process.h"
 #include "testutil.h"
 #include <random>
@@ -65,13 +75,52 @@ protected:
     void SetUp() override
     {
         myClient = create_open_client(myIoService);
+        ASSERT_TRUE(receive_function_table(*myClient));
     }
 
     void TearDown() override
     {
         myClient->close();
+        myWork.reset();
     }
 
+    using ClientType = CalculatorClient<CalculatorInterface::Serialization>;
+    using ServiceType = CalculatorService<CalculatorInterface::Serialization>;
+
+    /**
+     * Create a service in the test process, on the io_service of the client, which is reachable
+     * with the loopback transport of the given name. The client of the test service is closed.
+     */
+    std::shared_ptr<ServiceType> create_loopback_service(const std::string& name,
+                                                         std::function<void()> serviceCloseAction = [](){})
+    {
+        if ( !myWork) {
+            myClient->close();
+            //There are no pending socket operations, which would keep the io_service running between the calls.
+            myWork = cercall::make_unique<asio::io_service::work>(myIoService);
+        }
+        auto acceptor = cercall::make_unique<cercall::asio::LoopbackAcceptor>(myIoService, name);
+        return std::make_shared<ServiceType>(myIoService, std::move(acceptor), std::move(serviceCloseAction));
+    }
+
+    /**
+     * Open a client of the loopback service and receive the function table.
+     * @return the open client, or null pointer on failure
+     */
+    std::shared_ptr<ClientType> open_loopback_client(const std::string& name,
+                                                     const cercall::FrameConfig& frameConfig = cercall::FrameConfig(),
+                                                     int maxNumHandlers = 4)
+    {
+        auto transport = cercall::make_unique<cercall::asio::ClientLoopbackTransport>(myIoService, name);
+        auto client = std::make_shared<ClientType>(std::move(transport));
+        client->set_frame_config(frameConfig);
+        if ( !client->open() || !receive_function_table(*client, maxNumHandlers)) {
+            return nullptr;
+        }
+        return client;
+    }
+
+    std::unique_ptr<asio::io_service::work> myWork;
     static bool multipleClientTestSlave;
 };
 
@@ -140,6 +189,39 @@ TEST_F(CallTest, test_queued_calls)
    EXPECT_EQ(process_io_events(gotResultCall3, 4), true);
 }
 
+TEST_F(CallTest, test_pipelined_calls)
+{
+    //The calls are sent at once and the results are matched by the call ids, so the later calls
+    //complete before the delayed one.
+    bool gotDelayedResult = false;
+    int numResults = 0;
+
+    myClient->add_and_delay_result(10, 20, [&gotDelayedResult, &numResults](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        EXPECT_EQ(res.get_value(), 30);
+        EXPECT_EQ(numResults, 3);
+        gotDelayedResult = true;
+    });
+    for (int32_t i = 0; i < 3; ++i) {
+        myClient->add(1, 2, i, [i, &numResults](const cercall::Result<int32_t>& res){
+            EXPECT_FALSE( !res);
+            EXPECT_EQ(res.get_value(), (1 + 2 + i));
+            EXPECT_EQ(numResults, i);
+            ++numResults;
+        });
+    }
+    EXPECT_TRUE(myClient->is_call_in_progress("add"));
+
+    for (int maxNumHandlers = 8; numResults < 3 && maxNumHandlers; --maxNumHandlers) {
+        myIoService.run_one();
+    }
+    EXPECT_EQ(numResults, 3);
+    EXPECT_FALSE(myClient->is_call_in_progress("add"));
+    EXPECT_TRUE(myClient->is_call_in_progress("add_and_delay_result"));
+
+    EXPECT_EQ(process_io_events(gotDelayedResult, 4), true);
+}
+
 static std::vector<int32_t> generate_data(size_t size)
 {
     static std::uniform_int_distribution<int32_t> distribution(
@@ -169,6 +251,149 @@ TEST_F(CallTest, test_large_message)
     EXPECT_EQ(process_io_events(gotResult, 9), true);
 }
 
+TEST_F(CallTest, test_async_write)
+{
+    myClient->close();
+
+    cercall::asio::StreamTransportConfig config;
+    config.asyncWrite = true;
+    auto transport = cercall::make_unique<cercall::asio::ClientTcpTransport>(myIoService, TEST_SERVICE_HOST, TEST_SERVICE_PORT_STR);
+    transport->set_config(config);
+    myClient = std::make_shared<CalculatorClient<CalculatorInterface::Serialization>>(std::move(transport));
+    ASSERT_TRUE(myClient->open());
+    ASSERT_TRUE(receive_function_table(*myClient));
+
+    bool gotResultCall1 = false;
+    bool gotResultCall2 = false;
+    std::vector<int32_t> a = generate_data(4096u);
+    std::vector<int32_t> b = generate_data(4096u);
+    myClient->add_vector(a, b, [&gotResultCall1](const cercall::Result<std::vector<int64_t>> &res){
+        EXPECT_FALSE( !res);
+        EXPECT_EQ(res.get_value().size(), 4096u);
+        gotResultCall1 = true;
+    });
+    myClient->add(1, 2, 3, [&gotResultCall2](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        ASSERT_EQ(res.get_value(), (1 + 2 + 3));
+        gotResultCall2 = true;
+    });
+
+    EXPECT_EQ(process_io_events(gotResultCall1, 16), true);
+    EXPECT_EQ(process_io_events(gotResultCall2, 8), true);
+}
+
+TEST_F(CallTest, test_tcp_write_queue)
+{
+    //Reads frames of a fixed size, like a messenger, and records the write queue notifications.
+    static constexpr std::size_t frameSize = 64u * 1024u;
+    struct FrameListener : public cercall::Acceptor::Listener, public cercall::Transport::Listener
+    {
+        void on_client_accepted(std::shared_ptr<cercall::Transport> tr) override     {   accepted = tr;  }
+        void on_accept_error(const cercall::Error&) override {}
+        void on_connected(cercall::Transport& tr) override    {   tr.read(frameSize);     }
+        void on_connection_error(cercall::Transport&, const cercall::Error&) override {}
+        void on_disconnected(cercall::Transport&) override {}
+        std::size_t on_incoming_data(cercall::Transport& tr, std::size_t len) override
+        {
+            std::size_t consumed = 0;
+            for (; len - consumed >= frameSize; consumed += frameSize) {
+                cercall::DataView frame = tr.get_read_data();
+                received.append(frame.data(), frame.size());
+                tr.read(frameSize);
+            }
+            return consumed;
+        }
+        void on_write_queue_high(cercall::Transport&, std::size_t) override     {   ++highCount;    }
+        void on_write_queue_low(cercall::Transport&, std::size_t) override      {   ++lowCount;     }
+        std::shared_ptr<cercall::Transport> accepted;
+        std::string received;
+        int highCount = 0;
+        int lowCount = 0;
+    } serviceListener, clientListener;
+
+    cercall::asio::TcpAcceptor acceptor(myIoService, TEST_TCP_ACCEPTOR_PORT);
+    acceptor.set_listener(serviceListener);
+    acceptor.open();
+    ASSERT_TRUE(acceptor.is_open());
+
+    auto transport = std::make_shared<cercall::asio::ClientTcpTransport>(myIoService, TEST_SERVICE_HOST,
+                                                                         std::to_string(TEST_TCP_ACCEPTOR_PORT));
+    cercall::asio::StreamTransportConfig config;
+    config.asyncWrite = true;
+    config.writeQueueHighWatermark = 1024u * 1024u;
+    config.writeQueueLowWatermark = 256u * 1024u;
+    transport->set_config(config);
+    transport->set_listener(clientListener);
+    ASSERT_TRUE(transport->open());
+    for (int i = 0; i < 100 && serviceListener.accepted == nullptr; ++i) {
+        myIoService.run_one_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_TRUE(serviceListener.accepted != nullptr);
+
+    //The service does not read, the data exceeds the socket buffers, so the queue stays above the low watermark.
+    std::string sent;
+    for (std::size_t i = 0; i < 256u * frameSize; ++i) {
+        sent.push_back(static_cast<char>('a' + i % 23u));
+    }
+    EXPECT_FALSE(transport->write(sent));
+    EXPECT_EQ(clientListener.highCount, 1);
+    myIoService.run_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(clientListener.lowCount, 0);
+    EXPECT_GT(transport->get_write_queue_size(), config.writeQueueLowWatermark);
+
+    //The queue drains when the service reads.
+    serviceListener.accepted->set_listener(serviceListener);
+    ASSERT_TRUE(serviceListener.accepted->open());
+    bool allReceived = false;
+    for (int i = 0; i < 500 && !allReceived; ++i) {
+        myIoService.run_for(std::chrono::milliseconds(10));
+        allReceived = serviceListener.received.size() == sent.size();
+    }
+    EXPECT_TRUE(serviceListener.received == sent);
+    EXPECT_EQ(clientListener.highCount, 1);
+    EXPECT_EQ(clientListener.lowCount, 1);
+    EXPECT_EQ(transport->get_write_queue_size(), 0u);
+    transport->close();
+    serviceListener.accepted->close();
+    acceptor.close();
+}
+
+TEST_F(CallTest, test_streaming_receive)
+{
+    myClient->close();
+
+    cercall::asio::StreamTransportConfig config;
+    config.receiveBufferSize = 16u * 1024u;
+    auto transport = cercall::make_unique<cercall::asio::ClientTcpTransport>(myIoService, TEST_SERVICE_HOST, TEST_SERVICE_PORT_STR);
+    transport->set_config(config);
+    myClient = std::make_shared<CalculatorClient<CalculatorInterface::Serialization>>(std::move(transport));
+    ASSERT_TRUE(myClient->open());
+    ASSERT_TRUE(receive_function_table(*myClient));
+
+    //The vector result does not fit in the receive buffer.
+    bool gotVectorResult = false;
+    std::vector<int32_t> a = generate_data(8192u);
+    std::vector<int32_t> b = generate_data(8192u);
+    myClient->add_vector(a, b, [&gotVectorResult](const cercall::Result<std::vector<int64_t>> &res){
+        EXPECT_FALSE( !res);
+        EXPECT_EQ(res.get_value().size(), 8192u);
+        gotVectorResult = true;
+    });
+
+    int resultCount = 0;
+    bool gotAllResults = false;
+    for (int32_t i = 0; i < 3; ++i) {
+        myClient->add(1, 2, i, [&resultCount, &gotAllResults, i](const cercall::Result<int32_t>& res){
+            EXPECT_FALSE( !res);
+            ASSERT_EQ(res.get_value(), (1 + 2 + i));
+            gotAllResults = (++resultCount == 3);
+        });
+    }
+
+    EXPECT_EQ(process_io_events(gotVectorResult, 32), true);
+    EXPECT_EQ(process_io_events(gotAllResults, 16), true);
+}
+
 TEST_F(CallTest, test_async_open)
 {
     myClient->close();
@@ -188,6 +413,7 @@ TEST_F(CallTest, test_async_open)
     EXPECT_EQ(process_io_events(gotResult, 4), true);
 
     EXPECT_TRUE(myClient->is_open());
+    ASSERT_TRUE(receive_function_table(*myClient));
 
     gotResult = false;
     myClient->add(100, 200, 300, [&gotResult](const cercall::Result<int32_t>& res){
@@ -208,6 +434,1336 @@ TEST_F(CallTest, test_async_open)
 
 }
 
+TEST_F(CallTest, test_local_transport)
+{
+    myClient->close();
+
+    auto transport = cercall::make_unique<cercall::asio::ClientLocalTransport>(myIoService, TEST_SERVICE_LOCAL_PATH);
+    myClient = std::make_shared<CalculatorClient<CalculatorInterface::Serialization>>(std::move(transport));
+
+    bool gotResult = false;
+    myClient->open([&gotResult](const cercall::Result<bool>& res) {
+        gotResult = true;
+        EXPECT_FALSE( !res);
+    });
+    EXPECT_EQ(process_io_events(gotResult, 2), true);
+    ASSERT_TRUE(myClient->is_open());
+    ASSERT_TRUE(receive_function_table(*myClient));
+
+    gotResult = false;
+    myClient->add(10, 20, 30, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        ASSERT_EQ(res.get_value(), (10 + 20 + 30));
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 2), true);
+}
+
+TEST_F(CallTest, test_shm_transport)
+{
+    myClient->close();
+
+    auto transport = cercall::make_unique<cercall::asio::ClientShmTransport>(myIoService, TEST_SERVICE_SHM_PATH);
+    myClient = std::make_shared<CalculatorClient<CalculatorInterface::Serialization>>(std::move(transport));
+
+    bool gotResult = false;
+    myClient->open([&gotResult](const cercall::Result<bool>& res) {
+        gotResult = true;
+        EXPECT_FALSE( !res);
+    });
+    EXPECT_EQ(process_io_events(gotResult, 3), true);
+    ASSERT_TRUE(myClient->is_open());
+    ASSERT_TRUE(receive_function_table(*myClient));
+
+    gotResult = false;
+    myClient->add(10, 20, 30, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        ASSERT_EQ(res.get_value(), (10 + 20 + 30));
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 2), true);
+
+    //The messages are much larger than the rings of the test service.
+    gotResult = false;
+    std::vector<int32_t> a = generate_data(8192u);
+    std::vector<int32_t> b = generate_data(8192u);
+    myClient->add_vector(a, b, [&gotResult, &a, &b](const cercall::Result<std::vector<int64_t>> &res){
+        EXPECT_FALSE( !res);
+        std::vector<int64_t> localResult(a.size());
+        std::transform (a.begin(), a.end(), b.begin(), localResult.begin(), std::plus<int64_t>());
+        EXPECT_EQ(res.get_value(), localResult);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 256), true);
+}
+
+TEST_F(CallTest, test_shm_write_queue)
+{
+#ifdef CERCALL_ASIO_HAS_SHM_TRANSPORT
+    //Reads frames of a fixed size, like a messenger, and records the write queue notifications.
+    static constexpr std::size_t frameSize = 1000u;
+    struct FrameListener : public cercall::Acceptor::Listener, public cercall::Transport::Listener
+    {
+        void on_client_accepted(std::shared_ptr<cercall::Transport> tr) override     {   accepted = tr;  }
+        void on_accept_error(const cercall::Error&) override {}
+        void on_connected(cercall::Transport& tr) override    {   tr.read(frameSize);     }
+        void on_connection_error(cercall::Transport&, const cercall::Error&) override {}
+        void on_disconnected(cercall::Transport&) override {}
+        std::size_t on_incoming_data(cercall::Transport& tr, std::size_t len) override
+        {
+            std::size_t consumed = 0;
+            for (; len - consumed >= frameSize; consumed += frameSize) {
+                cercall::DataView frame = tr.get_read_data();
+                received.append(frame.data(), frame.size());
+                tr.read(frameSize);
+            }
+            return consumed;
+        }
+        void on_write_queue_high(cercall::Transport&, std::size_t) override     {   ++highCount;    }
+        void on_write_queue_low(cercall::Transport&, std::size_t) override      {   ++lowCount;     }
+        std::shared_ptr<cercall::Transport> accepted;
+        std::string received;
+        int highCount = 0;
+        int lowCount = 0;
+    } serviceListener, clientListener;
+
+    cercall::asio::ShmAcceptor acceptor(myIoService, TEST_SHM_ACCEPTOR_PATH, 4096u);
+    acceptor.set_listener(serviceListener);
+    acceptor.open();
+    ASSERT_TRUE(acceptor.is_open());
+
+    auto transport = std::make_shared<cercall::asio::ClientShmTransport>(myIoService, TEST_SHM_ACCEPTOR_PATH);
+    cercall::asio::StreamTransportConfig config;
+    config.writeQueueHighWatermark = 16u * 1024u;
+    config.writeQueueLowWatermark = 4u * 1024u;
+    transport->set_config(config);
+    transport->set_listener(clientListener);
+    bool opened = false;
+    transport->open([&opened](const cercall::Result<bool>& res) {
+        EXPECT_FALSE( !res);
+        opened = true;
+    });
+    EXPECT_EQ(process_io_events(opened, 5), true);
+    ASSERT_TRUE(transport->is_open());
+    ASSERT_TRUE(serviceListener.accepted != nullptr);
+
+    //The data does not fit in the ring until the service reads it.
+    std::string sent;
+    for (std::size_t i = 0; i < 64u * frameSize; ++i) {
+        sent.push_back(static_cast<char>('a' + i % 23u));
+    }
+    EXPECT_FALSE(transport->write(sent));
+    EXPECT_EQ(clientListener.highCount, 1);
+    EXPECT_EQ(clientListener.lowCount, 0);
+    EXPECT_GT(transport->get_write_queue_size(), config.writeQueueHighWatermark);
+
+    //The frames wrap around the end of the ring.
+    serviceListener.accepted->set_listener(serviceListener);
+    ASSERT_TRUE(serviceListener.accepted->open());
+    bool allReceived = false;
+    for (int i = 0; i < 100 && !allReceived; ++i) {
+        myIoService.run_for(std::chrono::milliseconds(10));
+        allReceived = serviceListener.received.size() == sent.size();
+    }
+    EXPECT_TRUE(serviceListener.received == sent);
+    EXPECT_EQ(clientListener.lowCount, 1);
+    EXPECT_EQ(transport->get_write_queue_size(), 0u);
+    transport->close();
+    serviceListener.accepted->close();
+    acceptor.close();
+#else
+    GTEST_SKIP() << "shared memory transport not supported";
+#endif
+}
+
+TEST_F(CallTest, test_shm_corrupted_ring)
+{
+#ifdef CERCALL_ASIO_HAS_SHM_TRANSPORT
+    namespace shm = cercall::asio::shm;
+    //Opens the accepted transports and records their errors.
+    struct ServiceListener : public cercall::Acceptor::Listener, public cercall::Transport::Listener
+    {
+        void on_client_accepted(std::shared_ptr<cercall::Transport> tr) override
+        {
+            tr->set_listener(*this);
+            tr->open();
+            transports.push_back(tr);
+        }
+        void on_accept_error(const cercall::Error&) override {}
+        void on_connected(cercall::Transport& tr) override    {   tr.read(1u);    }
+        void on_connection_error(cercall::Transport&, const cercall::Error& err) override
+        {
+            errors.push_back(err.code());
+        }
+        void on_disconnected(cercall::Transport&) override {}
+        std::size_t on_incoming_data(cercall::Transport&, std::size_t) override     {   return 0;   }
+        std::vector<std::shared_ptr<cercall::Transport>> transports;
+        std::vector<int> errors;
+    } listener;
+
+    const std::size_t capacity = 4096u;
+    cercall::asio::ShmAcceptor acceptor(myIoService, TEST_SHM_ACCEPTOR_PATH, capacity);
+    acceptor.set_listener(listener);
+    acceptor.open();
+    ASSERT_TRUE(acceptor.is_open());
+
+    //A client maps the segment itself and moves the consumer position of a ring far from the producer position.
+    for (bool serviceToClient : { false, true }) {
+        const std::size_t index = listener.transports.size();
+        asio::local::stream_protocol::socket socket(myIoService);
+        socket.connect(cercall::asio::make_local_endpoint(TEST_SHM_ACCEPTOR_PATH));
+        for (int i = 0; i < 100 && listener.transports.size() == index; ++i) {
+            myIoService.run_for(std::chrono::milliseconds(10));
+        }
+        ASSERT_EQ(listener.transports.size(), index + 1u);
+        std::shared_ptr<cercall::Transport> serviceTr = listener.transports.back();
+        ASSERT_TRUE(serviceTr->is_open());
+
+        int fds[shm::HANDSHAKE_FD_COUNT];
+        cercall::asio::ErrorCode ec;
+        ASSERT_TRUE(shm::receive_fds(socket.native_handle(), fds, ec));
+        void* mem = ::mmap(nullptr, shm::segment_size(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+        ASSERT_NE(mem, MAP_FAILED);
+        //The consumer position is the first member of the ring header.
+        std::memset(shm::ring_memory(mem, capacity, serviceToClient), 0x10, sizeof(std::uint64_t));
+
+        if (serviceToClient) {
+            //The service writes to the ring.
+            const std::string msg(100u, 'x');
+            cercall::Error err = serviceTr->write(msg);
+            EXPECT_TRUE(static_cast<bool>(err));
+            EXPECT_EQ(err.code(), EPROTO);
+        } else {
+            //The service reads from the ring when the client wakes it up.
+            const std::uint64_t one = 1u;
+            ASSERT_EQ(::write(fds[2], &one, sizeof(one)), static_cast<ssize_t>(sizeof(one)));
+            for (int i = 0; i < 100 && serviceTr->is_open(); ++i) {
+                myIoService.run_for(std::chrono::milliseconds(10));
+            }
+        }
+        EXPECT_FALSE(serviceTr->is_open());
+        ASSERT_EQ(listener.errors.size(), index + 1u);
+        EXPECT_EQ(listener.errors.back(), EPROTO);
+
+        ::munmap(mem, shm::segment_size(capacity));
+        for (int fd : fds) {
+            ::close(fd);
+        }
+    }
+    acceptor.close();
+#else
+    GTEST_SKIP() << "shared memory transport not supported";
+#endif
+}
+
+TEST_F(CallTest, test_uring_transport)
+{
+#ifdef CERCALL_ASIO_HAS_URING
+    try {
+        asio::io_service probeIoService;
+        cercall::asio::Uring::create(probeIoService);
+    } catch (std::system_error& e) {
+        GTEST_SKIP() << "io_uring not available: " << e.what();
+    }
+    myClient->close();
+
+    auto transport = cercall::make_unique<cercall::asio::ClientTcpTransport>(myIoService, TEST_SERVICE_HOST,
+                                                                            TEST_SERVICE_URING_PORT_STR);
+    myClient = std::make_shared<CalculatorClient<CalculatorInterface::Serialization>>(std::move(transport));
+    ASSERT_TRUE(myClient->open());
+    ASSERT_TRUE(receive_function_table(*myClient));
+
+    bool gotResult = false;
+    myClient->add(10, 20, 30, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        ASSERT_EQ(res.get_value(), (10 + 20 + 30));
+        gotResult = true;
+    });
+    //One more handler for the aborted read of the closed client.
+    EXPECT_EQ(process_io_events(gotResult, 3), true);
+
+    //The message is much larger than the receive buffer of the test service.
+    gotResult = false;
+    std::vector<int32_t> a = generate_data(65536u);
+    std::vector<int32_t> b = generate_data(65536u);
+    myClient->add_vector(a, b, [&gotResult, &a, &b](const cercall::Result<std::vector<int64_t>> &res){
+        EXPECT_FALSE( !res);
+        std::vector<int64_t> localResult(a.size());
+        std::transform (a.begin(), a.end(), b.begin(), localResult.begin(), std::plus<int64_t>());
+        EXPECT_EQ(res.get_value(), localResult);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 256), true);
+#else
+    GTEST_SKIP() << "io_uring not supported";
+#endif
+}
+
+TEST_F(CallTest, test_uring_shutdown)
+{
+#ifdef CERCALL_ASIO_HAS_URING
+    std::shared_ptr<cercall::asio::Uring> ring;
+    try {
+        ring = cercall::asio::Uring::create(myIoService);
+    } catch (std::system_error& e) {
+        GTEST_SKIP() << "io_uring not available: " << e.what();
+    }
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), 0);
+
+    //A receive in flight, whose handler holds the last reference to the buffer.
+    //When the buffer is released, the receive must be finished and not take data sent to the socket.
+    ssize_t receivedOnRelease = 0;
+    auto buffer = std::shared_ptr<std::vector<char>>(new std::vector<char>(64u), [&](std::vector<char>* buf) {
+        if (::send(fds[1], "data", 4u, 0) == 4) {
+            char received[4];
+            receivedOnRelease = ::recv(fds[0], received, sizeof(received), MSG_DONTWAIT);
+        }
+        delete buf;
+    });
+    std::weak_ptr<std::vector<char>> weakBuffer = buffer;
+    bool handlerCalled = false;
+    io_uring_sqe* sqe = ring->prepare([buffer, &handlerCalled](int, unsigned) {
+        handlerCalled = true;
+    });
+    ASSERT_TRUE(sqe != nullptr);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->flags = IOSQE_ASYNC;
+    sqe->fd = fds[0];
+    sqe->addr = reinterpret_cast<std::uintptr_t>(buffer->data());
+    sqe->len = static_cast<unsigned>(buffer->size());
+    ring->submit();
+    buffer.reset();
+    EXPECT_FALSE(weakBuffer.expired());
+
+    ring->shutdown();
+    EXPECT_TRUE(weakBuffer.expired());
+    EXPECT_FALSE(handlerCalled);
+    EXPECT_EQ(receivedOnRelease, 4);
+    ::close(fds[0]);
+    ::close(fds[1]);
+#else
+    GTEST_SKIP() << "io_uring not supported";
+#endif
+}
+
+TEST_F(CallTest, test_loopback_transport)
+{
+    //The service runs in the test process, on the io_service of the client.
+    auto service = create_loopback_service("calculator");
+    service->start();
+    myClient = open_loopback_client("calculator");
+    ASSERT_TRUE(myClient != nullptr);
+
+    bool gotResult = false;
+    myClient->add(10, 20, 30, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        ASSERT_EQ(res.get_value(), (10 + 20 + 30));
+        gotResult = true;
+    });
+    //Handlers for the aborted read of the closed client and the delivery to the service and back.
+    EXPECT_EQ(process_io_events(gotResult, 3), true);
+
+    gotResult = false;
+    std::vector<int32_t> a = generate_data(8192u);
+    std::vector<int32_t> b = generate_data(8192u);
+    myClient->add_vector(a, b, [&gotResult, &a, &b](const cercall::Result<std::vector<int64_t>> &res){
+        EXPECT_FALSE( !res);
+        std::vector<int64_t> localResult(a.size());
+        std::transform (a.begin(), a.end(), b.begin(), localResult.begin(), std::plus<int64_t>());
+        EXPECT_EQ(res.get_value(), localResult);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 2), true);
+
+    //Both ends are closed before the service is destroyed.
+    myClient->close();
+    service->stop();
+
+    //A second service of the same name is rejected.
+    auto service2 = create_loopback_service("calculator");
+    service2->start();
+    auto service3 = create_loopback_service("calculator");
+    EXPECT_THROW(service3->start(), std::runtime_error);
+}
+
+TEST_F(CallTest, test_disconnect_with_pending_call)
+{
+    auto service = create_loopback_service("calculator_pending");
+    service->start();
+    auto client = open_loopback_client("calculator_pending");
+    ASSERT_TRUE(client != nullptr);
+    client->add_and_delay_result(1, 2, [](const cercall::Result<int32_t>&){});
+    //The service handles the calls in order, so the delayed call is pending when the result of add arrives.
+    bool gotResult = false;
+    client->add(1, 2, 3, [&gotResult](const cercall::Result<int32_t>&){
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 4), true);
+    client->close();
+
+    //The pending call of the disconnected client doesn't affect the call with the same id from a new client,
+    //its result is dropped by the service.
+    myClient = open_loopback_client("calculator_pending");
+    ASSERT_TRUE(myClient != nullptr);
+    gotResult = false;
+    myClient->add_and_delay_result(10, 20, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        EXPECT_EQ(res.get_value(), 30);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 8), true);
+
+    myClient->close();
+    service->stop();
+}
+
+TEST_F(CallTest, test_client_registry)
+{
+    auto service = create_loopback_service("calculator_registry");
+    service->start();
+
+    std::vector<std::shared_ptr<ClientType>> clients;
+    for (unsigned i = 0; i < 3u; ++i) {
+        clients.push_back(open_loopback_client("calculator_registry"));
+        ASSERT_TRUE(clients.back() != nullptr);
+    }
+
+    //The last client takes the place of the first one in the registry.
+    clients.front()->close();
+    clients.erase(clients.begin());
+    for (std::shared_ptr<ClientType>& client : clients) {
+        bool gotResult = false;
+        client->get_connected_clients_count([&gotResult](const cercall::Result<size_t>& res){
+            EXPECT_FALSE( !res);
+            EXPECT_EQ(res.get_value(), 2u);
+            gotResult = true;
+        });
+        EXPECT_EQ(process_io_events(gotResult, 4), true);
+    }
+
+    for (std::shared_ptr<ClientType>& client : clients) {
+        client->close();
+    }
+    service->stop();
+
+    //The documented memory budget of an idle connection.
+    if (sizeof(void*) == 8) {
+        EXPECT_LE(ServiceType::get_client_state_size(), 320u);
+    }
+}
+
+TEST_F(CallTest, test_shared_dispatch_table)
+{
+    auto first = create_loopback_service("calculator_first");
+    auto second = create_loopback_service("calculator_second");
+    EXPECT_EQ(first->get_interface_hash(), second->get_interface_hash());
+
+    //The dispatch table outlives the instance which added the functions first.
+    first.reset();
+    second->start();
+    myClient = open_loopback_client("calculator_second");
+    ASSERT_TRUE(myClient != nullptr);
+
+    bool gotResult = false;
+    myClient->add(1, 2, 3, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        EXPECT_EQ(res.get_value(), (1 + 2 + 3));
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 3), true);
+
+    myClient->close();
+    second->stop();
+}
+
+TEST_F(CallTest, test_worker_pool)
+{
+    auto service = create_loopback_service("calculator_workers");
+    auto pool = cercall::make_unique<cercall::WorkerPool>(2u, 16u);
+    service->set_worker_pool(pool.get());
+    service->start();
+    myClient = open_loopback_client("calculator_workers");
+    ASSERT_TRUE(myClient != nullptr);
+
+    //add_vector runs on a worker thread, its result is posted back to the io_service.
+    bool gotResult = false;
+    std::vector<int32_t> a = generate_data(8192u);
+    std::vector<int32_t> b = generate_data(8192u);
+    myClient->add_vector(a, b, [&gotResult, &a, &b](const cercall::Result<std::vector<int64_t>> &res){
+        EXPECT_FALSE( !res);
+        std::vector<int64_t> localResult(a.size());
+        std::transform (a.begin(), a.end(), b.begin(), localResult.begin(), std::plus<int64_t>());
+        EXPECT_EQ(res.get_value(), localResult);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 4), true);
+
+    gotResult = false;
+    myClient->add(1, 2, 3, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        EXPECT_EQ(res.get_value(), (1 + 2 + 3));
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 3), true);
+
+    //A pool without room for queued calls rejects them.
+    auto fullPool = cercall::make_unique<cercall::WorkerPool>(1u, 0u);
+    service->set_worker_pool(fullPool.get());
+    gotResult = false;
+    myClient->add_vector(a, b, [&gotResult](const cercall::Result<std::vector<int64_t>> &res){
+        EXPECT_TRUE( !res);
+        EXPECT_EQ(res.error().code(), EAGAIN);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 3), true);
+
+    myClient->close();
+    service->stop();
+    pool.reset();
+    fullPool.reset();
+}
+
+TEST_F(CallTest, test_admission_control)
+{
+    auto service = create_loopback_service("calculator_quota");
+    cercall::AdmissionConfig config;
+    config.maxPendingCallsPerClient = 1;
+    config.maxPendingCallsPerFunction = 1;
+    service->set_admission_config(config);
+    service->start();
+
+    std::vector<std::shared_ptr<ClientType>> clients;
+    for (unsigned i = 0; i < 2u; ++i) {
+        clients.push_back(open_loopback_client("calculator_quota"));
+        ASSERT_TRUE(clients.back() != nullptr);
+    }
+
+    bool gotDelayedResult = false;
+    clients[0]->add_and_delay_result(1, 2, [&gotDelayedResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        EXPECT_EQ(res.get_value(), 3);
+        gotDelayedResult = true;
+    });
+    //The client has a call in progress already.
+    bool gotResult = false;
+    clients[0]->add(1, 2, 3, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_TRUE( !res);
+        EXPECT_EQ(res.error().code(), EDQUOT);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 8), true);
+    //The function has a call in progress of another client.
+    gotResult = false;
+    clients[1]->add_and_delay_result(3, 4, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_TRUE( !res);
+        EXPECT_EQ(res.error().code(), EDQUOT);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 8), true);
+    EXPECT_EQ(process_io_events(gotDelayedResult, 8), true);
+
+    //The quotas are released with the results.
+    gotResult = false;
+    clients[1]->add_and_delay_result(3, 4, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        EXPECT_EQ(res.get_value(), 7);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 8), true);
+    for (std::shared_ptr<ClientType>& client : clients) {
+        client->close();
+    }
+    service->stop();
+
+    //A call rate limit with an empty bucket after the first call.
+    auto rateService = create_loopback_service("calculator_rate");
+    config = cercall::AdmissionConfig();
+    config.callsPerSecond = 0.001;
+    rateService->set_admission_config(config);
+    rateService->start();
+    //Handlers for the closed clients of the first service precede the function table.
+    myClient = open_loopback_client("calculator_rate", cercall::FrameConfig(), 8);
+    ASSERT_TRUE(myClient != nullptr);
+    gotResult = false;
+    myClient->add(1, 2, 3, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 4), true);
+    gotResult = false;
+    myClient->add(1, 2, 3, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_TRUE( !res);
+        EXPECT_EQ(res.error().code(), EDQUOT);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 4), true);
+    myClient->close();
+    rateService->stop();
+}
+
+TEST_F(CallTest, test_lag_shedding)
+{
+    using cercall::details::LagShedder;
+    using std::chrono::milliseconds;
+    LagShedder shedder(milliseconds(5), milliseconds(100));
+    LagShedder::Clock::time_point now = LagShedder::Clock::now();
+
+    //A short lag is accepted, a long lag is tolerated for the interval.
+    EXPECT_FALSE(shedder.shed(now - milliseconds(1), now));
+    EXPECT_FALSE(shedder.shed(now - milliseconds(10), now));
+    now += milliseconds(50);
+    EXPECT_FALSE(shedder.shed(now - milliseconds(10), now));
+    EXPECT_FALSE(shedder.is_shedding());
+
+    //The sustained lag sheds a call, the next one after the interval, then more often.
+    now += milliseconds(50);
+    EXPECT_TRUE(shedder.shed(now - milliseconds(10), now));
+    EXPECT_TRUE(shedder.is_shedding());
+    now += milliseconds(1);
+    EXPECT_FALSE(shedder.shed(now - milliseconds(10), now));
+    now += milliseconds(99);
+    EXPECT_TRUE(shedder.shed(now - milliseconds(10), now));
+    now += milliseconds(71);    //100 ms / sqrt(2)
+    EXPECT_TRUE(shedder.shed(now - milliseconds(10), now));
+
+    //The shedding stops when the lag drops below the target.
+    now += milliseconds(100);
+    EXPECT_FALSE(shedder.shed(now - milliseconds(1), now));
+    EXPECT_FALSE(shedder.is_shedding());
+    now += milliseconds(100);
+    EXPECT_FALSE(shedder.shed(now - milliseconds(10), now));
+
+    //The default shedder is disabled.
+    EXPECT_FALSE(LagShedder().is_enabled());
+    EXPECT_FALSE(LagShedder().shed(now - milliseconds(1000), now));
+
+    //A service whose event loop is kept busy by other handlers.
+    auto service = create_loopback_service("calculator_lag");
+    cercall::AdmissionConfig config;
+    config.lagTarget = milliseconds(1);
+    config.lagInterval = milliseconds(5);
+    service->set_admission_config(config);
+    service->start();
+    myClient = open_loopback_client("calculator_lag");
+    ASSERT_TRUE(myClient != nullptr);
+
+    bool keepBusy = true;
+    bool busyHandlerQueued = true;
+    std::function<void()> busyHandler = [&]() {
+        std::this_thread::sleep_for(milliseconds(2));
+        busyHandlerQueued = keepBusy;
+        if (keepBusy) {
+            myIoService.post(busyHandler);
+        }
+    };
+    myIoService.post(busyHandler);
+
+    //The calls wait behind the busy handlers, the service sheds some of them.
+    const int numCalls = 20;
+    int numShed = 0;
+    for (int i = 0; i < numCalls; ++i) {
+        bool gotResult = false;
+        myClient->add(i, 1, 1, [&gotResult, &numShed](const cercall::Result<int32_t>& res){
+            if ( !res) {
+                EXPECT_EQ(res.error().code(), EAGAIN);
+                ++numShed;
+            }
+            gotResult = true;
+        });
+        ASSERT_TRUE(process_io_events(gotResult, 16));
+    }
+    EXPECT_GT(numShed, 0);
+    EXPECT_LT(numShed, numCalls);
+
+    keepBusy = false;
+    while (busyHandlerQueued) {
+        myIoService.run_one();
+    }
+    myClient->close();
+    service->stop();
+}
+
+TEST_F(CallTest, test_frame_config)
+{
+    cercall::FrameConfig frameConfig;
+    frameConfig.format = cercall::FrameFormat::VARINT;
+    frameConfig.maxMessageSize = 16384u;
+    auto service = create_loopback_service("calculator_varint");
+    service->set_frame_config(frameConfig);
+    service->start();
+    myClient = open_loopback_client("calculator_varint", frameConfig);
+    ASSERT_TRUE(myClient != nullptr);
+
+    bool gotResult = false;
+    std::vector<int32_t> a = generate_data(256u);
+    std::vector<int32_t> b = generate_data(256u);
+    myClient->add_vector(a, b, [&gotResult, &a, &b](const cercall::Result<std::vector<int64_t>> &res){
+        EXPECT_FALSE( !res);
+        std::vector<int64_t> localResult(a.size());
+        std::transform (a.begin(), a.end(), b.begin(), localResult.begin(), std::plus<int64_t>());
+        EXPECT_EQ(res.get_value(), localResult);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 3), true);
+
+    //The message exceeds the limit of the client.
+    std::vector<int32_t> large = generate_data(8192u);
+    EXPECT_THROW(myClient->add_vector(large, large, [](const cercall::Result<std::vector<int64_t>>&){}),
+                 std::length_error);
+
+    //The message exceeds the limit of the service, which closes the connection.
+    myClient->close();
+    frameConfig.maxMessageSize = 1024u * 1024u;
+    myClient = open_loopback_client("calculator_varint", frameConfig);
+    ASSERT_TRUE(myClient != nullptr);
+    gotResult = false;
+    myClient->add_vector(large, large, [&gotResult](const cercall::Result<std::vector<int64_t>> &res){
+        EXPECT_TRUE( !res);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 4), true);
+    EXPECT_FALSE(myClient->is_open());
+
+    myClient->close();
+    service->stop();
+}
+
+TEST_F(CallTest, test_invalid_frames)
+{
+    using cercall::details::Messenger;
+    struct StreamMock : public cercall::Transport
+    {
+        bool is_open() override     {   return !closed; }
+        bool open() override        {   return true;    }
+        void open(const cercall::Closure<bool>&) override {}
+        void close() override       {   closed = true;  }
+        void read(uint32_t len) override    {   requestedLen = len; }
+        bool reads_ahead() const override   {   return readsAhead;  }
+        cercall::DataView get_read_data() override
+        {
+            cercall::DataView view(stream.data() + readPos, requestedLen);
+            readPos += requestedLen;
+            return view;
+        }
+        cercall::Error write(const std::string& msg) override
+        {
+            stream += msg;
+            return cercall::Error();
+        }
+        std::string stream;
+        std::size_t readPos = 0;
+        uint32_t requestedLen = 0;
+        bool readsAhead = false;
+        bool closed = false;
+    } stream;
+
+    //A varint header would take a read per byte from a transport which doesn't read ahead.
+    cercall::FrameConfig frameConfig;
+    frameConfig.format = cercall::FrameFormat::VARINT;
+    unsigned receivedCount = 0;
+    Messenger receiver([&receivedCount](cercall::Transport&, const cercall::MessageView&){
+        ++receivedCount;
+    }, frameConfig);
+    EXPECT_THROW(receiver.init_transport(stream), std::logic_error);
+
+    //A zero message length is a protocol error, which closes the connection like an excessive length.
+    stream.readsAhead = true;
+    receiver.init_transport(stream);
+    stream.stream.assign("\x01m\x00", 3u);
+    EXPECT_EQ(receiver.read(stream, stream.stream.size()), 3u);
+    EXPECT_EQ(receivedCount, 1u);
+    EXPECT_TRUE(stream.closed);
+}
+
+TEST_F(CallTest, test_chunked_messages)
+{
+    cercall::FrameConfig frameConfig;
+    frameConfig.format = cercall::FrameFormat::FIXED_16;
+    frameConfig.chunkSize = 1000u;
+    auto service = create_loopback_service("calculator_chunked");
+    service->set_frame_config(frameConfig);
+    service->start();
+    myClient = open_loopback_client("calculator_chunked", frameConfig);
+    ASSERT_TRUE(myClient != nullptr);
+
+    //A message of one chunk.
+    bool gotResult = false;
+    myClient->add(10, 20, 30, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        ASSERT_EQ(res.get_value(), (10 + 20 + 30));
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 3), true);
+
+    //The arguments and the result are sent in many chunks, longer than 64 kB of the 16-bit header.
+    gotResult = false;
+    std::vector<int32_t> a = generate_data(16384u);
+    std::vector<int32_t> b = generate_data(16384u);
+    myClient->add_vector(a, b, [&gotResult, &a, &b](const cercall::Result<std::vector<int64_t>> &res){
+        EXPECT_FALSE( !res);
+        std::vector<int64_t> localResult(a.size());
+        std::transform (a.begin(), a.end(), b.begin(), localResult.begin(), std::plus<int64_t>());
+        EXPECT_EQ(res.get_value(), localResult);
+        gotResult = true;
+    });
+    //The chunks are passed to the transport a few in each turn of the event loop.
+    EXPECT_EQ(process_io_events(gotResult, 1024), true);
+
+    myClient->close();
+    service->stop();
+}
+
+TEST_F(CallTest, test_bulk_lane_pacing)
+{
+    //Reports when the service has passed the large result to its messenger.
+    struct VectorService : public ServiceType
+    {
+        using ServiceType::ServiceType;
+        void add_vector(const std::vector<int32_t>& a, const std::vector<int32_t>& b,
+                        cercall::Closure<std::vector<int64_t>> cl) override
+        {
+            ServiceType::add_vector(a, b, cl);
+            resultSent = true;
+        }
+        bool resultSent = false;
+    };
+
+    myClient->close();
+    cercall::FrameConfig frameConfig;
+    frameConfig.chunkSize = 16u * 1024u;
+    auto acceptor = cercall::make_unique<cercall::asio::TcpAcceptor>(myIoService, TEST_TCP_ACCEPTOR_PORT);
+    //The write queue of the service transport would take the whole result at once.
+    cercall::asio::StreamTransportConfig serviceConfig;
+    serviceConfig.asyncWrite = true;
+    serviceConfig.writeQueueHighWatermark = 64u * 1024u * 1024u;
+    acceptor->set_transport_config(serviceConfig);
+    auto service = std::make_shared<VectorService>(myIoService, std::move(acceptor), [](){});
+    service->set_frame_config(frameConfig);
+    service->start();
+
+    //The service runs in the thread of the client, which must not block in a write.
+    auto transport = cercall::make_unique<cercall::asio::ClientTcpTransport>(myIoService, TEST_SERVICE_HOST,
+                                                                            std::to_string(TEST_TCP_ACCEPTOR_PORT));
+    cercall::asio::StreamTransportConfig clientConfig;
+    clientConfig.asyncWrite = true;
+    transport->set_config(clientConfig);
+    myClient = std::make_shared<ClientType>(std::move(transport));
+    myClient->set_frame_config(frameConfig);
+    ASSERT_TRUE(myClient->open());
+    ASSERT_TRUE(receive_function_table(*myClient, 8));
+
+    const std::size_t vectorLength = 256u * 1024u;
+    bool gotVectorResult = false;
+    std::vector<int32_t> a = generate_data(vectorLength);
+    std::vector<int32_t> b = generate_data(vectorLength);
+    myClient->add_vector(a, b, [&gotVectorResult, vectorLength](const cercall::Result<std::vector<int64_t>> &res){
+        EXPECT_FALSE( !res);
+        EXPECT_EQ(res.get_value().size(), vectorLength);
+        gotVectorResult = true;
+    });
+    for (int i = 0; i < 100000 && !service->resultSent; ++i) {
+        myIoService.run_one();
+    }
+    ASSERT_TRUE(service->resultSent);
+
+    //The result of a small call overtakes the chunks of the large result, which are still being sent.
+    bool gotResult = false;
+    myClient->add(1, 2, 3, [&gotResult, &gotVectorResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        EXPECT_EQ(res.get_value(), (1 + 2 + 3));
+        EXPECT_FALSE(gotVectorResult);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 1000), true);
+    EXPECT_EQ(process_io_events(gotVectorResult, 100000), true);
+
+    myClient->close();
+    service->stop();
+}
+
+TEST_F(CallTest, test_function_table)
+{
+    //A client calling functions which the service does not provide.
+    struct MismatchedClient : public CalculatorClient<CalculatorInterface::Serialization>
+    {
+        using CalculatorClient<CalculatorInterface::Serialization>::CalculatorClient;
+
+        void subtract(int32_t a, int32_t b, cercall::Closure<int32_t> cl)
+        {
+            this->send_call(__func__, cl, a, b);
+        }
+
+        void add(int32_t a, int32_t b, cercall::Closure<int32_t> cl)
+        {
+            this->send_call(__func__, cl, a, b);
+        }
+    };
+
+    myClient->close();
+    auto transport = cercall::make_unique<cercall::asio::ClientTcpTransport>(myIoService, TEST_SERVICE_HOST, TEST_SERVICE_PORT_STR);
+    auto client = std::make_shared<MismatchedClient>(std::move(transport));
+    ASSERT_TRUE(client->open());
+    ASSERT_TRUE(receive_function_table(*client));
+
+    //The service of the same interface in this process has the same function table.
+    auto service = create_loopback_service("calculator_table");
+    EXPECT_EQ(client->get_interface_hash(), service->get_interface_hash());
+
+    //The calls fail without reaching the service.
+    bool gotResult = false;
+    client->subtract(2, 1, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_TRUE( !res);
+        EXPECT_EQ(res.error().code(), ENOSYS);
+        gotResult = true;
+    });
+    EXPECT_TRUE(gotResult);
+    EXPECT_FALSE(client->is_call_in_progress("subtract"));
+
+    gotResult = false;
+    client->add(1, 2, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_TRUE( !res);
+        EXPECT_EQ(res.error().code(), ENOSYS);
+        gotResult = true;
+    });
+    EXPECT_TRUE(gotResult);
+
+    //The calls of the interface functions go through.
+    gotResult = false;
+    client->CalculatorClient::add(1, 2, 3, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        EXPECT_EQ(res.get_value(), (1 + 2 + 3));
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 2), true);
+    client->close();
+
+    //A call made before the function table is received reaches the service, which replies without a result.
+    service->start();
+    auto loopback = cercall::make_unique<cercall::asio::ClientLoopbackTransport>(myIoService, "calculator_table");
+    client = std::make_shared<MismatchedClient>(std::move(loopback));
+    ASSERT_TRUE(client->open());
+    gotResult = false;
+    client->subtract(2, 1, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_TRUE( !res);
+        EXPECT_EQ(res.error().code(), ENOSYS);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 4), true);
+
+    //The archives of the connection are still in sync.
+    gotResult = false;
+    client->CalculatorClient::add(1, 2, 3, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        EXPECT_EQ(res.get_value(), (1 + 2 + 3));
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 4), true);
+    client->close();
+    service->stop();
+}
+
+TEST_F(CallTest, test_service_class_tables)
+{
+    //Another service class of the interface, which provides only some of the functions.
+    using BaseService = cercall::Service<CalculatorInterface, CalculatorInterface::Serialization>;
+    struct AdderService : public BaseService
+    {
+        AdderService(std::unique_ptr<cercall::Acceptor> ac, bool addVector) : BaseService(std::move(ac))
+        {
+            O_ADD_SERVICE_FUNCTIONS_OF(CalculatorInterface, false, add);
+            if (addVector) {
+                O_ADD_SERVICE_FUNCTIONS_OF(CalculatorInterface, false, add_vector);
+            }
+        }
+
+        void add(int8_t a, int16_t b, int32_t c, cercall::Closure<int32_t> cl) override
+        {
+            cl(static_cast<int32_t>(a + b + c));
+        }
+
+        void add_and_delay_result(int32_t, int32_t, cercall::Closure<int32_t>) override {}
+        void add_vector(const std::vector<int32_t>&, const std::vector<int32_t>&,
+                        cercall::Closure<std::vector<int64_t>>) override {}
+#if defined(TEST_CEREAL_BINARY) || defined(TEST_CEREAL_JSON)
+        void add_by_pointers(std::unique_ptr<int32_t>, std::unique_ptr<int32_t>, cercall::Closure<int32_t>) override {}
+#endif
+        void close_service() override {}
+        void get_connected_clients_count(cercall::Closure<size_t>) override {}
+    };
+
+    auto calculator = create_loopback_service("calculator_all");
+    auto adder = std::make_shared<AdderService>(
+                cercall::make_unique<cercall::asio::LoopbackAcceptor>(myIoService, "calculator_adder"), false);
+    //Each class has its own dispatch table.
+    EXPECT_NE(adder->get_interface_hash(), calculator->get_interface_hash());
+    EXPECT_EQ(create_loopback_service("calculator_all2")->get_interface_hash(), calculator->get_interface_hash());
+
+    adder->start();
+    auto client = open_loopback_client("calculator_adder");
+    ASSERT_TRUE(client != nullptr);
+    EXPECT_EQ(client->get_interface_hash(), adder->get_interface_hash());
+
+    bool gotResult = false;
+    client->add_vector({1}, {2}, [&gotResult](const cercall::Result<std::vector<int64_t>>& res){
+        EXPECT_TRUE( !res);
+        EXPECT_EQ(res.error().code(), ENOSYS);
+        gotResult = true;
+    });
+    EXPECT_TRUE(gotResult);
+
+    gotResult = false;
+    client->add(1, 2, 3, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        EXPECT_EQ(res.get_value(), (1 + 2 + 3));
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 2), true);
+    client->close();
+
+    //The table of a started service does not change, all instances of a class must add the same functions.
+    EXPECT_THROW(AdderService(cercall::make_unique<cercall::asio::LoopbackAcceptor>(myIoService, "calculator_adder2"),
+                              true), std::logic_error);
+    adder->stop();
+}
+
+TEST_F(CallTest, test_message_lanes)
+{
+    using cercall::details::Messenger;
+
+    //A byte stream, which reports the high watermark of its write queue after a number of writes.
+    struct StreamMock : public cercall::Transport
+    {
+        bool is_open() override     {   return true;    }
+        bool open() override        {   return true;    }
+        void open(const cercall::Closure<bool>&) override {}
+        void close() override {}
+        void read(uint32_t len) override    {   requestedLen = len; }
+        cercall::DataView get_read_data() override
+        {
+            cercall::DataView view(stream.data() + readPos, requestedLen);
+            readPos += requestedLen;
+            return view;
+        }
+        cercall::Error write(const std::string& msg) override
+        {
+            stream += msg;
+            return cercall::Error();
+        }
+        cercall::Error write(const cercall::DataView* buffers, std::size_t count) override
+        {
+            for (std::size_t i = 0; i < count; ++i) {
+                stream.append(buffers[i].data(), buffers[i].size());
+            }
+            if (++writeCount == writesUntilHigh) {
+                sender->on_write_queue_high();
+            }
+            return cercall::Error();
+        }
+        std::string stream;
+        std::size_t readPos = 0;
+        uint32_t requestedLen = 0;
+        unsigned writeCount = 0;
+        unsigned writesUntilHigh = 3;
+        Messenger* sender = nullptr;
+    } stream;
+
+    cercall::FrameConfig frameConfig;
+    frameConfig.chunkSize = 100u;
+    Messenger sender([](cercall::Transport&, const cercall::MessageView&){}, frameConfig);
+    stream.sender = &sender;
+
+    const std::string bulkMsg(1000u, 'b');
+    const std::string urgentMsg(10u, 'u');
+    sender.send(stream, bulkMsg);
+    EXPECT_EQ(stream.writeCount, 3u);
+    sender.send(stream, urgentMsg);
+    EXPECT_EQ(stream.writeCount, 4u);
+    sender.on_write_queue_low(stream);
+    EXPECT_EQ(stream.writeCount, 11u);
+
+    //The urgent message is received first, the chunks of the bulk message are reassembled.
+    std::vector<std::string> received;
+    Messenger receiver([&received](cercall::Transport&, const cercall::MessageView& msg){
+        std::string data;
+        for (std::size_t i = 0; i < msg.chunk_count(); ++i) {
+            data += msg.chunks()[i].to_string();
+        }
+        received.push_back(data);
+    }, frameConfig);
+    receiver.init_transport(stream);
+    receiver.read(stream, stream.stream.size());
+    ASSERT_EQ(received.size(), 2u);
+    EXPECT_EQ(received[0], urgentMsg);
+    EXPECT_EQ(received[1], bulkMsg);
+
+    //The receiver holds about the length of an incomplete message, not an allocation per chunk.
+    stream.stream.clear();
+    stream.readPos = 0;
+    stream.writesUntilHigh = 0;
+    const std::string largeMsg(1024u * 1024u, 'l');
+    sender.send(stream, largeMsg);
+    Messenger largeReceiver([&received](cercall::Transport&, const cercall::MessageView& msg){
+        std::string data;
+        for (std::size_t i = 0; i < msg.chunk_count(); ++i) {
+            data += msg.chunks()[i].to_string();
+        }
+        received.push_back(data);
+    }, frameConfig);
+    largeReceiver.init_transport(stream);
+    largeReceiver.read(stream, stream.stream.size() - 1u);
+    EXPECT_GE(largeReceiver.get_chunk_memory(), largeMsg.size() - frameConfig.chunkSize);
+    EXPECT_LE(largeReceiver.get_chunk_memory(), largeMsg.size() + 64u * 1024u + 1024u);
+    largeReceiver.read(stream, stream.stream.size() - stream.readPos);
+    ASSERT_EQ(received.size(), 3u);
+    EXPECT_EQ(received[2], largeMsg);
+    EXPECT_EQ(largeReceiver.get_chunk_memory(), 0u);
+}
+
+TEST_F(CallTest, test_local_binding)
+{
+    //The bound client calls the service functions directly, the transport is never opened.
+    bool serviceClosed = false;
+    auto service = create_loopback_service("calculator_local", [&serviceClosed](){
+        serviceClosed = true;
+    });
+
+    auto transport = cercall::make_unique<cercall::asio::ClientLoopbackTransport>(myIoService, "calculator_local");
+    myClient = std::make_shared<ClientType>(std::move(transport));
+    myClient->bind_local(*service, [this](std::function<void()> f) {
+        myIoService.post(std::move(f));
+    });
+
+    bool gotResult = false;
+    myClient->add(10, 20, 30, [&gotResult](const cercall::Result<int32_t>& res){
+        EXPECT_FALSE( !res);
+        ASSERT_EQ(res.get_value(), (10 + 20 + 30));
+        gotResult = true;
+    });
+    //The call is asynchronous.
+    EXPECT_FALSE(gotResult);
+    //Handlers for the aborted read of the closed client and the direct call.
+    EXPECT_EQ(process_io_events(gotResult, 2), true);
+
+    gotResult = false;
+    std::vector<int32_t> a = generate_data(8192u);
+    std::vector<int32_t> b = generate_data(8192u);
+    myClient->add_vector(a, b, [&gotResult, &a, &b](const cercall::Result<std::vector<int64_t>> &res){
+        EXPECT_FALSE( !res);
+        std::vector<int64_t> localResult(a.size());
+        std::transform (a.begin(), a.end(), b.begin(), localResult.begin(), std::plus<int64_t>());
+        EXPECT_EQ(res.get_value(), localResult);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 1), true);
+
+    myClient->close_service();
+    EXPECT_EQ(process_io_events(serviceClosed, 1), true);
+
+    //Without the binding, the calls need the open transport.
+    myClient->unbind_local();
+    EXPECT_THROW(myClient->get_connected_clients_count([](const cercall::Result<size_t>&){}), std::runtime_error);
+}
+
+TEST_F(CallTest, test_udp_transport)
+{
+#ifdef CERCALL_ASIO_HAS_UDP_TRANSPORT
+    myClient->close();
+    auto transport = cercall::make_unique<cercall::asio::ClientUdpTransport>(myIoService, TEST_SERVICE_HOST, TEST_SERVICE_UDP_PORT_STR);
+    myClient = std::make_shared<CalculatorClient<CalculatorInterface::Serialization>>(std::move(transport));
+    ASSERT_TRUE(myClient->open());
+
+    //Datagrams may be lost, so only one-way calls are allowed.
+    EXPECT_THROW(myClient->add(1, 2, 3, [](const cercall::Result<int32_t>&){}), std::logic_error);
+    myClient->close();
+#else
+    GTEST_SKIP() << "UDP transport not supported";
+#endif
+}
+
+TEST_F(CallTest, test_udp_truncated_datagram)
+{
+#ifdef CERCALL_ASIO_HAS_UDP_TRANSPORT
+    using cercall::details::Messenger;
+
+    //Receives the messages of the datagrams passed to the transport.
+    struct Receiver : public cercall::Transport::Listener
+    {
+        Receiver() : messenger([this](cercall::Transport&, const cercall::MessageView& msg){
+            std::string data;
+            for (std::size_t i = 0; i < msg.chunk_count(); ++i) {
+                data += msg.chunks()[i].to_string();
+            }
+            received.push_back(data);
+        }) {}
+        void on_connection_error(cercall::Transport&, const cercall::Error&) override {}
+        void on_disconnected(cercall::Transport&) override {}
+        std::size_t on_incoming_data(cercall::Transport& tr, std::size_t dataLenInBuffer) override
+        {
+            return messenger.read(tr, dataLenInBuffer);
+        }
+        Messenger messenger;
+        std::vector<std::string> received;
+    } receiver;
+
+    auto socket = std::make_shared<cercall::asio::DatagramSocket>(myIoService, cercall::asio::DatagramConfig());
+    cercall::asio::UdpTransport::Endpoint peer;
+    cercall::asio::UdpTransport transport(socket, &peer);
+    transport.set_listener(receiver);
+    ASSERT_TRUE(transport.open());
+    receiver.messenger.init_transport(transport);
+
+    //A message with the default 32-bit header.
+    auto message = [](uint32_t len, const std::string& data) {
+        std::string msg(sizeof(len), '\0');
+        std::memcpy(&msg[0], &len, sizeof(len));
+        return msg + data;
+    };
+    //The header announces more data than the datagram holds.
+    transport.deliver(message(100u, "truncated"));
+    transport.deliver(message(5u, "valid"));
+    ASSERT_EQ(receiver.received.size(), 1u);
+    EXPECT_EQ(receiver.received[0], "valid");
+
+    //The bytes after the last complete message.
+    transport.deliver(message(5u, "first") + "xy");
+    transport.deliver(message(6u, "second"));
+    ASSERT_EQ(receiver.received.size(), 3u);
+    EXPECT_EQ(receiver.received[1], "first");
+    EXPECT_EQ(receiver.received[2], "second");
+    transport.close();
+#else
+    GTEST_SKIP() << "UDP transport not supported";
+#endif
+}
+
+TEST_F(CallTest, test_udp_sender_limits)
+{
+#ifdef CERCALL_ASIO_HAS_UDP_TRANSPORT
+    //Opens the transports of the senders, like a service, and counts the open ones.
+    struct SenderListener : public cercall::Acceptor::Listener, public cercall::Transport::Listener
+    {
+        void on_client_accepted(std::shared_ptr<cercall::Transport> tr) override
+        {
+            tr->set_listener(*this);
+            tr->open();
+            ++openCount;
+            transports.push_back(tr);
+        }
+        void on_accept_error(const cercall::Error&) override {}
+        void on_connection_error(cercall::Transport&, const cercall::Error&) override {}
+        void on_disconnected(cercall::Transport&) override     {   --openCount;    }
+        std::size_t on_incoming_data(cercall::Transport&, std::size_t) override     {   return 0;   }
+        std::vector<std::shared_ptr<cercall::Transport>> transports;
+        int openCount = 0;
+    } listener;
+
+    cercall::asio::DatagramConfig config;
+    config.maxSenders = 2u;
+    config.senderIdleTimeout = std::chrono::milliseconds(50);
+    cercall::asio::UdpAcceptor acceptor(myIoService, TEST_UDP_ACCEPTOR_PORT, config);
+    acceptor.set_listener(listener);
+    acceptor.open();
+    ASSERT_TRUE(acceptor.is_open());
+
+    //The datagrams of a third sender are dropped.
+    using asio::ip::udp;
+    const udp::endpoint to(asio::ip::address::from_string(TEST_SERVICE_HOST), TEST_UDP_ACCEPTOR_PORT);
+    std::vector<std::unique_ptr<udp::socket>> senders;
+    for (int i = 0; i < 3; ++i) {
+        senders.push_back(cercall::make_unique<udp::socket>(myIoService, udp::endpoint(udp::v4(), 0)));
+        senders.back()->send_to(asio::buffer("x", 1u), to);
+    }
+    myIoService.run_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(listener.transports.size(), 2u);
+    EXPECT_EQ(listener.openCount, 2);
+
+    //The idle senders are closed, so a new sender is accepted.
+    myIoService.run_for(std::chrono::milliseconds(150));
+    EXPECT_EQ(listener.openCount, 0);
+    senders[2]->send_to(asio::buffer("x", 1u), to);
+    myIoService.run_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(listener.transports.size(), 3u);
+    EXPECT_EQ(listener.openCount, 1);
+    acceptor.close();
+#else
+    GTEST_SKIP() << "UDP transport not supported";
+#endif
+}
+
+TEST_F(CallTest, test_multi_threaded_service)
+{
+    const unsigned numClients = 4u;
+    std::vector<std::shared_ptr<ClientType>> clients;
+    for (unsigned i = 0; i < numClients; ++i) {
+        auto transport = cercall::make_unique<cercall::asio::ClientTcpTransport>(myIoService, TEST_SERVICE_HOST,
+                                                                                TEST_SERVICE_MT_PORT_STR);
+        clients.push_back(std::make_shared<ClientType>(std::move(transport)));
+        ASSERT_TRUE(clients.back()->open());
+    }
+
+    //The calls of all clients are processed concurrently by the service threads.
+    unsigned resultCount = 0;
+    bool gotAllResults = false;
+    std::vector<int32_t> a = generate_data(4096u);
+    std::vector<int32_t> b = generate_data(4096u);
+    for (unsigned i = 0; i < numClients; ++i) {
+        clients[i]->add_vector(a, b, [&](const cercall::Result<std::vector<int64_t>> &res){
+            EXPECT_FALSE( !res);
+            std::vector<int64_t> localResult(a.size());
+            std::transform (a.begin(), a.end(), b.begin(), localResult.begin(), std::plus<int64_t>());
+            EXPECT_EQ(res.get_value(), localResult);
+            gotAllResults = (++resultCount == 2u * numClients);
+        });
+        clients[i]->add(1, 2, static_cast<int32_t>(i), [&, i](const cercall::Result<int32_t>& res){
+            EXPECT_FALSE( !res);
+            EXPECT_EQ(res.get_value(), static_cast<int32_t>(1 + 2 + i));
+            gotAllResults = (++resultCount == 2u * numClients);
+        });
+    }
+    EXPECT_EQ(process_io_events(gotAllResults, 128), true);
+
+    bool gotResult = false;
+    clients[0]->get_connected_clients_count([&gotResult, numClients](const cercall::Result<size_t>& res){
+        EXPECT_FALSE( !res);
+        EXPECT_EQ(res.get_value(), numClients);
+        gotResult = true;
+    });
+    EXPECT_EQ(process_io_events(gotResult, 2), true);
+}
+
+TEST_F(CallTest, test_sharded_service)
+{
+    const unsigned numClients = 6u;
+    std::vector<std::shared_ptr<ClientType>> clients;
+    for (unsigned i = 0; i < numClients; ++i) {
+        auto transport = cercall::make_unique<cercall::asio::ClientTcpTransport>(myIoService, TEST_SERVICE_HOST,
+                                                                                TEST_SERVICE_SHARDED_PORT_STR);
+        clients.push_back(std::make_shared<ClientType>(std::move(transport)));
+        ASSERT_TRUE(clients.back()->open());
+    }
+
+    //The connections are distributed among the shards, each shard counts its own clients only.
+    unsigned resultCount = 0;
+    std::size_t connectedCount = 0;
+    bool gotAllResults = false;
+    for (unsigned i = 0; i < numClients; ++i) {
+        clients[i]->add(1, 2, static_cast<int32_t>(i), [&, i](const cercall::Result<int32_t>& res){
+            EXPECT_FALSE( !res);
+            EXPECT_EQ(res.get_value(), static_cast<int32_t>(1 + 2 + i));
+            gotAllResults = (++resultCount == 2u * numClients);
+        });
+        clients[i]->get_connected_clients_count([&](const cercall::Result<size_t>& res){
+            EXPECT_FALSE( !res);
+            connectedCount = std::max(connectedCount, res.get_value());
+            gotAllResults = (++resultCount == 2u * numClients);
+        });
+    }
+    EXPECT_EQ(process_io_events(gotAllResults, 64), true);
+    EXPECT_GT(connectedCount, 0u);
+    EXPECT_LE(connectedCount, numClients);
+}
+
 TEST_F(CallTest, test_many_clients)
 {
     const unsigned numClients = 4u;
@@ -21,12 +21,38 @@
 #include "debug.h"
 #include "cercall/cercall.h"
 #include "cercall/asio/tcpacceptor.h"
+#include "cercall/asio/localacceptor.h"
+#include "cercall/asio/shmacceptor.h"
+#include "cercall/asio/shardedservice.h"
+#include "cercall/asio/uringacceptor.h"
 #include "calculatorservice.h"
 #include <algorithm>
 #include "testutil.h"
 
 static asio::io_service ioService;
 static std::shared_ptr<asio::io_service::work> iosWork;
+static const unsigned mtServiceThreadCount = 3u;
+static const unsigned serviceShardCount = 2u;
+
+/** Threads running an io_service, the io_service is stopped and the threads joined on destruction. */
+struct IoServiceThreads
+{
+    IoServiceThreads(asio::io_service& ios, unsigned count) : myIoService(ios)
+    {
+        for (unsigned i = 0; i < count; ++i) {
+            myThreads.emplace_back([&ios]() { ios.run(); });
+        }
+    }
+    ~IoServiceThreads()
+    {
+        myIoService.stop();
+        for (std::thread& t : myThreads) {
+            t.join();
+        }
+    }
+    asio::io_service& myIoService;
+    std::vector<std::thread> myThreads;
+};
 
 void signal_handler(const std::error_code&, int signal_number)
 {
@@ -51,9 +77,52 @@ int main(int ac, char *av[])
         using CalculatorServiceType = CalculatorService<CalculatorInterface::Serialization>;
         std::shared_ptr<CalculatorServiceType> service = std::make_shared<CalculatorServiceType>(ioService, std::move(acceptor),
                                                                                          closeAction);
+        auto localAcceptor = cercall::make_unique<cercall::asio::LocalAcceptor>(ioService, TEST_SERVICE_LOCAL_PATH);
+        std::shared_ptr<CalculatorServiceType> localService = std::make_shared<CalculatorServiceType>(ioService,
+                                                                                         std::move(localAcceptor),
+                                                                                         closeAction);
+        //Small rings, so that large messages wrap around and wait for free space.
+        auto shmAcceptor = cercall::make_unique<cercall::asio::ShmAcceptor>(ioService, TEST_SERVICE_SHM_PATH, 4096u);
+        std::shared_ptr<CalculatorServiceType> shmService = std::make_shared<CalculatorServiceType>(ioService,
+                                                                                         std::move(shmAcceptor),
+                                                                                         closeAction);
+        std::shared_ptr<CalculatorServiceType> uringService;
+#ifdef CERCALL_ASIO_HAS_URING
+        try {
+            auto uringAcceptor = cercall::make_unique<cercall::asio::UringAcceptor>(ioService, TEST_SERVICE_URING_PORT);
+            //A small receive buffer, so that large messages grow it and the registered buffer is replaced.
+            cercall::asio::StreamTransportConfig uringConfig;
+            uringConfig.receiveBufferSize = 4096u;
+            uringAcceptor->set_transport_config(uringConfig);
+            uringService = std::make_shared<CalculatorServiceType>(ioService, std::move(uringAcceptor), closeAction);
+        } catch (std::system_error& e) {
+            cercall::log<cercall::error>(O_LOG_TOKEN, "io_uring service not available: %s", e.what());
+        }
+#endif
+        //A multi-threaded service with its own io_service.
+        asio::io_service mtIoService;
+        auto mtAcceptor = cercall::make_unique<cercall::asio::TcpAcceptor>(mtIoService, TEST_SERVICE_MT_PORT);
+        std::shared_ptr<CalculatorServiceType> mtService = std::make_shared<CalculatorServiceType>(mtIoService,
+                                                                                         std::move(mtAcceptor),
+                                                                                         closeAction, true);
+        asio::io_service::work mtWork(mtIoService);
+        mtService->start();
+        IoServiceThreads mtThreads(mtIoService, mtServiceThreadCount);
+        //Service shards sharing a port.
+        cercall::asio::ShardedService<CalculatorServiceType> shardedService(serviceShardCount,
+                [closeAction](asio::io_service& ios, unsigned) {
+                    auto shardAcceptor = cercall::make_unique<cercall::asio::TcpAcceptor>(ios, TEST_SERVICE_SHARDED_PORT, true);
+                    return std::make_shared<CalculatorServiceType>(ios, std::move(shardAcceptor), closeAction);
+                });
+        shardedService.start();
         iosWork = std::make_shared<asio::io_service::work>(ioService);
 
         service->start();
+        localService->start();
+        shmService->start();
+        if (uringService) {
+            uringService->start();
+        }
         if (ac > 1 && std::string(av[1]) == "-t") {
             cercall::log<cercall::debug>(O_LOG_TOKEN, "connection reset test");
             std::this_thread::sleep_for(std::chrono::milliseconds(500));
@@ -50,6 +50,7 @@ protected:
     void SetUp() override
     {
         myClient = create_open_client(myIoService);
+        ASSERT_TRUE(receive_function_table(*myClient));
     }
 
     void TearDown() override
@@ -107,20 +108,26 @@ TEST_F(ErrorsTest, test_accept_error)
 
 TEST_F(ErrorsTest, test_double_call_on_service)
 {
-    //The Client class template protects against a 2nd function call on Service before
-    //receving response from the 1st call. So lower-level classes must be used to stimulate that condition.
+    //The Client class template never reuses the id of a call before receving response to it.
+    //So lower-level classes must be used to stimulate a 2nd call with the same id.
     using namespace cercall::details;
     using Serialization = CalculatorInterface::Serialization;
     auto transport = std::make_shared<cercall::asio::ClientTcpTransport>(myIoService, TEST_SERVICE_HOST, TEST_SERVICE_PORT_STR);
     std::string funcName = "CalculatorInterface::add_and_delay_result";
     int32_t param = 0;
-    std::string callMsg = CalculatorInterface::Serialization::serialize_call(nullptr, funcName, param, param);
+    std::string callMsg = CalculatorInterface::Serialization::serialize_call(nullptr, cercall::details::function_id(funcName.c_str()), 1,
+                                                                             param, param);
 
     struct ClientMock : public cercall::asio::ClientTcpTransport::Listener
     {
-        ClientMock() : messenger ([](cercall::Transport&, const std::string& msg) {
-            Serialization::deserialize_call(nullptr, msg, [](const std::string& funcName, Serialization::InputArchive& arRes){
-                EXPECT_EQ(funcName, "CalculatorInterface::add_and_delay_result");
+        ClientMock() : messenger ([](cercall::Transport&, const cercall::MessageView& msg) {
+            Serialization::deserialize_call(nullptr, msg, [](cercall::FunctionId funcId, cercall::CallId callId,
+                                                              Serialization::InputArchive& arRes){
+                if (funcId == cercall::details::functionTableId) {
+                    return;     //the service sends its function table first
+                }
+                EXPECT_EQ(funcId, cercall::details::function_id("CalculatorInterface::add_and_delay_result"));
+                EXPECT_EQ(callId, 1U);
                 cercall::Result<int32_t> result = Serialization::deserialize_result<int32_t>(arRes);
                 //std::cout << "result: " << result.error().message() << '\n';
                 EXPECT_EQ(result.error().code(), EINPROGRESS);
@@ -152,8 +159,8 @@ TEST_F(ErrorsTest, test_double_call_on_service)
 
     transport->set_listener(clientMock);
     clientMock.open(*transport);
-    Messenger::write_message_with_header(*transport, callMsg);
-    Messenger::write_message_with_header(*transport, callMsg);
+    Messenger::write_message(*transport, callMsg);
+    Messenger::write_message(*transport, callMsg);
     myIoService.run_one();
     myIoService.run_one();
     transport->close();
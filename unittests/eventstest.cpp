@@ -21,6 +21,11 @@
 #include <gtest/gtest.h>
 #include "cercall/client.h"
 #include "cercall/asio/clienttcptransport.h"
+#include "cercall/asio/clientudptransport.h"
+#include "cercall/asio/multicasttransport.h"
+#include "cercall/asio/clientloopbacktransport.h"
+#include "cercall/asio/loopbackacceptor.h"
+#include "cercall/service.h"
 #include "process.h"
 #include "testutil.h"
 #include "simpleeventsourceinterface.h"
@@ -84,6 +89,7 @@ protected:
     void SetUp() override
     {
         MyBase::myClient = MyBase::create_open_client(MyBase::myIoService);
+        ASSERT_TRUE(MyBase::receive_function_table(*MyBase::myClient));
     }
 
     void TearDown() override
@@ -135,6 +141,99 @@ TEST_F(SimpleEventsTest, test_simple_events)
     EXPECT_EQ(simpleEventsListener.receivedEvent, SimpleEventSourceClient::EventType::EVENT_TWO);
 }
 
+TEST_F(SimpleEventsTest, test_simple_events_udp)
+{
+#ifdef CERCALL_ASIO_HAS_UDP_TRANSPORT
+    auto transport = cercall::make_unique<cercall::asio::ClientUdpTransport>(myIoService, TEST_SERVICE_HOST,
+                                                                            TEST_SERVICE_UDP_PORT_STR);
+    SimpleEventSourceClient udpClient(std::move(transport));
+    ASSERT_TRUE(udpClient.open());
+    udpClient.add_listener(simpleEventsListener);
+
+    //The one-way call and the event are sent in datagrams.
+    simpleEventsListener.reset();
+    udpClient.trigger_single_broadcast(SimpleEventSourceClient::EventType::EVENT_TWO);
+    EXPECT_EQ(process_io_events(simpleEventsListener.gotEvent, 4), true);
+    EXPECT_EQ(simpleEventsListener.receivedEvent, SimpleEventSourceClient::EventType::EVENT_TWO);
+    udpClient.remove_listener(simpleEventsListener);
+#else
+    GTEST_SKIP() << "UDP transport not supported";
+#endif
+}
+
+TEST_F(SimpleEventsTest, test_multicast_events)
+{
+#ifdef CERCALL_ASIO_HAS_UDP_TRANSPORT
+    auto transport = cercall::make_unique<cercall::asio::ClientTcpTransport>(myIoService, TEST_SERVICE_HOST,
+                                                                            TEST_SERVICE_MCAST_PORT_STR);
+    SimpleEventSourceClient mcastClient(std::move(transport));
+    ASSERT_TRUE(mcastClient.open());
+    auto channelTr = cercall::make_unique<cercall::asio::MulticastSubscriber>(myIoService, TEST_MULTICAST_GROUP,
+                                                                             TEST_MULTICAST_PORT);
+    cercall::asio::MulticastSubscriber* channel = channelTr.get();
+    if ( !mcastClient.open_event_channel(std::move(channelTr))) {
+        GTEST_SKIP() << "multicast not available";
+    }
+    mcastClient.add_listener(simpleEventsListener);
+
+    //The events are published once to the group, the sequence numbers must not have gaps.
+    for (auto et : { SimpleEventSourceClient::EventType::EVENT_ONE, SimpleEventSourceClient::EventType::EVENT_TWO }) {
+        simpleEventsListener.reset();
+        mcastClient.trigger_single_broadcast(et);
+        EXPECT_EQ(process_io_events(simpleEventsListener.gotEvent, 4), true);
+        EXPECT_EQ(simpleEventsListener.receivedEvent, et);
+    }
+    EXPECT_EQ(channel->get_lost_count(), 0u);
+    mcastClient.remove_listener(simpleEventsListener);
+#else
+    GTEST_SKIP() << "UDP transport not supported";
+#endif
+}
+
+TEST_F(SimpleEventsTest, test_broadcast_with_failing_client)
+{
+    class LocalEventSourceService
+        : public cercall::Service<SimpleEventSourceInterface, SimpleEventSourceInterface::Serialization>
+    {
+    public:
+        using cercall::Service<SimpleEventSourceInterface, SimpleEventSourceInterface::Serialization>::Service;
+
+        void trigger_single_broadcast(EventType) override {}
+    };
+
+    asio::io_service::work work(myIoService);
+    auto acceptor = cercall::make_unique<cercall::asio::LoopbackAcceptor>(myIoService, "events_failing_client");
+    LocalEventSourceService service(std::move(acceptor));
+    service.start();
+
+    std::vector<std::unique_ptr<SimpleEventSourceClient>> clients;
+    std::vector<SimpleEventsListener> listeners(3u);
+    for (SimpleEventsListener& listener : listeners) {
+        auto transport = cercall::make_unique<cercall::asio::ClientLoopbackTransport>(myIoService,
+                                                                                     "events_failing_client");
+        clients.push_back(cercall::make_unique<SimpleEventSourceClient>(std::move(transport)));
+        ASSERT_TRUE(clients.back()->open());
+        ASSERT_TRUE(receive_function_table(*clients.back()));
+        clients.back()->add_listener(listener);
+    }
+
+    //The write to the middle client fails during the broadcast, which removes it from the service.
+    clients[1].reset();
+    service.broadcast_event(SimpleEventSourceClient::EventType::EVENT_THREE);
+    myIoService.poll();     //the loopback transports deliver the messages in posted handlers
+    for (std::size_t i : { 0u, 2u }) {
+        EXPECT_TRUE(listeners[i].gotEvent);
+        EXPECT_EQ(listeners[i].receivedEvent, SimpleEventSourceClient::EventType::EVENT_THREE);
+    }
+
+    for (std::unique_ptr<SimpleEventSourceClient>& client : clients) {
+        if (client) {
+            client->close();
+        }
+    }
+    service.stop();
+}
+
 using PolyEventsTest = EventsTest<PolyEventSourceClient>;
 
 class PolyEventsListener : public PolyEventSourceClient::ServiceListener
@@ -198,3 +297,30 @@ TEST_F(PolyEventsTest, test_poly_events)
         EXPECT_EQ(evClassThree->myEventDict, testEventDataClassThree);
     }
 }
+
+TEST_F(PolyEventsTest, test_poly_events_many_clients)
+{
+    //An event is serialized once for all clients, whatever events each of them received before.
+    myClient->add_listener(polyEventsListener);
+    PolyEventSourceClient::EventType::Ptr ev = std::make_unique<RealEventClassTwo>(1);
+    myClient->trigger_single_broadcast(std::move(ev));
+    EXPECT_EQ(process_io_events(polyEventsListener.gotEvent, 2), true);
+
+    PolyEventsListener secondListener;
+    std::shared_ptr<PolyEventSourceClient> secondClient = create_open_client(myIoService);
+    ASSERT_TRUE(receive_function_table(*secondClient));
+    secondClient->add_listener(secondListener);
+
+    polyEventsListener.reset();
+    ev = std::make_unique<RealEventClassTwo>(2);
+    myClient->trigger_single_broadcast(std::move(ev));
+    EXPECT_EQ(process_io_events(polyEventsListener.gotEvent, 4), true);
+    EXPECT_EQ(process_io_events(secondListener.gotEvent, 4), true);
+    for (PolyEventsListener* listener : { &polyEventsListener, &secondListener }) {
+        ASSERT_NE(listener->receivedEvent, nullptr);
+        const auto evClassTwo = listener->receivedEvent->get_as<RealEventClassTwo>();
+        ASSERT_NE(evClassTwo, nullptr);
+        EXPECT_EQ(evClassTwo->myEventData, 2);
+    }
+    secondClient->close();
+}
@@ -23,6 +23,8 @@
 #include "simpleeventsourceinterface.h"
 #include "polyeventsourceinterface.h"
 #include "cercall/asio/tcpacceptor.h"
+#include "cercall/asio/udpacceptor.h"
+#include "cercall/asio/multicasttransport.h"
 #include <algorithm>
 #include "testutil.h"
 
@@ -123,6 +125,21 @@ void run_service(void)
         std::shared_ptr<Service> service = std::make_shared<Service>(ioService, std::move(acceptor));
 
         service->start();
+#ifdef CERCALL_ASIO_HAS_UDP_TRANSPORT
+        auto udpAcceptor = cercall::make_unique<cercall::asio::UdpAcceptor>(ioService, TEST_SERVICE_UDP_PORT);
+        std::shared_ptr<Service> udpService = std::make_shared<Service>(ioService, std::move(udpAcceptor));
+        udpService->start();
+
+        auto mcastAcceptor = cercall::make_unique<cercall::asio::TcpAcceptor>(ioService, TEST_SERVICE_MCAST_PORT);
+        std::shared_ptr<Service> mcastService = std::make_shared<Service>(ioService, std::move(mcastAcceptor));
+        try {
+            mcastService->set_event_channel(std::make_shared<cercall::asio::MulticastPublisher>(ioService,
+                                                        TEST_MULTICAST_GROUP, TEST_MULTICAST_PORT));
+        } catch (std::runtime_error& e) {
+            std::cerr << "Multicast not available: " << e.what() << "\n";
+        }
+        mcastService->start();
+#endif
         ioService.run();
     } catch (std::exception& e) {
         std::cerr << "Exception: " << e.what() << "\n";
@@ -30,6 +30,23 @@
 #define TEST_SERVICE_HOST "127.0.0.1"
 #define TEST_SERVICE_PORT  static_cast<unsigned short>(56789)
 #define TEST_SERVICE_PORT_STR "56789"
+#define TEST_SERVICE_MT_PORT  static_cast<unsigned short>(56790)
+#define TEST_SERVICE_MT_PORT_STR "56790"
+#define TEST_SERVICE_SHARDED_PORT  static_cast<unsigned short>(56791)
+#define TEST_SERVICE_SHARDED_PORT_STR "56791"
+#define TEST_SERVICE_URING_PORT  static_cast<unsigned short>(56792)
+#define TEST_SERVICE_URING_PORT_STR "56792"
+#define TEST_SERVICE_UDP_PORT  static_cast<unsigned short>(56793)
+#define TEST_SERVICE_UDP_PORT_STR "56793"
+#define TEST_SERVICE_MCAST_PORT  static_cast<unsigned short>(56794)
+#define TEST_SERVICE_MCAST_PORT_STR "56794"
+#define TEST_MULTICAST_GROUP "239.255.0.1"
+#define TEST_MULTICAST_PORT  static_cast<unsigned short>(56795)
+#define TEST_UDP_ACCEPTOR_PORT  static_cast<unsigned short>(56796)
+#define TEST_TCP_ACCEPTOR_PORT  static_cast<unsigned short>(56797)
+#define TEST_SERVICE_LOCAL_PATH "@cercall_test_service"
+#define TEST_SERVICE_SHM_PATH "@cercall_test_shm_service"
+#define TEST_SHM_ACCEPTOR_PATH "@cercall_test_shm_acceptor"
 
 template<typename T>
 struct has_close_method
@@ -113,6 +130,17 @@ protected:
         return closureCalled;
     }
 
+    /** Process the function table, which the service sends first to a new client. */
+    template<class C>
+    bool receive_function_table(C& client, int maxNumHandlers = 4)
+    {
+        while (client.get_interface_hash() == 0 && maxNumHandlers) {
+            myIoService.run_one();
+            --maxNumHandlers;
+        }
+        return client.get_interface_hash() != 0;
+    }
+
     asio::io_service myIoService;
     std::shared_ptr<Client> myClient;
 